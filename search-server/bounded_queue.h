@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Ограниченная очередь без блокировок для нескольких писателей и читателей
+// (схема Д. Вьюкова). Ёмкость округляется вверх до степени двойки. Каждая ячейка
+// хранит номер позиции, по которому писатель и читатель узнают, свободна ли она.
+// Push ждёт места в заполненной очереди: так медленная стадия конвейера
+// притормаживает быструю и расход памяти остаётся ограниченным. Ожидающий
+// поток недолго уступает процессор, а затем засыпает до сигнала другой стороны,
+// чтобы не отнимать процессор у медленной стадии
+template <typename T>
+class BoundedQueue {
+public:
+    // Число попыток перед засыпанием
+    static constexpr size_t SPIN_COUNT = 64;
+
+    explicit BoundedQueue(size_t capacity);
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Возвращает false, если очередь заполнена; тогда value не изменяется
+    bool TryPush(T& value);
+
+    bool TryPop(T& value);
+
+    void Push(T value);
+
+    // Ждёт элемента; возвращает false, если очередь закрыта и пуста
+    bool Pop(T& value);
+
+    // Сообщает читателям, что элементов больше не будет
+    void Close();
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> push_position_ = 0;
+    alignas(64) std::atomic<size_t> pop_position_ = 0;
+    std::atomic<bool> is_closed_ = false;
+    // спящие писатели и читатели; пока их нет, сигналы не отправляются
+    std::mutex wait_mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::atomic<size_t> waiting_count_ = 0;
+
+    // Ждёт, пока is_ready не вернёт true
+    template <typename Predicate>
+    void Await(std::condition_variable& condition, Predicate is_ready);
+    // Будит один поток, ждущий condition
+    void Notify(std::condition_variable& condition);
+
+    static size_t RoundUpToPowerOfTwo(size_t value);
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+    : cells_(new Cell[RoundUpToPowerOfTwo(capacity)])
+    , mask_(RoundUpToPowerOfTwo(capacity) - 1)
+{
+    for (size_t i = 0; i <= mask_; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(T& value) {
+    size_t position = push_position_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (push_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.value = std::move(value);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            // ячейку ещё не освободил читатель: очередь заполнена
+            return false;
+        } else {
+            position = push_position_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPop(T& value) {
+    size_t position = pop_position_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if (difference == 0) {
+            if (pop_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                value = std::move(cell.value);
+                cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            // ячейку ещё не заполнил писатель: очередь пуста
+            return false;
+        } else {
+            position = pop_position_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+void BoundedQueue<T>::Push(T value) {
+    Await(not_full_, [&] {
+        return TryPush(value);
+    });
+    Notify(not_empty_);
+}
+
+template <typename T>
+bool BoundedQueue<T>::Pop(T& value) {
+    bool is_popped = false;
+    Await(not_empty_, [&] {
+        if (TryPop(value)) {
+            is_popped = true;
+            return true;
+        }
+        if (is_closed_.load(std::memory_order_acquire)) {
+            // элемент мог быть добавлен перед закрытием
+            is_popped = TryPop(value);
+            return true;
+        }
+        return false;
+    });
+    if (is_popped) {
+        Notify(not_full_);
+    }
+    return is_popped;
+}
+
+template <typename T>
+void BoundedQueue<T>::Close() {
+    is_closed_.store(true, std::memory_order_release);
+    {
+        std::lock_guard lock(wait_mutex_);
+    }
+    not_empty_.notify_all();
+}
+
+template <typename T>
+template <typename Predicate>
+void BoundedQueue<T>::Await(std::condition_variable& condition, Predicate is_ready) {
+    for (size_t i = 0; i < SPIN_COUNT; ++i) {
+        if (is_ready()) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+    std::unique_lock lock(wait_mutex_);
+    waiting_count_.fetch_add(1, std::memory_order_relaxed);
+    // счётчик виден другой стороне раньше, чем проверяется состояние очереди
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition.wait(lock, is_ready);
+    waiting_count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+void BoundedQueue<T>::Notify(std::condition_variable& condition) {
+    // изменение очереди видно спящему потоку раньше, чем проверяется счётчик
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_count_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    // блокировка не даёт сигналу проскочить между проверкой условия и засыпанием
+    {
+        std::lock_guard lock(wait_mutex_);
+    }
+    condition.notify_one();
+}
+
+template <typename T>
+size_t BoundedQueue<T>::RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
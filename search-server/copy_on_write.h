@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Значение, разделяемое между версиями индекса. Копия CopyOnWrite ссылается
+// на то же значение; перед изменением значение копируется, если на него
+// ссылается кто-то ещё. Изменять значение может только один поток
+template <typename T>
+class CopyOnWrite {
+public:
+    CopyOnWrite() = default;
+
+    explicit operator bool() const {
+        return value_ != nullptr;
+    }
+
+    const T& operator*() const {
+        return *value_;
+    }
+
+    const T* operator->() const {
+        return value_.get();
+    }
+
+    template <typename... Args>
+    T& emplace(Args&&... args) {
+        value_ = std::make_shared<T>(std::forward<Args>(args)...);
+        return *value_;
+    }
+
+    void reset() {
+        value_.reset();
+    }
+
+    // Значение для изменения; пустое значение создаётся
+    T& Mutable() {
+        if (!value_) {
+            value_ = std::make_shared<T>();
+        } else if (value_.use_count() > 1) {
+            value_ = std::make_shared<T>(*value_);
+        }
+        return *value_;
+    }
+
+private:
+    std::shared_ptr<T> value_;
+};
+
+// Массив из частей по CHUNK_SIZE элементов. Копия массива разделяет части
+// с оригиналом, при изменении копируется только изменяемая часть
+template <typename T>
+class ChunkedVector {
+public:
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return (*chunks_[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+    }
+
+    T& Mutable(size_t index) {
+        return chunks_[index / CHUNK_SIZE].Mutable()[index % CHUNK_SIZE];
+    }
+
+    void push_back(T value) {
+        if (size_ % CHUNK_SIZE == 0) {
+            chunks_.emplace_back().emplace().reserve(CHUNK_SIZE);
+        }
+        chunks_.back().Mutable().push_back(std::move(value));
+        ++size_;
+    }
+
+private:
+    std::vector<CopyOnWrite<std::vector<T>>> chunks_;
+    size_t size_ = 0;
+};
+
+// Хеш-таблица из SHARD_COUNT независимых частей. Копия таблицы разделяет части
+// с оригиналом, при изменении копируется только изменяемая часть
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class CopyOnWriteHashMap {
+public:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    size_t size() const {
+        return size_;
+    }
+
+    const Value* Find(const Key& key) const {
+        const CopyOnWrite<Shard>& shard = shards_[GetShardIndex(key)];
+        if (!shard) {
+            return nullptr;
+        }
+        const auto it = shard->find(key);
+        return it == shard->end() ? nullptr : &it->second;
+    }
+
+    bool Contains(const Key& key) const {
+        return Find(key) != nullptr;
+    }
+
+    // Возвращает false, если ключ уже есть
+    bool Insert(const Key& key, Value value) {
+        const bool is_inserted = shards_[GetShardIndex(key)].Mutable().emplace(key, std::move(value)).second;
+        size_ += is_inserted;
+        return is_inserted;
+    }
+
+    bool Erase(const Key& key) {
+        CopyOnWrite<Shard>& shard = shards_[GetShardIndex(key)];
+        if (!shard || shard->count(key) == 0) {
+            return false;
+        }
+        shard.Mutable().erase(key);
+        --size_;
+        return true;
+    }
+
+private:
+    using Shard = std::unordered_map<Key, Value, Hash>;
+
+    std::array<CopyOnWrite<Shard>, SHARD_COUNT> shards_;
+    size_t size_ = 0;
+
+    static size_t GetShardIndex(const Key& key) {
+        // младшие биты хеша выбирают корзину внутри части, поэтому часть выбирается по старшим
+        const size_t hash = Hash{}(key);
+        return (hash ^ (hash >> 29)) * 0x9E3779B97F4A7C15ull >> 58;
+    }
+};
@@ -0,0 +1,260 @@
+#include "corpus_ingestion.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+
+using namespace std;
+
+namespace {
+
+struct CorpusChunk {
+    size_t sequence = 0;
+    string text;
+};
+
+// Документы пакета ссылаются на текст своего блока
+struct DocumentBatch {
+    size_t sequence = 0;
+    unique_ptr<CorpusChunk> chunk;
+    vector<NewDocument> documents;
+    size_t rejected_count = 0;
+};
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+optional<DocumentStatus> ParseStatus(string_view text) {
+    if (text == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    } else if (text == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    } else if (text == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    } else if (text == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    return nullopt;
+}
+
+// Отрезает от text поле до табуляции; false, если табуляции нет
+bool CutField(string_view& text, string_view& field) {
+    const size_t tab = text.find('\t');
+    if (tab == text.npos) {
+        return false;
+    }
+    field = text.substr(0, tab);
+    text.remove_prefix(tab + 1);
+    return true;
+}
+
+bool ParseLine(string_view line, NewDocument& document) {
+    string_view id;
+    string_view status;
+    string_view ratings;
+    if (!CutField(line, id) || !CutField(line, status) || !CutField(line, ratings) || !ParseInt(id, document.id)) {
+        return false;
+    }
+    const optional<DocumentStatus> parsed_status = ParseStatus(status);
+    if (!parsed_status) {
+        return false;
+    }
+    document.status = *parsed_status;
+    document.ratings.clear();
+    while (!ratings.empty()) {
+        const size_t space = ratings.find(' ');
+        int rating = 0;
+        if (!ParseInt(ratings.substr(0, space), rating)) {
+            return false;
+        }
+        document.ratings.push_back(rating);
+        ratings.remove_prefix(space == ratings.npos ? ratings.size() : space + 1);
+    }
+    document.text = line;
+    return true;
+}
+
+DocumentBatch ParseChunk(unique_ptr<CorpusChunk> chunk) {
+    DocumentBatch batch;
+    batch.sequence = chunk->sequence;
+    string_view text = chunk->text;
+    while (!text.empty()) {
+        const size_t end_of_line = text.find('\n');
+        string_view line = text.substr(0, end_of_line);
+        text.remove_prefix(end_of_line == text.npos ? text.size() : end_of_line + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        NewDocument document;
+        if (ParseLine(line, document)) {
+            batch.documents.push_back(move(document));
+        } else {
+            ++batch.rejected_count;
+        }
+    }
+    batch.chunk = move(chunk);
+    return batch;
+}
+
+// Добавляет документы пакета, пропуская отвергнутые. Возвращает число отвергнутых
+size_t AddBatch(SearchServer& search_server, const vector<NewDocument>& documents) {
+    vector<size_t> rejected;
+    search_server.AddDocuments(execution::par, documents, rejected);
+    return rejected.size();
+}
+
+} // namespace
+
+double IngestionStats::GetMegabytesPerSecond() const {
+    return seconds > 0 ? byte_count / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+double IngestionStats::GetDocumentsPerSecond() const {
+    return seconds > 0 ? document_count / seconds : 0.0;
+}
+
+ostream& operator<<(ostream& out, const IngestionStats& stats) {
+    out << stats.document_count << " documents ("s << stats.rejected_count << " rejected), "s
+        << stats.byte_count << " bytes in "s << stats.seconds << " s: "s
+        << stats.GetMegabytesPerSecond() << " MB/s, "s << stats.GetDocumentsPerSecond() << " documents/s"s;
+    return out;
+}
+
+IngestionStats IngestCorpus(SearchServer& search_server, istream& input, const IngestionOptions& options) {
+    const auto start_time = chrono::steady_clock::now();
+    const size_t chunk_size = max<size_t>(options.chunk_size, 1);
+    const size_t max_chunks_in_flight = max<size_t>(options.max_chunks_in_flight, 1);
+    const size_t parser_count = options.parser_count > 0
+        ? options.parser_count
+        : max<size_t>(thread::hardware_concurrency(), 1);
+
+    BoundedQueue<unique_ptr<CorpusChunk>> chunks(max_chunks_in_flight);
+    BoundedQueue<DocumentBatch> batches(max_chunks_in_flight);
+    // номер первого ещё не проиндексированного блока
+    atomic<size_t> indexed_sequence = 0;
+    atomic<bool> is_cancelled = false;
+    // читатель спит, пока блоков в обработке слишком много
+    mutex window_mutex;
+    condition_variable window_changed;
+    const auto notify_window_changed = [&] {
+        {
+            lock_guard lock(window_mutex);
+        }
+        window_changed.notify_one();
+    };
+    IngestionStats stats;
+
+    thread reader([&] {
+        string tail;
+        for (size_t sequence = 0; !is_cancelled;) {
+            string text = move(tail);
+            tail.clear();
+            const size_t old_size = text.size();
+            text.resize(old_size + chunk_size);
+            input.read(text.data() + old_size, chunk_size);
+            const size_t read_count = input.gcount();
+            text.resize(old_size + read_count);
+            stats.byte_count += read_count;
+            const bool is_end = read_count < chunk_size;
+            if (!is_end) {
+                // неполная последняя строка переходит в следующий блок
+                const size_t last_end_of_line = text.rfind('\n');
+                if (last_end_of_line == text.npos) {
+                    tail = move(text);
+                    continue;
+                }
+                tail.assign(text, last_end_of_line + 1);
+                text.resize(last_end_of_line + 1);
+            }
+            if (!text.empty()) {
+                // ограничение памяти: блок читается, только когда есть место
+                if (sequence >= indexed_sequence.load() + max_chunks_in_flight) {
+                    unique_lock lock(window_mutex);
+                    window_changed.wait(lock, [&] {
+                        return sequence < indexed_sequence.load() + max_chunks_in_flight || is_cancelled;
+                    });
+                }
+                chunks.Push(make_unique<CorpusChunk>(CorpusChunk{sequence++, move(text)}));
+            }
+            if (is_end) {
+                break;
+            }
+        }
+        chunks.Close();
+    });
+
+    atomic<size_t> running_parser_count = parser_count;
+    vector<thread> parsers;
+    for (size_t i = 0; i < parser_count; ++i) {
+        parsers.emplace_back([&] {
+            unique_ptr<CorpusChunk> chunk;
+            while (chunks.Pop(chunk)) {
+                batches.Push(ParseChunk(move(chunk)));
+            }
+            if (--running_parser_count == 0) {
+                batches.Close();
+            }
+        });
+    }
+
+    // пакеты приходят не по порядку, но номера ожидающих пакетов
+    // отличаются меньше чем на max_chunks_in_flight
+    vector<optional<DocumentBatch>> pending(max_chunks_in_flight);
+    exception_ptr error;
+    DocumentBatch batch;
+    while (batches.Pop(batch)) {
+        if (error) {
+            continue;
+        }
+        try {
+            const size_t slot = batch.sequence % max_chunks_in_flight;
+            pending[slot] = move(batch);
+            for (size_t sequence = indexed_sequence; pending[sequence % max_chunks_in_flight]; ++sequence) {
+                optional<DocumentBatch>& ready = pending[sequence % max_chunks_in_flight];
+                const size_t rejected_count = AddBatch(search_server, ready->documents);
+                stats.document_count += ready->documents.size() - rejected_count;
+                stats.rejected_count += ready->rejected_count + rejected_count;
+                ready.reset();
+                indexed_sequence = sequence + 1;
+                notify_window_changed();
+            }
+        } catch (...) {
+            error = current_exception();
+            is_cancelled = true;
+            notify_window_changed();
+        }
+    }
+
+    reader.join();
+    for (thread& parser : parsers) {
+        parser.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+IngestionStats IngestCorpusFile(SearchServer& search_server, const string& path, const IngestionOptions& options) {
+    ifstream input(path, ios::binary);
+    if (!input) {
+        throw invalid_argument("cannot open "s + path);
+    }
+    return IngestCorpus(search_server, input, options);
+}
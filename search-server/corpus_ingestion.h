@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "search_server.h"
+
+// Настройки конвейера загрузки корпуса
+struct IngestionOptions {
+    // размер блока, которым читается вход
+    size_t chunk_size = 1 << 20;
+    // потоки разбора строк; 0 - по числу ядер
+    size_t parser_count = 0;
+    // наибольшее число прочитанных, но ещё не проиндексированных блоков
+    size_t max_chunks_in_flight = 16;
+};
+
+struct IngestionStats {
+    size_t byte_count = 0;
+    // добавленные документы
+    size_t document_count = 0;
+    // строки неверного формата и документы, которые отверг AddDocument
+    size_t rejected_count = 0;
+    double seconds = 0.0;
+
+    double GetMegabytesPerSecond() const;
+    double GetDocumentsPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const IngestionStats& stats);
+
+// Загружает корпус: по документу в строке, поля разделены табуляцией -
+// id, статус (ACTUAL, IRRELEVANT, BANNED, REMOVED), рейтинги через пробел, текст.
+// Поток чтения читает вход блоками и режет их по границам строк, потоки разбора
+// превращают блоки в пакеты документов, вызывающий поток добавляет пакеты
+// в порядке корпуса через AddDocuments(execution::par, ...). Стадии связаны
+// ограниченными очередями, а чтение ждёт, пока в работе не меньше
+// max_chunks_in_flight блоков, поэтому расход памяти ограничен
+IngestionStats IngestCorpus(SearchServer& search_server, std::istream& input, const IngestionOptions& options = {});
+
+// То же для файла; invalid_argument, если файл не открывается
+IngestionStats IngestCorpusFile(SearchServer& search_server, const std::string& path, const IngestionOptions& options = {});
@@ -0,0 +1,223 @@
+#include "document_bitmap.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+uint16_t HighBits(uint32_t ordinal) {
+    return static_cast<uint16_t>(ordinal >> 16);
+}
+
+uint16_t LowBits(uint32_t ordinal) {
+    return static_cast<uint16_t>(ordinal & 0xFFFF);
+}
+
+}  // namespace
+
+void DocumentBitmap::Add(uint32_t ordinal) {
+    const uint16_t key = HighBits(ordinal);
+    const uint16_t low = LowBits(ordinal);
+    auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container{key, 0, {}, {}});
+    }
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.bits[low / 64];
+        const uint64_t bit = uint64_t{1} << (low % 64);
+        if ((word & bit) == 0) {
+            word |= bit;
+            ++container.size;
+            ++size_;
+        }
+        return;
+    }
+
+    // номера обычно добавляются по возрастанию
+    auto position = container.values.empty() || container.values.back() < low
+        ? container.values.end()
+        : lower_bound(container.values.begin(), container.values.end(), low);
+    if (position != container.values.end() && *position == low) {
+        return;
+    }
+    container.values.insert(position, low);
+    ++container.size;
+    ++size_;
+
+    if (container.values.size() > MAX_ARRAY_CONTAINER_SIZE) {
+        container.bits.assign(CONTAINER_WORD_COUNT, 0);
+        for (const uint16_t value : container.values) {
+            container.bits[value / 64] |= uint64_t{1} << (value % 64);
+        }
+        container.values.clear();
+        container.values.shrink_to_fit();
+    }
+}
+
+bool DocumentBitmap::Remove(uint32_t ordinal) {
+    const uint16_t key = HighBits(ordinal);
+    const uint16_t low = LowBits(ordinal);
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+    if (it == containers_.end() || it->key != key) {
+        return false;
+    }
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.bits[low / 64];
+        const uint64_t bit = uint64_t{1} << (low % 64);
+        if ((word & bit) == 0) {
+            return false;
+        }
+        word &= ~bit;
+        --container.size;
+        --size_;
+        ShrinkContainer(container);
+    } else {
+        const auto position = lower_bound(container.values.begin(), container.values.end(), low);
+        if (position == container.values.end() || *position != low) {
+            return false;
+        }
+        container.values.erase(position);
+        --container.size;
+        --size_;
+    }
+
+    if (container.size == 0) {
+        containers_.erase(it);
+    }
+    return true;
+}
+
+size_t DocumentBitmap::RemoveSorted(const uint32_t* first, const uint32_t* last) {
+    size_t removed_count = 0;
+    auto it = containers_.begin();
+    while (first != last) {
+        const uint16_t key = HighBits(*first);
+        // номера этого контейнера: [first, next)
+        const uint32_t* next = find_if(first, last, [key](uint32_t ordinal) {
+            return HighBits(ordinal) != key;
+        });
+        it = lower_bound(it, containers_.end(), key, [](const Container& container, uint16_t key) {
+            return container.key < key;
+        });
+        if (it == containers_.end()) {
+            break;
+        }
+        if (it->key != key) {
+            first = next;
+            continue;
+        }
+        Container& container = *it;
+        const uint32_t old_size = container.size;
+        if (container.IsBitmap()) {
+            for (; first != next; ++first) {
+                const uint16_t low = LowBits(*first);
+                uint64_t& word = container.bits[low / 64];
+                const uint64_t bit = uint64_t{1} << (low % 64);
+                container.size -= (word & bit) != 0;
+                word &= ~bit;
+            }
+            ShrinkContainer(container);
+        } else {
+            // слияние двух отсортированных последовательностей
+            auto values_end = remove_if(container.values.begin(), container.values.end(), [&first, next](uint16_t value) {
+                while (first != next && LowBits(*first) < value) {
+                    ++first;
+                }
+                return first != next && LowBits(*first) == value;
+            });
+            container.values.erase(values_end, container.values.end());
+            container.size = static_cast<uint32_t>(container.values.size());
+            first = next;
+        }
+        removed_count += old_size - container.size;
+        if (container.size == 0) {
+            it = containers_.erase(it);
+        }
+    }
+    size_ -= removed_count;
+    return removed_count;
+}
+
+void DocumentBitmap::ShrinkContainer(Container& container) {
+    // обратно в массив с запасом, чтобы не переключаться на каждом удалении
+    if (container.size > MAX_ARRAY_CONTAINER_SIZE / 2) {
+        return;
+    }
+    vector<uint16_t> values;
+    values.reserve(container.size);
+    for (uint32_t word_index = 0; word_index < CONTAINER_WORD_COUNT; ++word_index) {
+        for (uint64_t bits = container.bits[word_index]; bits != 0; bits &= bits - 1) {
+            values.push_back(static_cast<uint16_t>(word_index * 64 + __builtin_ctzll(bits)));
+        }
+    }
+    container.values = move(values);
+    container.bits.clear();
+    container.bits.shrink_to_fit();
+}
+
+bool DocumentBitmap::Contains(uint32_t ordinal) const {
+    const Container* container = FindContainer(HighBits(ordinal));
+    if (container == nullptr) {
+        return false;
+    }
+    const uint16_t low = LowBits(ordinal);
+    if (container->IsBitmap()) {
+        return (container->bits[low / 64] >> (low % 64)) & 1;
+    }
+    return binary_search(container->values.begin(), container->values.end(), low);
+}
+
+size_t DocumentBitmap::size() const {
+    return size_;
+}
+
+bool DocumentBitmap::empty() const {
+    return size_ == 0;
+}
+
+void DocumentBitmap::CopyWords(uint32_t first_word, uint32_t last_word, uint64_t* words) const {
+    fill(words, words + (last_word - first_word), 0);
+    for (const Container& container : containers_) {
+        const uint32_t container_first_word = static_cast<uint32_t>(container.key) * CONTAINER_WORD_COUNT;
+        const uint32_t container_last_word = container_first_word + CONTAINER_WORD_COUNT;
+        if (container_last_word <= first_word) {
+            continue;
+        }
+        if (container_first_word >= last_word) {
+            break;
+        }
+        if (container.IsBitmap()) {
+            const uint32_t begin = max(first_word, container_first_word);
+            const uint32_t end = min(last_word, container_last_word);
+            copy(container.bits.begin() + (begin - container_first_word),
+                 container.bits.begin() + (end - container_first_word),
+                 words + (begin - first_word));
+            continue;
+        }
+        for (const uint16_t low : container.values) {
+            const uint32_t word_index = container_first_word + low / 64;
+            if (word_index >= first_word && word_index < last_word) {
+                words[word_index - first_word] |= uint64_t{1} << (low % 64);
+            }
+        }
+    }
+}
+
+const DocumentBitmap::Container* DocumentBitmap::FindContainer(uint16_t key) const {
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+    if (it == containers_.end() || it->key != key) {
+        return nullptr;
+    }
+    return &*it;
+}
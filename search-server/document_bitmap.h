@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Сжатое множество порядковых номеров документов по схеме Roaring:
+// номера делятся на контейнеры по старшим 16 битам. Контейнер с небольшим
+// числом номеров хранит отсортированный массив младших 16 бит, плотный
+// контейнер - битовую карту из 1024 64-битных слов
+class DocumentBitmap {
+public:
+    // Наибольшее число номеров в контейнере-массиве
+    static const size_t MAX_ARRAY_CONTAINER_SIZE = 4096;
+    // Количество 64-битных слов, покрываемых одним контейнером
+    static const uint32_t CONTAINER_WORD_COUNT = 1024;
+
+    void Add(uint32_t ordinal);
+
+    bool Remove(uint32_t ordinal);
+
+    // Удаляет номера из отсортированного по возрастанию [first, last) за один
+    // проход по каждому затронутому контейнеру. Возвращает число удалённых номеров
+    size_t RemoveSorted(const uint32_t* first, const uint32_t* last);
+
+    bool Contains(uint32_t ordinal) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    // Вызывает callback(ordinal) для всех номеров по возрастанию
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+    // Записывает в words[0, last_word - first_word) слова битовой карты с номерами
+    // из [first_word, last_word); бит i слова w соответствует документу 64 * w + i
+    void CopyWords(uint32_t first_word, uint32_t last_word, uint64_t* words) const;
+
+private:
+    struct Container {
+        uint16_t key;
+        uint32_t size;
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> bits;
+
+        bool IsBitmap() const {
+            return !bits.empty();
+        }
+    };
+
+    std::vector<Container> containers_;
+    size_t size_ = 0;
+
+    const Container* FindContainer(uint16_t key) const;
+
+    // Переводит контейнер-битовую карту в массив, если номеров в нём стало мало
+    static void ShrinkContainer(Container& container);
+};
+
+template <typename Callback>
+void DocumentBitmap::ForEach(Callback callback) const {
+    for (const Container& container : containers_) {
+        const uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        if (!container.IsBitmap()) {
+            for (const uint16_t low : container.values) {
+                callback(high | low);
+            }
+            continue;
+        }
+        for (uint32_t word_index = 0; word_index < CONTAINER_WORD_COUNT; ++word_index) {
+            for (uint64_t word = container.bits[word_index]; word != 0; word &= word - 1) {
+                callback(high | (word_index * 64 + static_cast<uint32_t>(__builtin_ctzll(word))));
+            }
+        }
+    }
+}
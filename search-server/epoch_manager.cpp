@@ -0,0 +1,44 @@
+#include "epoch_manager.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+size_t EpochManager::Enter() const {
+    // поток начинает поиск со слота, который занимал в прошлый раз
+    static thread_local size_t hint = hash<thread::id>{}(this_thread::get_id()) % SLOT_COUNT;
+    for (size_t attempt = 0;; ++attempt) {
+        const size_t slot = (hint + attempt) % SLOT_COUNT;
+        uint64_t expected = FREE_SLOT;
+        if (slots_[slot].epoch.load(memory_order_relaxed) == FREE_SLOT
+            && slots_[slot].epoch.compare_exchange_strong(expected, epoch_.load())) {
+            hint = slot;
+            return slot;
+        }
+        if (attempt % SLOT_COUNT == SLOT_COUNT - 1) {
+            this_thread::yield();
+        }
+    }
+}
+
+void EpochManager::Leave(size_t slot) const {
+    slots_[slot].epoch.store(FREE_SLOT);
+}
+
+uint64_t EpochManager::Advance() {
+    return epoch_.fetch_add(1);
+}
+
+uint64_t EpochManager::GetMinActiveEpoch() const {
+    uint64_t min_epoch = numeric_limits<uint64_t>::max();
+    for (const Slot& slot : slots_) {
+        const uint64_t epoch = slot.epoch.load();
+        if (epoch != FREE_SLOT) {
+            min_epoch = min(min_epoch, epoch);
+        }
+    }
+    return min_epoch;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Эпохи для освобождения версий данных, которые читают другие потоки.
+// Читатель на время чтения занимает слот с текущей эпохой. Писатель, заменив
+// версию, переходит к следующей эпохе и освобождает заменённую версию, когда
+// все занятые слоты получат эпоху больше эпохи замены
+class EpochManager {
+public:
+    // Наибольшее число одновременных читателей; следующие ждут освобождения слота
+    static constexpr size_t SLOT_COUNT = 128;
+
+    // Занимает слот с текущей эпохой и возвращает его номер.
+    // Версию нужно читать после вызова
+    size_t Enter() const;
+
+    void Leave(size_t slot) const;
+
+    // Переходит к следующей эпохе и возвращает предыдущую
+    uint64_t Advance();
+
+    // Версию, заменённую в эпоху epoch, можно освободить, если epoch меньше результата
+    uint64_t GetMinActiveEpoch() const;
+
+private:
+    static constexpr uint64_t FREE_SLOT = 0;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch = FREE_SLOT;
+    };
+
+    std::atomic<uint64_t> epoch_ = 1;
+    mutable std::array<Slot, SLOT_COUNT> slots_;
+};
@@ -0,0 +1,248 @@
+#include "index_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+uint64_t AlignUp(uint64_t value) {
+    return (value + 7) & ~uint64_t{7};
+}
+
+// Сбрасывает на диск файл или каталог
+bool SyncPath(const string& path) {
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    const bool is_synced = fsync(file) == 0;
+    close(file);
+    return is_synced;
+}
+
+} // namespace
+
+void ImageChecksum::Update(const char* data, size_t size) {
+    length_ += size;
+    while (size > 0 && pending_size_ > 0) {
+        pending_[pending_size_++] = *data++;
+        --size;
+        if (pending_size_ == pending_.size()) {
+            uint64_t word;
+            memcpy(&word, pending_.data(), sizeof(word));
+            UpdateWord(word);
+            pending_size_ = 0;
+        }
+    }
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        UpdateWord(word);
+    }
+    for (; size > 0; --size) {
+        pending_[pending_size_++] = *data++;
+    }
+}
+
+uint64_t ImageChecksum::Get() const {
+    ImageChecksum result = *this;
+    if (result.pending_size_ > 0) {
+        fill(result.pending_.begin() + result.pending_size_, result.pending_.end(), 0);
+        uint64_t word;
+        memcpy(&word, result.pending_.data(), sizeof(word));
+        result.UpdateWord(word);
+    }
+    result.UpdateWord(length_);
+    return result.state_;
+}
+
+void ImageChecksum::UpdateWord(uint64_t word) {
+    word *= 0xC2B2AE3D27D4EB4Full;
+    word = (word << 31) | (word >> 33);
+    state_ ^= word * 0x9E3779B185EBCA87ull;
+    state_ = ((state_ << 27) | (state_ >> 37)) * 5 + 0x52DCE729;
+}
+
+ImageReader::ImageReader(const char* first, const char* last)
+    : first_(first)
+    , position_(first)
+    , last_(last)
+{}
+
+string_view ImageReader::ReadString() {
+    const uint64_t size = Read<uint64_t>();
+    return string_view(Take(size), size);
+}
+
+ImageReader ImageReader::At(uint64_t offset) const {
+    if (offset > static_cast<uint64_t>(last_ - first_)) {
+        throw invalid_argument("corrupted index image");
+    }
+    ImageReader reader = *this;
+    reader.position_ = first_ + offset;
+    return reader;
+}
+
+const char* ImageReader::Take(uint64_t size) {
+    const uint64_t available = last_ - position_;
+    if (size > available || AlignUp(size) > available) {
+        throw invalid_argument("corrupted index image");
+    }
+    const char* result = position_;
+    position_ += AlignUp(size);
+    return result;
+}
+
+shared_ptr<const IndexImage> IndexImage::Open(const string& path, uint32_t posting_format, bool verify_checksum) {
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw invalid_argument("cannot open index image "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+        close(file);
+        throw invalid_argument("corrupted index image "s + path);
+    }
+    const size_t size = file_stat.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    // отображение остаётся действительным после закрытия файла
+    close(file);
+    if (data == MAP_FAILED) {
+        throw invalid_argument("cannot map index image "s + path);
+    }
+    shared_ptr<const IndexImage> image(new IndexImage(static_cast<const char*>(data), size));
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.size != size) {
+        throw invalid_argument("corrupted index image "s + path);
+    }
+    if (header.version != VERSION) {
+        throw invalid_argument("unsupported index image version "s + to_string(header.version));
+    }
+    if (header.posting_format != posting_format) {
+        throw invalid_argument("index image has another posting list format"s);
+    }
+    for (size_t section = 0; section < SECTION_COUNT; ++section) {
+        if (header.section_offsets[section] < sizeof(Header) || header.section_offsets[section] % 8 != 0
+            || header.section_offsets[section] > size || header.section_sizes[section] > size - header.section_offsets[section]) {
+            throw invalid_argument("corrupted index image "s + path);
+        }
+    }
+    if (verify_checksum) {
+        ImageChecksum checksum;
+        checksum.Update(static_cast<const char*>(data) + sizeof(Header), size - sizeof(Header));
+        if (checksum.Get() != header.checksum) {
+            throw invalid_argument("index image checksum mismatch "s + path);
+        }
+    }
+    return image;
+}
+
+IndexImage::IndexImage(const char* data, size_t size)
+    : data_(data)
+    , size_(size)
+{}
+
+IndexImage::~IndexImage() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+ImageReader IndexImage::GetSection(Section section) const {
+    Header header;
+    memcpy(&header, data_, sizeof(header));
+    const char* first = data_ + header.section_offsets[section];
+    return ImageReader(first, first + header.section_sizes[section]);
+}
+
+ImageWriter::ImageWriter(const string& path)
+    : path_(path)
+{
+    // уникальное имя рядом с целевым файлом: rename работает в пределах файловой системы
+    string name_template = path + ".XXXXXX"s;
+    const int file = mkstemp(name_template.data());
+    if (file < 0) {
+        throw invalid_argument("cannot open index image "s + path);
+    }
+    // права доступа - как у заменяемого файла
+    struct stat target;
+    fchmod(file, stat(path.c_str(), &target) == 0 ? target.st_mode & 07777 : 0644);
+    close(file);
+    temporary_path_ = move(name_template);
+    out_.open(temporary_path_, ios::binary | ios::trunc);
+    if (!out_) {
+        remove(temporary_path_.c_str());
+        throw invalid_argument("cannot open index image "s + path);
+    }
+    // место под заголовок; он записывается в Finish и в контрольную сумму не входит
+    const IndexImage::Header header = {};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    position_ = sizeof(header);
+}
+
+void ImageWriter::BeginSection(IndexImage::Section section) {
+    EndSection();
+    section_ = section;
+    header_.section_offsets[section] = position_;
+}
+
+uint64_t ImageWriter::GetSectionPosition() const {
+    return position_ - header_.section_offsets[section_];
+}
+
+void ImageWriter::WriteString(string_view text) {
+    Write<uint64_t>(text.size());
+    WriteBytes(text.data(), text.size());
+    Align();
+}
+
+void ImageWriter::Finish(uint32_t posting_format) {
+    EndSection();
+    memcpy(header_.magic, IndexImage::MAGIC, sizeof(IndexImage::MAGIC));
+    header_.version = IndexImage::VERSION;
+    header_.posting_format = posting_format;
+    header_.size = position_;
+    header_.checksum = checksum_.Get();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    if (!out_ || !SyncPath(temporary_path_) || rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("cannot write index image "s + path_);
+    }
+    is_finished_ = true;
+    // переименование сохраняется на диске вместе с каталогом
+    const filesystem::path directory = filesystem::path(path_).parent_path();
+    SyncPath(directory.empty() ? "."s : directory.string());
+}
+
+ImageWriter::~ImageWriter() {
+    if (!is_finished_) {
+        out_.close();
+        remove(temporary_path_.c_str());
+    }
+}
+
+void ImageWriter::WriteBytes(const char* data, size_t size) {
+    out_.write(data, size);
+    checksum_.Update(data, size);
+    position_ += size;
+}
+
+void ImageWriter::Align() {
+    static const char zeros[8] = {};
+    WriteBytes(zeros, AlignUp(position_) - position_);
+}
+
+void ImageWriter::EndSection() {
+    if (section_ != IndexImage::SECTION_COUNT) {
+        header_.section_sizes[section_] = position_ - header_.section_offsets[section_];
+    }
+}
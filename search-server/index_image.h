@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "mapped_vector.h"
+
+// Контрольная сумма образа: слова по 8 байт перемешиваются умножением
+// и циклическим сдвигом, неполное последнее слово дополняется нулями
+class ImageChecksum {
+public:
+    void Update(const char* data, size_t size);
+
+    uint64_t Get() const;
+
+private:
+    uint64_t state_ = 0x9E3779B97F4A7C15ull;
+    uint64_t length_ = 0;
+    // байты неполного слова
+    std::array<char, 8> pending_ = {};
+    size_t pending_size_ = 0;
+
+    void UpdateWord(uint64_t word);
+};
+
+// Последовательное чтение значений секции образа. Массивы и строки
+// не копируются, а ссылаются на память образа. При выходе за границы
+// секции выбрасывается invalid_argument
+class ImageReader {
+public:
+    ImageReader(const char* first, const char* last);
+
+    template <typename T>
+    T Read();
+
+    template <typename T>
+    MappedVector<T> ReadArray();
+
+    std::string_view ReadString();
+
+    // Читатель той же секции с позиции offset от её начала
+    ImageReader At(uint64_t offset) const;
+
+private:
+    const char* first_;
+    const char* position_;
+    const char* last_;
+
+    const char* Take(uint64_t size);
+};
+
+// Образ индекса: неизменяемый файл из заголовка и секций. Все значения
+// выровнены по 8 байт, поэтому массивы читаются прямо из отображённой памяти
+class IndexImage {
+public:
+    static constexpr uint32_t VERSION = 2;
+
+    enum Section : size_t {
+        STOP_WORDS,
+        TERMS,
+        DOCUMENTS,
+        DOCUMENT_WORDS,
+        POSTINGS,
+        SECTION_COUNT,
+    };
+
+    // Отображает файл в память, проверяет заголовок, формат списков вхождений
+    // и, если verify_checksum, контрольную сумму. invalid_argument, если файл
+    // не открывается или повреждён
+    static std::shared_ptr<const IndexImage> Open(const std::string& path, uint32_t posting_format, bool verify_checksum = true);
+
+    IndexImage(const IndexImage&) = delete;
+    IndexImage& operator=(const IndexImage&) = delete;
+    ~IndexImage();
+
+    ImageReader GetSection(Section section) const;
+
+private:
+    friend class ImageWriter;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t posting_format;
+        uint64_t size;
+        uint64_t checksum;
+        uint64_t section_offsets[SECTION_COUNT];
+        uint64_t section_sizes[SECTION_COUNT];
+    };
+
+    static constexpr char MAGIC[8] = {'S', 'S', 'I', 'M', 'A', 'G', 'E', '\0'};
+
+    IndexImage(const char* data, size_t size);
+
+    const char* data_;
+    size_t size_;
+};
+
+// Запись образа индекса по секциям. Образ пишется во временный файл в том же
+// каталоге; Finish записывает заголовок с контрольной суммой, сбрасывает файл
+// на диск и переименовывает его в path. Поэтому образ можно сохранить поверх
+// открытого: отображения старого файла продолжают ссылаться на его содержимое.
+// Без Finish временный файл удаляется, а прежний файл не меняется
+class ImageWriter {
+public:
+    // invalid_argument, если временный файл не создаётся
+    explicit ImageWriter(const std::string& path);
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    // Последующие значения попадают в секцию section
+    void BeginSection(IndexImage::Section section);
+
+    // Позиция от начала текущей секции
+    uint64_t GetSectionPosition() const;
+
+    template <typename T>
+    void Write(const T& value);
+
+    template <typename T>
+    void WriteArray(const T* data, size_t size);
+
+    void WriteString(std::string_view text);
+
+    void Finish(uint32_t posting_format);
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    bool is_finished_ = false;
+    uint64_t position_ = 0;
+    ImageChecksum checksum_;
+    IndexImage::Header header_ = {};
+    size_t section_ = IndexImage::SECTION_COUNT;
+
+    void WriteBytes(const char* data, size_t size);
+
+    // Дополняет нулями до границы 8 байт
+    void Align();
+
+    void EndSection();
+};
+
+template <typename T>
+T ImageReader::Read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+MappedVector<T> ImageReader::ReadArray() {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+    const uint64_t size = Read<uint64_t>();
+    if (size > static_cast<uint64_t>(last_ - position_) / sizeof(T)) {
+        throw std::invalid_argument("corrupted index image");
+    }
+    return MappedVector<T>::Map(reinterpret_cast<const T*>(Take(size * sizeof(T))), size);
+}
+
+template <typename T>
+void ImageWriter::Write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(reinterpret_cast<const char*>(&value), sizeof(T));
+    Align();
+}
+
+template <typename T>
+void ImageWriter::WriteArray(const T* data, size_t size) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+    Write<uint64_t>(size);
+    WriteBytes(reinterpret_cast<const char*>(data), size * sizeof(T));
+    Align();
+}
@@ -0,0 +1,82 @@
+#include "index_segment.h"
+
+using namespace std;
+
+IndexSegment::IndexSegment(uint32_t first_ordinal)
+    : first_ordinal_(first_ordinal)
+{}
+
+IndexSegment::IndexSegment(uint32_t first_ordinal, vector<double> inverse_word_counts,
+                           unordered_map<TermId, PostingList> postings, shared_ptr<const void> storage)
+    : first_ordinal_(first_ordinal)
+    , inverse_word_counts_(move(inverse_word_counts))
+    , postings_(move(postings))
+    , storage_(move(storage))
+{}
+
+void IndexSegment::AddDocument(uint32_t ordinal, double inverse_word_count, const vector<pair<TermId, uint32_t>>& term_counts) {
+    inverse_word_counts_.push_back(inverse_word_count);
+    for (const auto& [term_id, term_count] : term_counts) {
+        postings_[term_id].Append(ordinal, term_count, term_count * inverse_word_count);
+    }
+}
+
+void IndexSegment::AddDocuments(TaskExecutor& executor, const double* inverse_word_counts, size_t document_count,
+                                const GroupedPostings& grouped, vector<size_t>& cursors) {
+    inverse_word_counts_.insert(inverse_word_counts_.end(), inverse_word_counts, inverse_word_counts + document_count);
+    const uint32_t end_ordinal = GetEndOrdinal();
+    // списки создаются заранее: вставка в таблицу не потокобезопасна,
+    // а ссылки на её элементы при перехешировании не меняются
+    vector<pair<size_t, PostingList*>> lists;
+    for (size_t i = 0; i < grouped.term_ids.size(); ++i) {
+        if (cursors[i] < grouped.offsets[i + 1] && grouped.postings[cursors[i]].first < end_ordinal) {
+            lists.push_back({i, &postings_[grouped.term_ids[i]]});
+        }
+    }
+    executor.ParallelFor(lists.size(), [&](size_t i) {
+        const pair<size_t, PostingList*>& list = lists[i];
+        size_t& cursor = cursors[list.first];
+        for (; cursor < grouped.offsets[list.first + 1] && grouped.postings[cursor].first < end_ordinal; ++cursor) {
+            const auto [ordinal, term_count] = grouped.postings[cursor];
+            list.second->Append(ordinal, term_count, term_count * inverse_word_counts_[ordinal - first_ordinal_]);
+        }
+    });
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term_id) const {
+    const auto it = postings_.find(term_id);
+    return it == postings_.end() ? nullptr : &it->second;
+}
+
+IndexSegment IndexSegment::Merge(const vector<const IndexSegment*>& segments, const DocumentBitmap& removed) {
+    IndexSegment merged(segments.front()->first_ordinal_);
+    for (const IndexSegment* segment : segments) {
+        merged.inverse_word_counts_.insert(merged.inverse_word_counts_.end(),
+            segment->inverse_word_counts_.begin(), segment->inverse_word_counts_.end());
+        segment->purged_.ForEach([&merged](uint32_t ordinal) {
+            merged.purged_.Add(ordinal);
+        });
+    }
+    removed.ForEach([&merged](uint32_t ordinal) {
+        if (ordinal >= merged.first_ordinal_ && ordinal < merged.GetEndOrdinal()) {
+            merged.purged_.Add(ordinal);
+        }
+    });
+    // сегменты идут по возрастанию номеров, поэтому вхождения добавляются по порядку
+    for (const IndexSegment* segment : segments) {
+        for (const auto& [term_id, postings] : segment->postings_) {
+            PostingList* merged_postings = nullptr;
+            postings.ForEach([&](uint32_t ordinal, uint32_t term_count) {
+                if (removed.Contains(ordinal)) {
+                    return;
+                }
+                if (merged_postings == nullptr) {
+                    merged_postings = &merged.postings_[term_id];
+                }
+                const double inverse_word_count = segment->inverse_word_counts_[ordinal - segment->first_ordinal_];
+                merged_postings->Append(ordinal, term_count, term_count * inverse_word_count);
+            });
+        }
+    }
+    return merged;
+}
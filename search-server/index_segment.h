@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "document_bitmap.h"
+#include "posting_list.h"
+#include "task_executor.h"
+
+// Вхождения пакета документов, сгруппированные по словам: вхождения слова
+// term_ids[i] - postings[offsets[i], offsets[i + 1]) по возрастанию ordinal
+struct GroupedPostings {
+    std::vector<TermId> term_ids;
+    std::vector<size_t> offsets;
+    // (ordinal, количество вхождений)
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+};
+
+// Сегмент индекса: списки вхождений слов для документов с порядковыми номерами
+// из [first_ordinal, end_ordinal). Пока сегмент служит буфером записи, в него
+// добавляются документы; после сброса буфера сегмент больше не изменяется
+class IndexSegment {
+public:
+    explicit IndexSegment(uint32_t first_ordinal);
+
+    // Готовый неизменяемый сегмент, например прочитанный из образа индекса.
+    // storage - память, на которую ссылаются списки вхождений; она живёт, пока жив сегмент
+    IndexSegment(uint32_t first_ordinal, std::vector<double> inverse_word_counts,
+                 std::unordered_map<TermId, PostingList> postings, std::shared_ptr<const void> storage);
+
+    // Порядковый номер документа должен быть равен GetEndOrdinal().
+    // term_counts - слова документа и количество их вхождений
+    void AddDocument(uint32_t ordinal, double inverse_word_count, const std::vector<std::pair<TermId, uint32_t>>& term_counts);
+
+    // Добавляет document_count документов с номерами от GetEndOrdinal(); списки
+    // вхождений разных слов дополняются параллельно. cursors[i] - первое ещё
+    // не добавленное вхождение слова grouped.term_ids[i], сдвигается за добавленные
+    void AddDocuments(TaskExecutor& executor, const double* inverse_word_counts, size_t document_count,
+                      const GroupedPostings& grouped, std::vector<size_t>& cursors);
+
+    uint32_t GetFirstOrdinal() const {
+        return first_ordinal_;
+    }
+
+    uint32_t GetEndOrdinal() const {
+        return first_ordinal_ + static_cast<uint32_t>(inverse_word_counts_.size());
+    }
+
+    // Количество документов, включая удалённые, но ещё не вычищенные слиянием
+    size_t GetDocumentCount() const {
+        return inverse_word_counts_.size();
+    }
+
+    // Список вхождений слова в документы сегмента или nullptr, если слова в сегменте нет
+    const PostingList* FindPostings(TermId term_id) const;
+
+    // Вычищен ли документ сегмента слиянием: его вхождений в сегменте уже нет
+    bool IsPurged(uint32_t ordinal) const {
+        return purged_.Contains(ordinal);
+    }
+
+    // Объединяет соседние сегменты, перечисленные по возрастанию порядковых номеров.
+    // Документы из removed в объединённые списки вхождений не попадают
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments, const DocumentBitmap& removed);
+
+private:
+    uint32_t first_ordinal_;
+    // 1 / (количество слов документа), нужна для верхних оценок TF при слиянии
+    std::vector<double> inverse_word_counts_;
+    std::unordered_map<TermId, PostingList> postings_;
+    // удалённые документы, вхождения которых не попали в сегмент при слиянии
+    DocumentBitmap purged_;
+    std::shared_ptr<const void> storage_;
+};
@@ -1,12 +1,20 @@
+#include "corpus_ingestion.h"
+#include "process_queries.h"
 #include "search_server.h"
 #include "test_example_functions.h"
 
 #include "log_duration.h"
 
+#include <atomic>
+#include <chrono>
 #include <execution>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -54,21 +62,188 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
-template <typename ExecutionPolicy>
-void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
+template <typename ExecutionPolicy, typename... Options>
+void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy, Options... options) {
     LOG_DURATION(mark);
     double total_relevance = 0;
     for (const string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
+        for (const auto& document : search_server.FindTopDocuments(policy, query, options...)) {
             total_relevance += document.relevance;
         }
     }
     cout << total_relevance << endl;
 }
 
+// Пакет различных запросов из популярных слов: по одному запросу и общим обходом
+// слов в ProcessQueries. Запросы почти не повторяются, но делят слова
+void TestProcessQueries(const SearchServer& search_server, const vector<string>& dictionary) {
+    mt19937 generator;
+    const vector<string> popular_words(dictionary.begin(), dictionary.begin() + 100);
+    const auto queries = GenerateQueries(generator, popular_words, 5'000, 5);
+
+    vector<vector<Document>> expected(queries.size());
+    {
+        LOG_DURATION("batch per query"sv);
+        transform(execution::par, queries.begin(), queries.end(), expected.begin(), [&search_server](const string& query) {
+            return search_server.FindTopDocuments(query);
+        });
+    }
+    vector<vector<Document>> results;
+    {
+        LOG_DURATION("batch shared terms"sv);
+        results = ProcessQueries(search_server, queries);
+    }
+    size_t mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        mismatch_count += results[i].size() != expected[i].size()
+            || !equal(results[i].begin(), results[i].end(), expected[i].begin(), [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+            });
+    }
+    cout << "batch mismatches: "s << mismatch_count << endl;
+}
+
+// Чтение снимков из reader_count потоков, пока писатель добавляет и удаляет документы
+// и публикует версию после каждых publish_interval изменений
+void TestSnapshotReads(const vector<string>& documents, const vector<string>& queries, int reader_count, size_t publish_interval) {
+    SearchServer search_server("and with"s);
+    search_server.SetSnapshotPublishInterval(publish_interval);
+    const size_t live_document_count = documents.size() / 2;
+    for (size_t i = 0; i < live_document_count; ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+
+    atomic<bool> is_stopped = false;
+    atomic<size_t> query_count = 0;
+    vector<thread> readers;
+    for (int i = 0; i < reader_count; ++i) {
+        readers.emplace_back([&, i] {
+            size_t local_query_count = 0;
+            for (size_t q = i; !is_stopped; ++q) {
+                const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+                snapshot->FindTopDocuments(queries[q % queries.size()]);
+                ++local_query_count;
+            }
+            query_count += local_query_count;
+        });
+    }
+
+    // писатель поддерживает постоянное число документов
+    const auto start_time = chrono::steady_clock::now();
+    size_t write_count = 0;
+    for (size_t i = live_document_count; chrono::steady_clock::now() - start_time < 1s; ++i) {
+        search_server.AddDocument(i, documents[i % documents.size()], DocumentStatus::ACTUAL, {1, 2, 3});
+        search_server.RemoveDocument(i - live_document_count);
+        write_count += 2;
+    }
+    is_stopped = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    cout << "snapshot reads, "s << reader_count << " readers, publish every "s << publish_interval << " writes: "s
+         << static_cast<size_t>(query_count / seconds) << " queries/s, "s
+         << static_cast<size_t>(write_count / seconds) << " writes/s"s << endl;
+}
+
+// Построение индекса вызовами AddDocument и одним параллельным пакетом
+void TestBulkAdd(const vector<string>& documents) {
+    vector<NewDocument> batch;
+    batch.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+    }
+    {
+        SearchServer search_server("and with"s);
+        LOG_DURATION("add one by one"sv);
+        for (const NewDocument& document : batch) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    {
+        SearchServer search_server("and with"s);
+        LOG_DURATION("add batch par"sv);
+        search_server.AddDocuments(execution::par, batch);
+    }
+}
+
+// Загрузка корпуса в формате IngestCorpus из памяти
+void TestIngestion(const vector<string>& documents) {
+    string corpus;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        corpus += to_string(i) + "\tACTUAL\t1 2 3\t"s + documents[i] + "\n"s;
+    }
+    SearchServer search_server("and with"s);
+    istringstream input(corpus);
+    IngestionOptions options;
+    options.chunk_size = 64 * 1024;
+    cout << "ingestion: "s << IngestCorpus(search_server, input, options) << endl;
+}
+
+// Удаление половины документов по одному и одним пакетом
+void TestRemoveDocuments(const vector<string>& documents) {
+    vector<int> document_ids;
+    for (size_t i = 0; i < documents.size(); i += 2) {
+        document_ids.push_back(i);
+    }
+    const auto build = [&documents] {
+        auto search_server = make_unique<SearchServer>("and with"s);
+        // сжатие выполняется одинаково во всех вариантах и не входит в замер
+        search_server->SetCompactionThreshold(2.0);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server->AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        return search_server;
+    };
+    {
+        auto search_server = build();
+        LOG_DURATION("remove one by one"sv);
+        for (const int document_id : document_ids) {
+            search_server->RemoveDocument(document_id);
+        }
+    }
+    {
+        auto search_server = build();
+        LOG_DURATION("remove batch seq"sv);
+        search_server->RemoveDocuments(execution::seq, document_ids);
+    }
+    {
+        auto search_server = build();
+        LOG_DURATION("remove batch par"sv);
+        search_server->RemoveDocuments(execution::par, document_ids);
+    }
+}
+
+// Сохранение образа индекса и запуск сервера из образа вместо повторного добавления
+void TestIndexImage(const SearchServer& search_server, const vector<string>& queries) {
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.image"s).string();
+    {
+        LOG_DURATION("save image"sv);
+        search_server.SaveImage(path);
+    }
+    {
+        LOG_DURATION("open image"sv);
+        SearchServer mapped_server(IndexImage::Open(path, POSTING_FORMAT));
+    }
+    SearchServer mapped_server(IndexImage::Open(path, POSTING_FORMAT));
+    Test("mapped seq"sv, mapped_server, queries, execution::seq);
+    filesystem::remove(path);
+}
+
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
-int main() {
+// С аргументом загружает корпус из файла ("-" - из стандартного ввода)
+// и выводит скорость загрузки вместо тестов
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        SearchServer search_server(""s);
+        const string path = argv[1];
+        const IngestionStats stats = path == "-"s
+            ? IngestCorpus(search_server, cin)
+            : IngestCorpusFile(search_server, path);
+        cout << stats << endl;
+        return 0;
+    }
 
     TestSearchServer();
 
@@ -88,4 +263,32 @@ int main() {
 
     TEST(seq);
     TEST(par);
+    Test("block_max_wand"sv, search_server, queries, search_policy::block_max_wand);
+
+    // повторные запросы с кешем результатов: первый проход заполняет кеш
+    search_server.SetResultCacheCapacity(2 * queries.size());
+    Test("seq cache fill"sv, search_server, queries, execution::seq);
+    Test("seq cache hit"sv, search_server, queries, execution::seq);
+    const ResultCacheStats cache_stats = search_server.GetResultCacheStats();
+    cout << "result cache: hit rate "s << cache_stats.GetHitRate() << ", "s << cache_stats.entry_count << " entries, "s
+         << cache_stats.memory_usage << " bytes"s << endl;
+    search_server.SetResultCacheCapacity(0);
+
+    // короткие запросы: поиск документов с любым и со всеми словами запроса
+    const auto short_queries = GenerateQueries(generator, dictionary, 2'000, 3);
+    Test("seq any_word"sv, search_server, short_queries, execution::seq, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ANY_WORD);
+    Test("seq all_words"sv, search_server, short_queries, execution::seq, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ALL_WORDS);
+    Test("par any_word"sv, search_server, short_queries, execution::par, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ANY_WORD);
+    Test("par all_words"sv, search_server, short_queries, execution::par, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ALL_WORDS);
+
+    TestProcessQueries(search_server, dictionary);
+
+    // поиск по снимкам под постоянной нагрузкой на запись
+    TestSnapshotReads(documents, short_queries, 2, 1);
+    TestSnapshotReads(documents, short_queries, 2, 64);
+
+    TestBulkAdd(documents);
+    TestIngestion(documents);
+    TestRemoveDocuments(documents);
+    TestIndexImage(search_server, queries);
 } 
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Массив, который хранит элементы сам или ссылается на неизменяемую внешнюю
+// память, например на отображённый в память образ индекса. Внешняя память
+// должна жить дольше массива и всех его копий. Перед изменением элементы
+// внешней памяти копируются в собственный массив
+template <typename T>
+class MappedVector {
+public:
+    MappedVector() = default;
+
+    MappedVector(const MappedVector& other)
+        : owned_(other.owned_)
+        , mapped_(other.mapped_)
+        , mapped_size_(other.mapped_size_)
+    {}
+
+    MappedVector& operator=(const MappedVector& other) {
+        owned_ = other.owned_;
+        mapped_ = other.mapped_;
+        mapped_size_ = other.mapped_size_;
+        return *this;
+    }
+
+    MappedVector(MappedVector&& other) noexcept = default;
+    MappedVector& operator=(MappedVector&& other) noexcept = default;
+
+    static MappedVector Map(const T* data, size_t size) {
+        MappedVector result;
+        result.mapped_ = data;
+        result.mapped_size_ = size;
+        return result;
+    }
+
+    bool IsMapped() const {
+        return mapped_ != nullptr;
+    }
+
+    const T* data() const {
+        return mapped_ != nullptr ? mapped_ : owned_.data();
+    }
+
+    size_t size() const {
+        return mapped_ != nullptr ? mapped_size_ : owned_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size();
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+
+    const T& front() const {
+        return data()[0];
+    }
+
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    // Собственный массив для изменения
+    std::vector<T>& Mutable() {
+        if (mapped_ != nullptr) {
+            owned_.assign(mapped_, mapped_ + mapped_size_);
+            mapped_ = nullptr;
+            mapped_size_ = 0;
+        }
+        return owned_;
+    }
+
+    void push_back(const T& value) {
+        Mutable().push_back(value);
+    }
+
+    void clear() {
+        Mutable().clear();
+    }
+
+private:
+    std::vector<T> owned_;
+    const T* mapped_ = nullptr;
+    size_t mapped_size_ = 0;
+};
@@ -0,0 +1,61 @@
+#include "ordinal_ranks.h"
+
+using namespace std;
+
+void OrdinalRanks::Add(uint32_t ordinal) {
+    const size_t block = ordinal / BLOCK_SIZE;
+    while (block_masks_.size() <= block) {
+        // новый узел дерева покрывает уже существующие блоки и пустой новый
+        const size_t node = block_masks_.size() + 1;
+        block_masks_.push_back(0);
+        block_counts_.push_back(static_cast<uint32_t>(CountInBlocks(node - 1) - CountInBlocks(node - (node & (~node + 1)))));
+    }
+    block_masks_.Mutable(block) |= uint64_t{1} << (ordinal % BLOCK_SIZE);
+    UpdateBlockCount(block, 1);
+    ++size_;
+}
+
+void OrdinalRanks::Remove(uint32_t ordinal) {
+    const size_t block = ordinal / BLOCK_SIZE;
+    const uint64_t bit = uint64_t{1} << (ordinal % BLOCK_SIZE);
+    if (block >= block_masks_.size() || (block_masks_[block] & bit) == 0) {
+        return;
+    }
+    block_masks_.Mutable(block) &= ~bit;
+    UpdateBlockCount(block, -1);
+    --size_;
+}
+
+uint32_t OrdinalRanks::Select(size_t rank) const {
+    // спуск по дереву: наибольшее число блоков, в которых не больше rank живых номеров
+    size_t block = 0;
+    size_t step = 1;
+    while (step * 2 <= block_counts_.size()) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (block + step <= block_counts_.size() && block_counts_[block + step - 1] <= rank) {
+            block += step;
+            rank -= block_counts_[block - 1];
+        }
+    }
+    uint64_t mask = block_masks_[block];
+    for (; rank > 0; --rank) {
+        mask &= mask - 1;
+    }
+    return static_cast<uint32_t>(block * BLOCK_SIZE + __builtin_ctzll(mask));
+}
+
+size_t OrdinalRanks::CountInBlocks(size_t block_count) const {
+    size_t count = 0;
+    for (size_t node = block_count; node > 0; node &= node - 1) {
+        count += block_counts_[node - 1];
+    }
+    return count;
+}
+
+void OrdinalRanks::UpdateBlockCount(size_t block, int delta) {
+    for (size_t node = block + 1; node <= block_counts_.size(); node += node & (~node + 1)) {
+        block_counts_.Mutable(node - 1) += delta;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "copy_on_write.h"
+
+// Номера живых документов с доступом по рангу: номер документа, k-го по
+// возрастанию номера среди живых, находится за O(log n). Номера делятся на
+// блоки по 64, у каждого блока битовая маска живых номеров, а количества живых
+// номеров в блоках хранятся в дереве Фенвика. Копия разделяет данные с оригиналом
+class OrdinalRanks {
+public:
+    // Номер должен быть больше всех добавленных ранее
+    void Add(uint32_t ordinal);
+
+    void Remove(uint32_t ordinal);
+
+    // Номер с рангом rank; rank меньше size()
+    uint32_t Select(size_t rank) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    static constexpr uint32_t BLOCK_SIZE = 64;
+
+    ChunkedVector<uint64_t> block_masks_;
+    // узел i (с 1) - количество живых номеров в блоках (i - lowbit(i), i]
+    ChunkedVector<uint32_t> block_counts_;
+    size_t size_ = 0;
+
+    // Количество живых номеров в первых block_count блоках
+    size_t CountInBlocks(size_t block_count) const;
+    void UpdateBlockCount(size_t block, int delta);
+};
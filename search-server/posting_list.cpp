@@ -0,0 +1,477 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "index_image.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+uint32_t BitWidth(uint32_t value) {
+    uint32_t bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+size_t WordsPerLane(size_t rows, uint32_t bits) {
+    return (rows * bits + 31) / 32;
+}
+
+// Значение с индексом 4 * row + lane попадает в дорожку lane по смещению row * bits бит.
+// Слово k дорожки lane хранится в data[4 * k + lane]
+void PackLanes(const uint32_t* values, size_t rows, uint32_t bits, vector<uint32_t>& data) {
+    const size_t base = data.size();
+    data.resize(base + 4 * WordsPerLane(rows, bits), 0);
+    if (bits == 0) {
+        return;
+    }
+    for (size_t row = 0; row < rows; ++row) {
+        const size_t position = row * bits;
+        const size_t word = position / 32;
+        const uint32_t shift = position % 32;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            const uint32_t value = values[4 * row + lane];
+            data[base + 4 * word + lane] |= value << shift;
+            if (shift + bits > 32) {
+                data[base + 4 * (word + 1) + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+#if defined(__SSE2__)
+
+#if defined(__AVX2__)
+// Две строки по четыре значения за итерацию: у строк разные сдвиги, поэтому
+// используются сдвиги с отдельным счётчиком для каждой дорожки.
+// Сдвиг влево на 32 даёт ноль, так что строки без переноса не требуют ветвления
+size_t UnpackLanesAvx2(const uint32_t* data, size_t rows, uint32_t bits, uint32_t* values) {
+    const __m256i mask = _mm256_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+    size_t row = 0;
+    for (; row + 1 < rows; row += 2) {
+        const size_t position_0 = row * bits;
+        const size_t position_1 = position_0 + bits;
+        const size_t word_0 = position_0 / 32;
+        const size_t word_1 = position_1 / 32;
+        const uint32_t shift_0 = position_0 % 32;
+        const uint32_t shift_1 = position_1 % 32;
+        const __m256i words = _mm256_set_m128i(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * word_1)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * word_0)));
+        __m256i lanes = _mm256_srlv_epi32(words, _mm256_setr_epi32(
+            shift_0, shift_0, shift_0, shift_0, shift_1, shift_1, shift_1, shift_1));
+        const bool spill_0 = shift_0 + bits > 32;
+        const bool spill_1 = shift_1 + bits > 32;
+        if (spill_0 || spill_1) {
+            const size_t next_0 = spill_0 ? word_0 + 1 : word_0;
+            const size_t next_1 = spill_1 ? word_1 + 1 : word_1;
+            const uint32_t back_0 = spill_0 ? 32 - shift_0 : 32;
+            const uint32_t back_1 = spill_1 ? 32 - shift_1 : 32;
+            const __m256i next = _mm256_set_m128i(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * next_1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * next_0)));
+            lanes = _mm256_or_si256(lanes, _mm256_sllv_epi32(next, _mm256_setr_epi32(
+                back_0, back_0, back_0, back_0, back_1, back_1, back_1, back_1)));
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values + 4 * row), _mm256_and_si256(lanes, mask));
+    }
+    return row;
+}
+#endif
+
+void UnpackLanes(const uint32_t* data, size_t rows, uint32_t bits, uint32_t* values) {
+    if (bits == 0) {
+        fill(values, values + 4 * rows, 0);
+        return;
+    }
+    size_t row = 0;
+#if defined(__AVX2__)
+    row = UnpackLanesAvx2(data, rows, bits, values);
+#endif
+    const __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+    for (; row < rows; ++row) {
+        const size_t position = row * bits;
+        const size_t word = position / 32;
+        const uint32_t shift = position % 32;
+        __m128i lanes = _mm_srl_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * word)),
+            _mm_cvtsi32_si128(shift));
+        if (shift + bits > 32) {
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * (word + 1)));
+            lanes = _mm_or_si128(lanes, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - shift)));
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(values + 4 * row), _mm_and_si128(lanes, mask));
+    }
+}
+
+// Префиксные суммы разностей внутри каждых четырёх значений и перенос между ними
+void PrefixSum(uint32_t* values, size_t rows, uint32_t initial) {
+    __m128i carry = _mm_set1_epi32(static_cast<int>(initial));
+    for (size_t row = 0; row < rows; ++row) {
+        __m128i* ptr = reinterpret_cast<__m128i*>(values + 4 * row);
+        __m128i lanes = _mm_load_si128(ptr);
+        lanes = _mm_add_epi32(lanes, _mm_slli_si128(lanes, 4));
+        lanes = _mm_add_epi32(lanes, _mm_slli_si128(lanes, 8));
+        lanes = _mm_add_epi32(lanes, carry);
+        _mm_store_si128(ptr, lanes);
+        carry = _mm_shuffle_epi32(lanes, 0xFF);
+    }
+}
+
+void AddOne(uint32_t* values, size_t rows) {
+    const __m128i one = _mm_set1_epi32(1);
+    for (size_t row = 0; row < rows; ++row) {
+        __m128i* ptr = reinterpret_cast<__m128i*>(values + 4 * row);
+        _mm_store_si128(ptr, _mm_add_epi32(_mm_load_si128(ptr), one));
+    }
+}
+
+#else
+
+void UnpackLanes(const uint32_t* data, size_t rows, uint32_t bits, uint32_t* values) {
+    if (bits == 0) {
+        fill(values, values + 4 * rows, 0);
+        return;
+    }
+    const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+    for (size_t row = 0; row < rows; ++row) {
+        const size_t position = row * bits;
+        const size_t word = position / 32;
+        const uint32_t shift = position % 32;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint32_t value = data[4 * word + lane] >> shift;
+            if (shift + bits > 32) {
+                value |= data[4 * (word + 1) + lane] << (32 - shift);
+            }
+            values[4 * row + lane] = value & mask;
+        }
+    }
+}
+
+void PrefixSum(uint32_t* values, size_t rows, uint32_t initial) {
+    uint32_t sum = initial;
+    for (size_t i = 0; i < 4 * rows; ++i) {
+        sum += values[i];
+        values[i] = sum;
+    }
+}
+
+void AddOne(uint32_t* values, size_t rows) {
+    for (size_t i = 0; i < 4 * rows; ++i) {
+        ++values[i];
+    }
+}
+
+#endif
+
+// Количество элементов, после которого поиск переходит с линейного на двоичный
+const ptrdiff_t LINEAR_SEARCH_LIMIT = 32;
+
+// Первый элемент отсортированного [first, last), не меньший target.
+// Короткие диапазоны просматриваются по четыре элемента сравнением SSE2
+const uint32_t* LowerBound(const uint32_t* first, const uint32_t* last, uint32_t target) {
+#if defined(__SSE2__)
+    if (last - first <= LINEAR_SEARCH_LIMIT) {
+        // SSE2 сравнивает числа со знаком, поэтому старший бит инвертируется
+        const __m128i sign = _mm_set1_epi32(numeric_limits<int32_t>::min());
+        const __m128i pivot = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(target)), sign);
+        for (; last - first >= 4; first += 4) {
+            const __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), sign);
+            const int less_mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, pivot)));
+            if (less_mask != 0xF) {
+                // элементы упорядочены, поэтому меньшие target идут первыми
+                return first + __builtin_popcount(less_mask);
+            }
+        }
+    }
+#endif
+    return lower_bound(first, last, target);
+}
+
+} // namespace
+
+void RawPostingList::Append(uint32_t ordinal, uint32_t term_count, double term_freq) {
+    if (ordinals_.size() % POSTING_BLOCK_SIZE == 0) {
+        block_max_term_freqs_.push_back(term_freq);
+    } else {
+        block_max_term_freqs_.Mutable().back() = max(block_max_term_freqs_.back(), term_freq);
+    }
+    ordinals_.push_back(ordinal);
+    term_counts_.push_back(term_count);
+}
+
+bool RawPostingList::Contains(uint32_t ordinal) const {
+    return binary_search(ordinals_.begin(), ordinals_.end(), ordinal);
+}
+
+size_t RawPostingList::size() const {
+    return ordinals_.size();
+}
+
+bool RawPostingList::empty() const {
+    return ordinals_.empty();
+}
+
+size_t RawPostingList::GetBlockCount() const {
+    return (ordinals_.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+}
+
+void RawPostingList::WriteTo(ImageWriter& writer) const {
+    writer.WriteArray(ordinals_.data(), ordinals_.size());
+    writer.WriteArray(term_counts_.data(), term_counts_.size());
+    writer.WriteArray(block_max_term_freqs_.data(), block_max_term_freqs_.size());
+}
+
+RawPostingList RawPostingList::ReadFrom(ImageReader& reader) {
+    RawPostingList postings;
+    postings.ordinals_ = reader.ReadArray<uint32_t>();
+    postings.term_counts_ = reader.ReadArray<uint32_t>();
+    postings.block_max_term_freqs_ = reader.ReadArray<double>();
+    if (postings.term_counts_.size() != postings.ordinals_.size()
+        || postings.block_max_term_freqs_.size() != postings.GetBlockCount()) {
+        throw invalid_argument("corrupted index image"s);
+    }
+    return postings;
+}
+
+RawPostingList::Cursor::Cursor(const RawPostingList& postings)
+    : postings_(&postings)
+    , ordinals_(postings.ordinals_.data())
+    , term_counts_(postings.term_counts_.data())
+    , size_(postings.ordinals_.size())
+{}
+
+void RawPostingList::Cursor::Advance(uint32_t target) {
+    const uint32_t* ordinals = ordinals_;
+    if (AtEnd() || ordinals[index_] >= target) {
+        return;
+    }
+    // близкая цель ищется линейно, дальняя - экспоненциальным поиском границы, затем двоичным
+    const size_t near_end = min(index_ + LINEAR_SEARCH_LIMIT, size_);
+    if (ordinals[near_end - 1] >= target) {
+        index_ = LowerBound(ordinals + index_, ordinals + near_end, target) - ordinals;
+        return;
+    }
+    size_t low = index_;
+    size_t step = 1;
+    while (low + step < size_ && ordinals[low + step] < target) {
+        low += step;
+        step *= 2;
+    }
+    const size_t high = min(low + step + 1, size_);
+    index_ = LowerBound(ordinals + low, ordinals + high, target) - ordinals;
+}
+
+bool RawPostingList::Cursor::ShallowAdvance(uint32_t target) {
+    const size_t block_count = postings_->GetBlockCount();
+    shallow_block_ = max(shallow_block_, index_ / POSTING_BLOCK_SIZE);
+    while (shallow_block_ < block_count && GetBlockLastOrdinal() < target) {
+        ++shallow_block_;
+    }
+    return shallow_block_ < block_count;
+}
+
+uint32_t RawPostingList::Cursor::GetBlockLastOrdinal() const {
+    const size_t last = min((shallow_block_ + 1) * POSTING_BLOCK_SIZE, size_);
+    return ordinals_[last - 1];
+}
+
+double RawPostingList::Cursor::GetBlockMaxTermFreq() const {
+    return postings_->block_max_term_freqs_[shallow_block_];
+}
+
+void CompressedPostingList::Append(uint32_t ordinal, uint32_t term_count, double term_freq) {
+    tail_ordinals_.push_back(ordinal);
+    tail_term_counts_.push_back(term_count);
+    tail_max_term_freq_ = max(tail_max_term_freq_, term_freq);
+    ++size_;
+    if (tail_ordinals_.size() == POSTING_BLOCK_SIZE) {
+        SealTail();
+    }
+}
+
+bool CompressedPostingList::Contains(uint32_t ordinal) const {
+    if (!tail_ordinals_.empty() && ordinal >= tail_ordinals_.front()) {
+        return binary_search(tail_ordinals_.begin(), tail_ordinals_.end(), ordinal);
+    }
+    const auto block_it = lower_bound(blocks_.begin(), blocks_.end(), ordinal, [](const Block& block, uint32_t value) {
+        return block.last_ordinal < value;
+    });
+    if (block_it == blocks_.end() || block_it->first_ordinal > ordinal) {
+        return false;
+    }
+    DecodedBlock decoded;
+    DecodeBlock(*block_it, decoded);
+    return binary_search(decoded.ordinals, decoded.ordinals + block_it->size, ordinal);
+}
+
+size_t CompressedPostingList::size() const {
+    return size_;
+}
+
+bool CompressedPostingList::empty() const {
+    return size_ == 0;
+}
+
+size_t CompressedPostingList::GetBlockCount() const {
+    return blocks_.size() + (tail_ordinals_.empty() ? 0 : 1);
+}
+
+CompressedPostingList::Block CompressedPostingList::EncodeBlock(const uint32_t* ordinals, const uint32_t* term_counts, size_t size, vector<uint32_t>& data) {
+    const size_t rows = (size + 3) / 4;
+    uint32_t deltas[POSTING_BLOCK_SIZE] = {};
+    uint32_t counts[POSTING_BLOCK_SIZE] = {};
+    uint32_t max_delta = 0;
+    uint32_t max_count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        deltas[i] = i == 0 ? 0 : ordinals[i] - ordinals[i - 1];
+        counts[i] = term_counts[i] - 1;
+        max_delta = max(max_delta, deltas[i]);
+        max_count = max(max_count, counts[i]);
+    }
+
+    Block block;
+    block.first_ordinal = ordinals[0];
+    block.last_ordinal = ordinals[size - 1];
+    block.offset = static_cast<uint32_t>(data.size());
+    block.size = static_cast<uint16_t>(size);
+    block.delta_bits = static_cast<uint8_t>(BitWidth(max_delta));
+    block.count_bits = static_cast<uint8_t>(BitWidth(max_count));
+    block.max_term_freq = 0.0;
+    PackLanes(deltas, rows, block.delta_bits, data);
+    PackLanes(counts, rows, block.count_bits, data);
+    return block;
+}
+
+void CompressedPostingList::DecodeBlock(const Block& block, DecodedBlock& decoded) const {
+    const size_t rows = (block.size + 3) / 4;
+    const uint32_t* deltas = data_.data() + block.offset;
+    const uint32_t* counts = deltas + 4 * WordsPerLane(rows, block.delta_bits);
+    UnpackLanes(deltas, rows, block.delta_bits, decoded.ordinals);
+    PrefixSum(decoded.ordinals, rows, block.first_ordinal);
+    UnpackLanes(counts, rows, block.count_bits, decoded.term_counts);
+    AddOne(decoded.term_counts, rows);
+}
+
+void CompressedPostingList::SealTail() {
+    blocks_.push_back(EncodeBlock(tail_ordinals_.data(), tail_term_counts_.data(), tail_ordinals_.size(), data_.Mutable()));
+    blocks_.Mutable().back().max_term_freq = tail_max_term_freq_;
+    tail_ordinals_.clear();
+    tail_term_counts_.clear();
+    tail_max_term_freq_ = 0.0;
+}
+
+uint32_t CompressedPostingList::GetBlockLastOrdinal(size_t block_index) const {
+    return block_index < blocks_.size() ? blocks_[block_index].last_ordinal : tail_ordinals_.back();
+}
+
+double CompressedPostingList::GetBlockMaxTermFreq(size_t block_index) const {
+    return block_index < blocks_.size() ? blocks_[block_index].max_term_freq : tail_max_term_freq_;
+}
+
+void CompressedPostingList::WriteTo(ImageWriter& writer) const {
+    writer.Write<uint64_t>(size_);
+    writer.Write(tail_max_term_freq_);
+    writer.WriteArray(blocks_.data(), blocks_.size());
+    writer.WriteArray(data_.data(), data_.size());
+    writer.WriteArray(tail_ordinals_.data(), tail_ordinals_.size());
+    writer.WriteArray(tail_term_counts_.data(), tail_term_counts_.size());
+}
+
+CompressedPostingList CompressedPostingList::ReadFrom(ImageReader& reader) {
+    CompressedPostingList postings;
+    postings.size_ = reader.Read<uint64_t>();
+    postings.tail_max_term_freq_ = reader.Read<double>();
+    postings.blocks_ = reader.ReadArray<Block>();
+    postings.data_ = reader.ReadArray<uint32_t>();
+    postings.tail_ordinals_ = reader.ReadArray<uint32_t>();
+    postings.tail_term_counts_ = reader.ReadArray<uint32_t>();
+    // распаковка блока читает его слова по смещению, поэтому смещения проверяются
+    size_t size = postings.tail_ordinals_.size();
+    for (const Block& block : postings.blocks_) {
+        const size_t rows = (block.size + 3) / 4;
+        const size_t words = 4 * (WordsPerLane(rows, block.delta_bits) + WordsPerLane(rows, block.count_bits));
+        if (block.size == 0 || block.size > POSTING_BLOCK_SIZE || block.delta_bits > 32 || block.count_bits > 32
+            || block.offset > postings.data_.size() || words > postings.data_.size() - block.offset) {
+            throw invalid_argument("corrupted index image"s);
+        }
+        size += block.size;
+    }
+    if (postings.tail_term_counts_.size() != postings.tail_ordinals_.size() || size != postings.size_) {
+        throw invalid_argument("corrupted index image"s);
+    }
+    return postings;
+}
+
+CompressedPostingList::Cursor::Cursor(const CompressedPostingList& postings)
+    : postings_(&postings)
+{
+    LoadBlock(0);
+}
+
+void CompressedPostingList::Cursor::LoadBlock(size_t block_index) {
+    block_ = block_index;
+    position_ = 0;
+    if (block_index < postings_->blocks_.size()) {
+        postings_->DecodeBlock(postings_->blocks_[block_index], decoded_);
+        block_size_ = postings_->blocks_[block_index].size;
+    } else if (block_index == postings_->blocks_.size()) {
+        copy(postings_->tail_ordinals_.begin(), postings_->tail_ordinals_.end(), decoded_.ordinals);
+        copy(postings_->tail_term_counts_.begin(), postings_->tail_term_counts_.end(), decoded_.term_counts);
+        block_size_ = postings_->tail_ordinals_.size();
+    } else {
+        block_size_ = 0;
+    }
+}
+
+void CompressedPostingList::Cursor::Advance(uint32_t target) {
+    if (AtEnd() || GetOrdinal() >= target) {
+        return;
+    }
+    if (postings_->GetBlockLastOrdinal(block_) < target) {
+        // блоки, целиком лежащие левее target, пропускаются без распаковки
+        const auto& blocks = postings_->blocks_;
+        const auto block_it = lower_bound(blocks.begin() + min(block_ + 1, blocks.size()), blocks.end(), target,
+            [](const Block& block, uint32_t value) {
+                return block.last_ordinal < value;
+            });
+        size_t next_block = block_it - blocks.begin();
+        if (next_block == blocks.size() && (postings_->tail_ordinals_.empty() || postings_->tail_ordinals_.back() < target)) {
+            next_block = blocks.size() + 1;
+        }
+        LoadBlock(next_block);
+        if (AtEnd()) {
+            return;
+        }
+    }
+    position_ = LowerBound(decoded_.ordinals + position_, decoded_.ordinals + block_size_, target) - decoded_.ordinals;
+}
+
+bool CompressedPostingList::Cursor::ShallowAdvance(uint32_t target) {
+    const size_t block_count = postings_->GetBlockCount();
+    shallow_block_ = max(shallow_block_, block_);
+    while (shallow_block_ < block_count && postings_->GetBlockLastOrdinal(shallow_block_) < target) {
+        ++shallow_block_;
+    }
+    return shallow_block_ < block_count;
+}
+
+uint32_t CompressedPostingList::Cursor::GetBlockLastOrdinal() const {
+    return postings_->GetBlockLastOrdinal(shallow_block_);
+}
+
+double CompressedPostingList::Cursor::GetBlockMaxTermFreq() const {
+    return postings_->GetBlockMaxTermFreq(shallow_block_);
+}
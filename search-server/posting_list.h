@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mapped_vector.h"
+
+class ImageReader;
+class ImageWriter;
+
+// Идентификатор слова в словаре поискового сервера
+using TermId = uint32_t;
+
+// Количество вхождений в одном блоке списка
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Список вхождений слова: порядковые номера документов (по возрастанию)
+// и количество вхождений слова в документ хранятся в двух непрерывных массивах
+class RawPostingList {
+public:
+    // Порядковый номер документа должен быть больше всех уже добавленных.
+    // term_freq нужна только для верхних оценок TF блоков
+    void Append(uint32_t ordinal, uint32_t term_count, double term_freq);
+
+    bool Contains(uint32_t ordinal) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    // Вызывает callback(ordinal, term_count) для всех вхождений по возрастанию ordinal
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+    // Число блоков по POSTING_BLOCK_SIZE вхождений, для которых хранятся верхние оценки TF
+    size_t GetBlockCount() const;
+
+    // Запись в образ индекса и чтение из него. Прочитанный список ссылается
+    // на память образа и копирует массивы только при изменении
+    void WriteTo(ImageWriter& writer) const;
+
+    static RawPostingList ReadFrom(ImageReader& reader);
+
+    // Курсор для обхода списка документ за документом с пропуском блоков
+    class Cursor {
+    public:
+        explicit Cursor(const RawPostingList& postings);
+
+        bool AtEnd() const {
+            return index_ == size_;
+        }
+
+        uint32_t GetOrdinal() const {
+            return ordinals_[index_];
+        }
+
+        uint32_t GetTermCount() const {
+            return term_counts_[index_];
+        }
+
+        void Next() {
+            ++index_;
+        }
+
+        // Переходит к первому вхождению с порядковым номером не меньше target
+        void Advance(uint32_t target);
+
+        // Находит блок с первым вхождением не меньше target, не перемещая курсор.
+        // Возвращает false, если такого блока нет
+        bool ShallowAdvance(uint32_t target);
+
+        uint32_t GetBlockLastOrdinal() const;
+
+        double GetBlockMaxTermFreq() const;
+
+    private:
+        const RawPostingList* postings_;
+        // массивы списка не меняются, пока курсор используется
+        const uint32_t* ordinals_;
+        const uint32_t* term_counts_;
+        size_t size_;
+        size_t index_ = 0;
+        size_t shallow_block_ = 0;
+    };
+
+private:
+    MappedVector<uint32_t> ordinals_;
+    MappedVector<uint32_t> term_counts_;
+    MappedVector<double> block_max_term_freqs_;
+};
+
+// Сжатый список вхождений: полные блоки по POSTING_BLOCK_SIZE вхождений хранят
+// разности порядковых номеров и (количество вхождений - 1), упакованные
+// минимально необходимым числом бит. Значения блока разложены по четырём
+// 32-битным дорожкам, поэтому распаковка выполняется SSE2 сразу для четырёх
+// вхождений. Для каждого блока хранятся первый и последний порядковые номера,
+// по которым блоки пропускаются без распаковки. Неполный хвост хранится как есть.
+class CompressedPostingList {
+public:
+    // Порядковый номер документа должен быть больше всех уже добавленных.
+    // term_freq нужна только для верхних оценок TF блоков
+    void Append(uint32_t ordinal, uint32_t term_count, double term_freq);
+
+    bool Contains(uint32_t ordinal) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+    size_t GetBlockCount() const;
+
+    void WriteTo(ImageWriter& writer) const;
+
+    static CompressedPostingList ReadFrom(ImageReader& reader);
+
+private:
+    // Буфер для распакованного блока
+    struct alignas(32) DecodedBlock {
+        uint32_t ordinals[POSTING_BLOCK_SIZE];
+        uint32_t term_counts[POSTING_BLOCK_SIZE];
+    };
+
+public:
+    // Курсор распаковывает по одному блоку; хвост считается последним блоком
+    class Cursor {
+    public:
+        explicit Cursor(const CompressedPostingList& postings);
+
+        bool AtEnd() const {
+            return position_ == block_size_;
+        }
+
+        uint32_t GetOrdinal() const {
+            return decoded_.ordinals[position_];
+        }
+
+        uint32_t GetTermCount() const {
+            return decoded_.term_counts[position_];
+        }
+
+        void Next() {
+            if (++position_ == block_size_) {
+                LoadBlock(block_ + 1);
+            }
+        }
+
+        void Advance(uint32_t target);
+
+        bool ShallowAdvance(uint32_t target);
+
+        uint32_t GetBlockLastOrdinal() const;
+
+        double GetBlockMaxTermFreq() const;
+
+    private:
+        const CompressedPostingList* postings_;
+        size_t block_ = 0;
+        size_t position_ = 0;
+        size_t block_size_ = 0;
+        size_t shallow_block_ = 0;
+        DecodedBlock decoded_;
+
+        void LoadBlock(size_t block_index);
+    };
+
+private:
+    struct Block {
+        uint32_t first_ordinal;
+        uint32_t last_ordinal;
+        uint32_t offset;
+        uint16_t size;
+        uint8_t delta_bits;
+        uint8_t count_bits;
+        double max_term_freq;
+    };
+
+    MappedVector<Block> blocks_;
+    MappedVector<uint32_t> data_;
+    MappedVector<uint32_t> tail_ordinals_;
+    MappedVector<uint32_t> tail_term_counts_;
+    double tail_max_term_freq_ = 0.0;
+    size_t size_ = 0;
+
+    static Block EncodeBlock(const uint32_t* ordinals, const uint32_t* term_counts, size_t size, std::vector<uint32_t>& data);
+
+    void DecodeBlock(const Block& block, DecodedBlock& decoded) const;
+
+    void SealTail();
+
+    // Блоки с индексом blocks_.size() соответствуют хвосту
+    uint32_t GetBlockLastOrdinal(size_t block_index) const;
+
+    double GetBlockMaxTermFreq(size_t block_index) const;
+
+    // Обходит вхождения одного блока, распаковывая его во временный буфер
+    template <typename Callback>
+    void ForEachInBlock(size_t block_index, Callback callback) const;
+};
+
+// Сборка с -DSEARCH_SERVER_COMPRESSED_POSTINGS включает сжатые списки вхождений
+// Формат списков записывается в образ индекса: образ открывается только сборкой того же формата
+#ifdef SEARCH_SERVER_COMPRESSED_POSTINGS
+using PostingList = CompressedPostingList;
+const uint32_t POSTING_FORMAT = 1;
+#else
+using PostingList = RawPostingList;
+const uint32_t POSTING_FORMAT = 0;
+#endif
+
+template <typename Callback>
+void RawPostingList::ForEach(Callback callback) const {
+    const uint32_t* ordinals = ordinals_.data();
+    const uint32_t* term_counts = term_counts_.data();
+    for (size_t i = 0; i < ordinals_.size(); ++i) {
+        callback(ordinals[i], term_counts[i]);
+    }
+}
+
+template <typename Callback>
+void CompressedPostingList::ForEach(Callback callback) const {
+    for (size_t block_index = 0; block_index < GetBlockCount(); ++block_index) {
+        ForEachInBlock(block_index, callback);
+    }
+}
+
+template <typename Callback>
+void CompressedPostingList::ForEachInBlock(size_t block_index, Callback callback) const {
+    if (block_index == blocks_.size()) {
+        for (size_t i = 0; i < tail_ordinals_.size(); ++i) {
+            callback(tail_ordinals_[i], tail_term_counts_[i]);
+        }
+        return;
+    }
+    DecodedBlock decoded;
+    DecodeBlock(blocks_[block_index], decoded);
+    for (size_t i = 0; i < blocks_[block_index].size; ++i) {
+        callback(decoded.ordinals[i], decoded.term_counts[i]);
+    }
+}
@@ -1,30 +1,73 @@
 #include "process_queries.h"
 
 #include <algorithm>
+#include <atomic>
 #include <execution>
+#include <iterator>
+#include <optional>
 
-vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
-    vector<vector<Document>> result(queries.size());
-
-    transform(execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const string& str){
-        return search_server.FindTopDocuments(str);
-    });
+vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries, QueryMode mode) {
+    return search_server.FindTopDocumentsBatch(queries, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, mode);
+}
 
+vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries, QueryMode mode){
+    vector<Document> result;
+    ProcessQueriesJoined(search_server, queries, [&result](const Document& document) {
+        result.push_back(document);
+        return true;
+    }, mode);
     return result;
 }
 
-vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries){
-    vector<vector<Document>> result_transform(queries.size());
-    result_transform = move(ProcessQueries(search_server, queries));
-
-
-    vector<Document> result;
+void ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries, const DocumentSink& sink, QueryMode mode) {
+    if (queries.empty()) {
+        return;
+    }
+    // Шаг выполняется частями по группе запросов на поток пула. Между частями
+    // проверяется отмена, поэтому после отказа получателя шаг, начатый заранее,
+    // прерывается на границе части
+    TaskExecutor& executor = search_server.GetExecutor();
+    const size_t part_size = SearchServer::BATCH_GROUP_SIZE * (executor.GetThreadCount() + 1);
+    atomic<bool> is_cancelled = false;
+    const auto process_window = [&search_server, &queries, &is_cancelled, part_size, mode](size_t first, size_t last) {
+        vector<vector<Document>> window;
+        window.reserve(last - first);
+        for (size_t part_first = first; part_first < last && !is_cancelled.load(memory_order_relaxed); part_first += part_size) {
+            vector<vector<Document>> part = search_server.FindTopDocumentsBatch(queries, part_first, min(part_first + part_size, last),
+                                                                               DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, mode);
+            move(part.begin(), part.end(), back_inserter(window));
+        }
+        return window;
+    };
 
-    for (const auto& documents : result_transform) {
-        for (const auto& doc : documents) {
-            result.push_back(move(doc));
+    // Шаги выполняются пулом потоков сервера. Первый шаг мал, чтобы первые документы
+    // появились сразу, следующие удваиваются до PROCESS_QUERIES_WINDOW_SIZE. При
+    // досрочном выходе деструктор дожидается выполняемого шага
+    using WindowFuture = TaskExecutor::Future<vector<vector<Document>>>;
+    optional<WindowFuture> next_window;
+    size_t window_size = PROCESS_QUERIES_FIRST_WINDOW_SIZE;
+    const auto start_window = [&](size_t first) {
+        const size_t last = min(first + window_size, queries.size());
+        next_window.emplace(executor, [&process_window, first, last] {
+            return process_window(first, last);
+        });
+        window_size = min(window_size * 2, PROCESS_QUERIES_WINDOW_SIZE);
+        return last;
+    };
+    size_t next_first = start_window(0);
+    while (next_window) {
+        const vector<vector<Document>> window = next_window->Get();
+        next_window.reset();
+        if (next_first < queries.size()) {
+            next_first = start_window(next_first);
+        }
+        for (const vector<Document>& documents : window) {
+            for (const Document& document : documents) {
+                if (!sink(document)) {
+                    is_cancelled.store(true, memory_order_relaxed);
+                    return;
+                }
+            }
         }
     }
-
-    return result;
-}
\ No newline at end of file
+}
@@ -1,13 +1,34 @@
 #pragma once
 
+#include <functional>
 #include <vector>
 #include <string>
 #include "search_server.h"
 
+// Наибольшее число запросов, выполняемых за один шаг потоковой обработки, и
+// размер первого шага. В памяти одновременно находятся результаты не более двух шагов
+const size_t PROCESS_QUERIES_WINDOW_SIZE = 1024;
+const size_t PROCESS_QUERIES_FIRST_WINDOW_SIZE = 1;
+
+// Получатель документов потоковой обработки; вернув false, прекращает обработку
+using DocumentSink = std::function<bool(const Document&)>;
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
+    const std::vector<std::string>& queries,
+    QueryMode mode = QueryMode::ANY_WORD); 
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
\ No newline at end of file
+    const std::vector<std::string>& queries,
+    QueryMode mode = QueryMode::ANY_WORD); 
+
+// Передаёт документы в порядке запросов, не собирая результат целиком: следующий
+// шаг выполняется пулом потоков сервера, пока получатель разбирает предыдущий.
+// Шаги растут от PROCESS_QUERIES_FIRST_WINDOW_SIZE запросов; после отказа
+// получателя следующий шаг не начинается, а начатый прерывается
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const DocumentSink& sink,
+    QueryMode mode = QueryMode::ANY_WORD);
@@ -0,0 +1,50 @@
+#include "query_arena.h"
+
+using namespace std;
+
+void* QueryArena::OverflowResource::do_allocate(size_t bytes, size_t alignment) {
+    overflow_size += bytes;
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::OverflowResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool QueryArena::OverflowResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+QueryArena::QueryArena()
+    : buffer_(make_unique<byte[]>(INITIAL_SIZE))
+    , capacity_(INITIAL_SIZE)
+{
+    resource_.emplace(buffer_.get(), capacity_, &overflow_);
+}
+
+void QueryArena::Release() {
+    // монотонный ресурс возвращает дополнительные блоки в кучу при уничтожении
+    resource_.reset();
+    if (overflow_.overflow_size > 0) {
+        capacity_ = 2 * (capacity_ + overflow_.overflow_size);
+        buffer_ = make_unique<byte[]>(capacity_);
+        overflow_.overflow_size = 0;
+    }
+    resource_.emplace(buffer_.get(), capacity_, &overflow_);
+}
+
+QueryArena::Lease::Lease() {
+    thread_local QueryArena thread_arena;
+    if (thread_arena.is_leased_) {
+        own_arena_ = make_unique<QueryArena>();
+        arena_ = own_arena_.get();
+    } else {
+        arena_ = &thread_arena;
+    }
+    arena_->is_leased_ = true;
+}
+
+QueryArena::Lease::~Lease() {
+    arena_->Release();
+    arena_->is_leased_ = false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// Память для временных данных одного запроса: монотонный ресурс pmr поверх
+// буфера, закреплённого за потоком. Выделение - сдвиг указателя, освобождение
+// происходит разом в конце запроса, а буфер переживает запросы. Если запросу
+// не хватило буфера, недостающее берётся из кучи, а следующий запрос потока
+// получает буфер с запасом, поэтому в установившемся режиме куча не используется
+class QueryArena {
+public:
+    static constexpr size_t INITIAL_SIZE = 64 * 1024;
+
+    QueryArena();
+
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+
+    // Размер буфера, из которого выделяется память без обращения к куче
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    // Выдаёт арену, закреплённую за текущим потоком, и освобождает её память
+    // по окончании. Если арена потока уже занята (вложенный запрос), выдаётся отдельная
+    class Lease {
+    public:
+        Lease();
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        std::pmr::memory_resource* GetResource() {
+            return &*arena_->resource_;
+        }
+
+    private:
+        QueryArena* arena_;
+        std::unique_ptr<QueryArena> own_arena_;
+    };
+
+private:
+    // Ресурс для выделений сверх буфера: запоминает, сколько памяти не хватило
+    class OverflowResource : public std::pmr::memory_resource {
+    public:
+        size_t overflow_size = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_t capacity_ = 0;
+    OverflowResource overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    bool is_leased_ = false;
+
+    // Освобождает выделенную память; при нехватке буфера увеличивает его
+    void Release();
+};
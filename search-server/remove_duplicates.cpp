@@ -31,9 +31,9 @@ void RemoveDuplicates(SearchServer& search_server) {
         }
     }
 
-    // удаляем дубликаты методом RemoveDocument
+    // удаляем дубликаты одним вызовом RemoveDocuments
     for ( int document_id : id_documents_to_remove ) {
         cout << "Found duplicate document id " << document_id << endl;
-        search_server.RemoveDocument(document_id);
     }
+    search_server.RemoveDocuments(vector<int>(id_documents_to_remove.begin(), id_documents_to_remove.end()));
 }
\ No newline at end of file
@@ -1,27 +1,124 @@
 #include "request_queue.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
 using namespace std;
 
 RequestQueue::RequestQueue(const SearchServer& search_server)
-    : search_server_(search_server), requests_size_(0)
+    : search_server_(search_server)
+    , slots_(make_unique<Slot[]>(WINDOW_SIZE))
+    , query_slab_(make_unique<char[]>(WINDOW_SIZE * MAX_STORED_QUERY_LENGTH))
 {}
 
 int RequestQueue::GetNoResultRequests() const {
-    int result = 0;
-    for (const auto& i : requests_) {
-        if (i.empty) {
-            ++result;
-        }
-    }
-    return result;
+    return no_result_count_.load(memory_order_relaxed);
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query, DocumentStatus status) {
-    auto key_l = [status](int document_id, DocumentStatus compare_status, int rating) { 
-        return status == compare_status;  };
-    return AddFindRequest(raw_query, key_l);
+    return Execute(raw_query, [&] {
+        return search_server_.FindTopDocuments(raw_query, status);
+    });
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
+
+chrono::nanoseconds RequestQueue::GetLatencyPercentile(double percentile) const {
+    vector<int64_t> latencies;
+    latencies.reserve(WINDOW_SIZE);
+    for (size_t i = 0; i < WINDOW_SIZE; ++i) {
+        if (slots_[i].ticket.load(memory_order_acquire) != 0) {
+            latencies.push_back(slots_[i].latency.load(memory_order_relaxed));
+        }
+    }
+    if (latencies.empty()) {
+        return chrono::nanoseconds{0};
+    }
+    const double position = clamp(percentile, 0.0, 1.0) * (latencies.size() - 1);
+    const auto nth = latencies.begin() + static_cast<ptrdiff_t>(ceil(position));
+    nth_element(latencies.begin(), nth, latencies.end());
+    return chrono::nanoseconds{*nth};
+}
+
+vector<RequestQueue::RequestRecord> RequestQueue::GetSlowRequests() const {
+    // номера ячеек отбираются по времени без блокировок, текст копируется только у отобранных
+    struct Candidate {
+        int64_t latency;
+        size_t index;
+        uint64_t ticket;
+    };
+    vector<Candidate> candidates;
+    candidates.reserve(WINDOW_SIZE);
+    for (size_t i = 0; i < WINDOW_SIZE; ++i) {
+        const uint64_t ticket = slots_[i].ticket.load(memory_order_acquire);
+        if (ticket != 0) {
+            candidates.push_back({slots_[i].latency.load(memory_order_relaxed), i, ticket});
+        }
+    }
+    const size_t count = min(candidates.size(), SLOW_REQUEST_SAMPLE_SIZE);
+    partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.latency > rhs.latency;
+    });
+
+    vector<RequestRecord> slow_requests;
+    for (size_t i = 0; i < count; ++i) {
+        RequestRecord record;
+        // запрос, вытесненный после отбора, пропускается
+        if (ReadSlot(candidates[i].index, candidates[i].ticket, record)) {
+            slow_requests.push_back(move(record));
+        }
+    }
+    return slow_requests;
+}
+
+void RequestQueue::Record(string_view raw_query, bool empty, chrono::nanoseconds latency) {
+    const uint64_t ticket = request_count_.fetch_add(1, memory_order_relaxed);
+    const size_t index = ticket % WINDOW_SIZE;
+    Slot& slot = slots_[index];
+    Lock(slot);
+    const uint64_t previous_ticket = slot.ticket.load(memory_order_relaxed);
+    // если ячейку уже занял более поздний запрос, этот запрос выпал из окна
+    if (previous_ticket > ticket) {
+        Unlock(slot);
+        return;
+    }
+    if (previous_ticket != 0 && slot.empty) {
+        no_result_count_.fetch_sub(1, memory_order_relaxed);
+    }
+    if (empty) {
+        no_result_count_.fetch_add(1, memory_order_relaxed);
+    }
+    slot.empty = empty;
+    slot.query_length = static_cast<uint32_t>(min(raw_query.size(), MAX_STORED_QUERY_LENGTH));
+    memcpy(query_slab_.get() + index * MAX_STORED_QUERY_LENGTH, raw_query.data(), slot.query_length);
+    slot.latency.store(latency.count(), memory_order_relaxed);
+    slot.ticket.store(ticket + 1, memory_order_release);
+    Unlock(slot);
+}
+
+bool RequestQueue::ReadSlot(size_t index, uint64_t ticket, RequestRecord& record) const {
+    Slot& slot = slots_[index];
+    Lock(slot);
+    const bool is_same = slot.ticket.load(memory_order_relaxed) == ticket;
+    if (is_same) {
+        record.query.assign(query_slab_.get() + index * MAX_STORED_QUERY_LENGTH, slot.query_length);
+        record.empty = slot.empty;
+        record.latency = chrono::nanoseconds{slot.latency.load(memory_order_relaxed)};
+    }
+    Unlock(slot);
+    return is_same;
+}
+
+void RequestQueue::Lock(Slot& slot) {
+    while (slot.busy.test_and_set(memory_order_acquire)) {
+        this_thread::yield();
+    }
+}
+
+void RequestQueue::Unlock(Slot& slot) {
+    slot.busy.clear(memory_order_release);
+}
@@ -1,12 +1,25 @@
 #pragma once
 #include "search_server.h"
 #include "document.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <deque>
 #include <vector>
 
+// Статистика последних WINDOW_SIZE запросов к серверу. Запросы записываются
+// в кольцевой буфер фиксированного размера, текст запроса копируется в память
+// очереди. Запросы можно добавлять из нескольких потоков одновременно: поток
+// получает ячейку атомарным счётчиком, и потоки состязаются только за одну
+// ячейку, если очередь успела обернуться, пока запрос записывался
 class RequestQueue {
 public:
+    static constexpr size_t WINDOW_SIZE = 1440;
+    // Более длинные запросы хранятся усечёнными
+    static constexpr size_t MAX_STORED_QUERY_LENGTH = 256;
+    static constexpr size_t SLOW_REQUEST_SAMPLE_SIZE = 10;
+
     explicit RequestQueue(const SearchServer& search_server);
 
     template <typename DocumentPredicate>
@@ -16,45 +29,62 @@ public:
 
     vector<Document> AddFindRequest(const string_view& raw_query);
 
+    // Количество запросов окна без результатов; поддерживается при добавлении запроса
     int GetNoResultRequests() const;
 
+    struct RequestRecord {
+        string query;
+        bool empty = false;
+        chrono::nanoseconds latency{0};
+    };
+
+    // Время выполнения, которое не превышает доля percentile из [0, 1] запросов окна
+    chrono::nanoseconds GetLatencyPercentile(double percentile) const;
+
+    // Не более SLOW_REQUEST_SAMPLE_SIZE самых долгих запросов окна, от самого долгого
+    vector<RequestRecord> GetSlowRequests() const;
+
 private:
-    struct QueryResult {
-        string_view request;
-        bool empty;
+    struct Slot {
+        // занятость ячейки записью или чтением текста
+        atomic_flag busy = ATOMIC_FLAG_INIT;
+        // номер записанного запроса + 1; 0 - ячейка пуста
+        atomic<uint64_t> ticket = 0;
+        atomic<int64_t> latency = 0;
+        bool empty = false;
+        uint32_t query_length = 0;
     };
-    deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
+
     const SearchServer& search_server_;
-    int requests_size_;
+    unique_ptr<Slot[]> slots_;
+    // текст запроса ячейки i - query_slab_[i * MAX_STORED_QUERY_LENGTH, ...)
+    unique_ptr<char[]> query_slab_;
+    atomic<uint64_t> request_count_ = 0;
+    atomic<int> no_result_count_ = 0;
+
+    template <typename Search>
+    vector<Document> Execute(string_view raw_query, Search search);
+
+    void Record(string_view raw_query, bool empty, chrono::nanoseconds latency);
+
+    // Копия запроса ячейки, если в ней всё ещё запрос с номером ticket + 1
+    bool ReadSlot(size_t index, uint64_t ticket, RequestRecord& record) const;
+
+    static void Lock(Slot& slot);
+    static void Unlock(Slot& slot);
 };
 
+template <typename Search>
+vector<Document> RequestQueue::Execute(string_view raw_query, Search search) {
+    const auto start = chrono::steady_clock::now();
+    vector<Document> matched_documents = search();
+    Record(raw_query, matched_documents.empty(), chrono::steady_clock::now() - start);
+    return matched_documents;
+}
+
 template <typename DocumentPredicate>
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query, DocumentPredicate document_predicate) {
-    QueryResult query;
-    auto matched_documents = search_server_.FindTopDocuments(raw_query, document_predicate);
-    if (requests_size_ < min_in_day_) {
-        ++requests_size_;
-        if (matched_documents.empty()) {
-            query.request = raw_query;
-            query.empty = true;
-            requests_.push_back(query);
-        } else {
-            query.request = raw_query;
-            query.empty = false;
-            requests_.push_back(query);
-        }
-    } else {
-        requests_.pop_front();
-        if (matched_documents.empty()) {
-            query.request = raw_query;
-            query.empty = true;
-            requests_.push_back(query);
-        } else {
-            query.request = raw_query;
-            query.empty = false;
-            requests_.push_back(query);
-        }
-    }
-    return matched_documents;
-}
\ No newline at end of file
+    return Execute(raw_query, [&] {
+        return search_server_.FindTopDocuments(raw_query, document_predicate);
+    });
+}
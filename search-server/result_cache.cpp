@@ -0,0 +1,99 @@
+#include "result_cache.h"
+
+#include <functional>
+
+using namespace std;
+
+ResultCache::ResultCache(size_t capacity)
+    : capacity_(capacity)
+{}
+
+void ResultCache::SetCapacity(size_t capacity) {
+    capacity_.store(capacity, memory_order_relaxed);
+    const size_t shard_capacity = GetShardCapacity();
+    for (Shard& shard : shards_) {
+        lock_guard lock(shard.mutex);
+        EvictExcess(shard, shard_capacity);
+    }
+}
+
+optional<vector<Document>> ResultCache::Find(string_view key, uint64_t epoch) {
+    Shard& shard = GetShard(key);
+    {
+        lock_guard lock(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            if (it->second->epoch == epoch) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                hits_.fetch_add(1, memory_order_relaxed);
+                return it->second->documents;
+            }
+            ++shard.invalidations;
+            Erase(shard, it->second);
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return nullopt;
+}
+
+void ResultCache::Insert(string_view key, uint64_t epoch, const vector<Document>& documents) {
+    const size_t shard_capacity = GetShardCapacity();
+    if (shard_capacity == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // запись могла появиться, пока запрос выполнялся в другом потоке
+        Erase(shard, it->second);
+    }
+    shard.entries.push_front({string(key), epoch, documents});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.memory_usage += GetEntryMemoryUsage(shard.entries.front());
+    EvictExcess(shard, shard_capacity);
+}
+
+ResultCacheStats ResultCache::GetStats() const {
+    ResultCacheStats stats;
+    stats.hits = hits_.load(memory_order_relaxed);
+    stats.misses = misses_.load(memory_order_relaxed);
+    for (const Shard& shard : shards_) {
+        lock_guard lock(shard.mutex);
+        stats.evictions += shard.evictions;
+        stats.invalidations += shard.invalidations;
+        stats.entry_count += shard.entries.size();
+        stats.memory_usage += shard.memory_usage;
+    }
+    return stats;
+}
+
+size_t ResultCache::GetEntryMemoryUsage(const Entry& entry) {
+    // узел списка с записью и узел таблицы с ключом, итератором и хешем
+    constexpr size_t NODE_OVERHEAD = 2 * sizeof(void*);
+    return sizeof(Entry) + NODE_OVERHEAD
+        + sizeof(string_view) + sizeof(list<Entry>::iterator) + sizeof(size_t) + NODE_OVERHEAD
+        + (entry.key.capacity() > string().capacity() ? entry.key.capacity() : 0)
+        + entry.documents.capacity() * sizeof(Document);
+}
+
+ResultCache::Shard& ResultCache::GetShard(string_view key) {
+    return shards_[hash<string_view>{}(key) % SHARD_COUNT];
+}
+
+size_t ResultCache::GetShardCapacity() const {
+    return (GetCapacity() + SHARD_COUNT - 1) / SHARD_COUNT;
+}
+
+void ResultCache::Erase(Shard& shard, list<Entry>::iterator entry) {
+    shard.memory_usage -= GetEntryMemoryUsage(*entry);
+    shard.index.erase(entry->key);
+    shard.entries.erase(entry);
+}
+
+void ResultCache::EvictExcess(Shard& shard, size_t shard_capacity) {
+    while (shard.entries.size() > shard_capacity) {
+        ++shard.evictions;
+        Erase(shard, prev(shard.entries.end()));
+    }
+}
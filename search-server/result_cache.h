@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // записи, вытесненные из-за нехватки места
+    uint64_t evictions = 0;
+    // записи, найденные для устаревшей эпохи индекса и удалённые
+    uint64_t invalidations = 0;
+    size_t entry_count = 0;
+    // оценка памяти записей: ключи, результаты и узлы списков и таблиц
+    size_t memory_usage = 0;
+
+    double GetHitRate() const {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+    }
+};
+
+// Кеш результатов поиска по ключу нормализованного запроса. Запись действительна
+// только для эпохи индекса, при которой она получена: после изменения документов
+// эпоха растёт, и старые записи удаляются при обращении или вытесняются.
+// Записи делятся на сегменты по хешу ключа, в каждом сегменте своя блокировка
+// и вытеснение давно не использованных записей (LRU)
+class ResultCache {
+public:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    // capacity - наибольшее число записей, оно делится поровну между сегментами;
+    // 0 - кеш выключен
+    explicit ResultCache(size_t capacity = 0);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Лишние записи вытесняются сразу
+    void SetCapacity(size_t capacity);
+
+    size_t GetCapacity() const {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+
+    bool IsEnabled() const {
+        return GetCapacity() > 0;
+    }
+
+    std::optional<std::vector<Document>> Find(std::string_view key, uint64_t epoch);
+
+    void Insert(std::string_view key, uint64_t epoch, const std::vector<Document>& documents);
+
+    ResultCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t epoch;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // в начале - последние использованные записи; ключи таблицы указывают в записи
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        size_t memory_usage = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    std::atomic<size_t> capacity_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    Shard shards_[SHARD_COUNT];
+
+    static size_t GetEntryMemoryUsage(const Entry& entry);
+
+    Shard& GetShard(std::string_view key);
+
+    size_t GetShardCapacity() const;
+
+    void Erase(Shard& shard, std::list<Entry>::iterator entry);
+
+    void EvictExcess(Shard& shard, size_t shard_capacity);
+};
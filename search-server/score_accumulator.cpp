@@ -0,0 +1,73 @@
+#include "score_accumulator.h"
+
+using namespace std;
+
+void ScoreAccumulator::Reset(size_t document_count) {
+    if (found_.size() < document_count) {
+        scores_.resize(document_count);
+        found_.resize(document_count, false);
+        excluded_.resize((document_count + 63) / 64, 0);
+    }
+}
+
+void ScoreAccumulator::Exclude(const DocumentBitmap& bitmap, uint32_t first, uint32_t last) {
+    ExcludeWords(bitmap, first, last, [](uint64_t excluded, uint64_t bits) {
+        return excluded | bits;
+    });
+}
+
+void ScoreAccumulator::ExcludeAllExcept(const DocumentBitmap& bitmap, uint32_t first, uint32_t last) {
+    ExcludeWords(bitmap, first, last, [](uint64_t excluded, uint64_t bits) {
+        return excluded | ~bits;
+    });
+}
+
+template <typename Combine>
+void ScoreAccumulator::ExcludeWords(const DocumentBitmap& bitmap, uint32_t first, uint32_t last, Combine combine) {
+    if (first >= last) {
+        return;
+    }
+    const uint32_t first_word = first / 64;
+    const uint32_t last_word = (last + 63) / 64;
+    bitmap_words_.resize(last_word - first_word);
+    bitmap.CopyWords(first_word, last_word, bitmap_words_.data());
+    uint64_t* excluded = excluded_.data() + first_word;
+    const uint64_t* bits = bitmap_words_.data();
+    // простой цикл по словам компилятор векторизует
+    for (uint32_t i = 0; i < last_word - first_word; ++i) {
+        excluded[i] = combine(excluded[i], bits[i]);
+    }
+    excluded_word_ranges_.push_back({first_word, last_word});
+}
+
+void ScoreAccumulator::Clear() {
+    for (const uint32_t ordinal : found_ordinals_) {
+        found_[ordinal] = false;
+    }
+    found_ordinals_.clear();
+    for (const uint32_t word : excluded_words_) {
+        excluded_[word] = 0;
+    }
+    excluded_words_.clear();
+    for (const auto& [first_word, last_word] : excluded_word_ranges_) {
+        fill(excluded_.begin() + first_word, excluded_.begin() + last_word, 0);
+    }
+    excluded_word_ranges_.clear();
+}
+
+ScoreAccumulator::Lease::Lease(size_t document_count) {
+    thread_local ScoreAccumulator thread_accumulator;
+    if (thread_accumulator.is_leased_) {
+        own_accumulator_ = make_unique<ScoreAccumulator>();
+        accumulator_ = own_accumulator_.get();
+    } else {
+        accumulator_ = &thread_accumulator;
+    }
+    accumulator_->is_leased_ = true;
+    accumulator_->Reset(document_count);
+}
+
+ScoreAccumulator::Lease::~Lease() {
+    accumulator_->Clear();
+    accumulator_->is_leased_ = false;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "document_bitmap.h"
+
+// Накопитель релевантности документов: массив оценок по порядковому номеру
+// документа, признак найденного документа и битовая маска исключённых документов.
+// Исключённые документы (минус-слова, фильтр по статусу) больше не получают оценок.
+// Память не освобождается между запросами, очищаются только затронутые документы
+class ScoreAccumulator {
+public:
+    // Готовит накопитель для document_count документов. Накопитель должен быть очищен
+    void Reset(size_t document_count);
+
+    // Номера затронутых документов запоминаются, поэтому очистка и обход
+    // не зависят от общего числа документов
+    void Add(uint32_t ordinal, double score) {
+        if (!found_[ordinal]) {
+            found_[ordinal] = true;
+            scores_[ordinal] = score;
+            found_ordinals_.push_back(ordinal);
+        } else {
+            scores_[ordinal] += score;
+        }
+    }
+
+    void Exclude(uint32_t ordinal) {
+        uint64_t& word = excluded_[ordinal / 64];
+        if (word == 0) {
+            excluded_words_.push_back(ordinal / 64);
+        }
+        word |= uint64_t{1} << (ordinal % 64);
+    }
+
+    // Исключение по битовой карте выполняется целыми 64-битными словами, поэтому
+    // могут быть затронуты документы за границами [first, last) в крайних словах
+    void Exclude(const DocumentBitmap& bitmap, uint32_t first, uint32_t last);
+
+    void ExcludeAllExcept(const DocumentBitmap& bitmap, uint32_t first, uint32_t last);
+
+    bool IsExcluded(uint32_t ordinal) const {
+        return (excluded_[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    // Вызывает callback(ordinal, relevance) для найденных и не исключённых
+    // документов с порядковыми номерами из [first, last) по возрастанию номера
+    template <typename Callback>
+    void ForEach(uint32_t first, uint32_t last, Callback callback);
+
+    template <typename Callback>
+    void ForEach(Callback callback) {
+        ForEach(0, static_cast<uint32_t>(found_.size()), callback);
+    }
+
+    void Clear();
+
+    // Выдаёт накопитель, закреплённый за текущим потоком, и очищает его по окончании.
+    // Если накопитель потока уже занят (вложенный поиск), выдаётся отдельный
+    class Lease {
+    public:
+        explicit Lease(size_t document_count);
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ScoreAccumulator& operator*() {
+            return *accumulator_;
+        }
+
+        ScoreAccumulator* operator->() {
+            return accumulator_;
+        }
+
+    private:
+        ScoreAccumulator* accumulator_;
+        std::unique_ptr<ScoreAccumulator> own_accumulator_;
+    };
+
+private:
+    std::vector<double> scores_;
+    std::vector<uint8_t> found_;
+    std::vector<uint32_t> found_ordinals_;
+    std::vector<uint64_t> excluded_;
+    // слова маски, которые могут быть ненулевыми: по одному и диапазонами
+    std::vector<uint32_t> excluded_words_;
+    std::vector<std::pair<uint32_t, uint32_t>> excluded_word_ranges_;
+    std::vector<uint64_t> bitmap_words_;
+    bool is_leased_ = false;
+
+    template <typename Combine>
+    void ExcludeWords(const DocumentBitmap& bitmap, uint32_t first, uint32_t last, Combine combine);
+};
+
+template <typename Callback>
+void ScoreAccumulator::ForEach(uint32_t first, uint32_t last, Callback callback) {
+    // если все документы нашло одно слово, номера уже упорядочены
+    if (!std::is_sorted(found_ordinals_.begin(), found_ordinals_.end())) {
+        std::sort(found_ordinals_.begin(), found_ordinals_.end());
+    }
+    const auto found_end = std::lower_bound(found_ordinals_.begin(), found_ordinals_.end(), last);
+    for (auto it = std::lower_bound(found_ordinals_.begin(), found_ordinals_.end(), first); it != found_end; ++it) {
+        if (!IsExcluded(*it)) {
+            callback(*it, scores_[*it]);
+        }
+    }
+}
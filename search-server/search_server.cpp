@@ -2,6 +2,9 @@
 #include "search_server.h"
 #include "log_duration.h"
 
+#include <thread>
+#include <unordered_set>
+
 
 using namespace std;
 
@@ -10,13 +13,335 @@ SearchServer::SearchServer(const string& stop_words)
 {}
 
 SearchServer::SearchServer(const string_view& stop_words) 
-    : SearchServer(SplitIntoWords(stop_words))
+    : SearchServer(SplitIntoValidWords(stop_words))
+{}
+
+SearchServer::SearchServer(const SearchServer& other, SnapshotTag)
+    : stop_words_(other.stop_words_)
+    , stop_word_filter_(other.stop_word_filter_)
+    , index_epoch_(other.index_epoch_)
+    , result_cache_(other.result_cache_)
+    , executor_(other.executor_)
+    , term_words_(other.term_words_)
+    , term_ids_(other.term_ids_)
+    , document_freqs_(other.document_freqs_)
+    , log_document_count_(other.log_document_count_)
+    , log_document_freqs_(other.log_document_freqs_)
+    , dense_term_share_(other.dense_term_share_)
+    , term_bitmaps_(other.term_bitmaps_)
+    , status_bitmaps_(other.status_bitmaps_)
+    , document_to_ordinal_(other.document_to_ordinal_)
+    , document_ids_(other.document_ids_)
+    , document_ratings_(other.document_ratings_)
+    , document_statuses_(other.document_statuses_)
+    , inverse_word_counts_(other.inverse_word_counts_)
+    , word_frequencies_(other.word_frequencies_)
+    , image_(other.image_)
+    , mapped_document_count_(other.mapped_document_count_)
+    , mapped_word_offsets_(other.mapped_word_offsets_)
+    , mapped_words_(other.mapped_words_)
+    , mapped_word_frequencies_(other.mapped_word_frequencies_)
+    , previous_ordinals_(other.previous_ordinals_)
+    , next_ordinals_(other.next_ordinals_)
+    , first_ordinal_(other.first_ordinal_)
+    , last_ordinal_(other.last_ordinal_)
+    , document_ranks_(other.document_ranks_)
+    , index_(other.index_, SegmentedIndex::Frozen{})
+    , published_snapshot_(this)
+    , snapshot_version_(other.snapshot_version_)
 {}
 
+SearchServer::MappedWordFrequencies::MappedWordFrequencies(size_t document_count)
+    : maps(document_count)
+{}
+
+SearchServer::MappedWordFrequencies::~MappedWordFrequencies() {
+    for (const atomic<const map<string_view, double>*>& word_freqs : maps) {
+        delete word_freqs.load(memory_order_relaxed);
+    }
+}
+
+SearchServer::SearchServer(shared_ptr<const IndexImage> image)
+    : image_(move(image))
+{
+    const invalid_argument corrupted("corrupted index image"s);
+    for (CopyOnWrite<DocumentBitmap>& bitmap : status_bitmaps_) {
+        bitmap.emplace();
+    }
+
+    ImageReader stop_words = image_->GetSection(IndexImage::STOP_WORDS);
+    for (uint64_t count = stop_words.Read<uint64_t>(); count > 0; --count) {
+        stop_words_.emplace(stop_words.ReadString());
+    }
+    stop_word_filter_ = StopWordFilter(stop_words_);
+
+    // строки словаря остаются в образе
+    ImageReader terms = image_->GetSection(IndexImage::TERMS);
+    const uint64_t term_count = terms.Read<uint64_t>();
+    for (uint64_t term_id = 0; term_id < term_count; ++term_id) {
+        const string_view word = terms.ReadString();
+        if (!term_ids_.Insert(word, static_cast<TermId>(term_id))) {
+            throw corrupted;
+        }
+        term_words_.push_back(word);
+        term_bitmaps_.push_back({});
+    }
+    const MappedVector<uint32_t> document_freqs = terms.ReadArray<uint32_t>();
+    if (document_freqs.size() != term_count) {
+        throw corrupted;
+    }
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        document_freqs_.push_back(document_freqs[term_id]);
+        log_document_freqs_.push_back(0.0);
+        UpdateDocumentFreq(term_id);
+    }
+
+    ImageReader documents = image_->GetSection(IndexImage::DOCUMENTS);
+    const MappedVector<int> ids = documents.ReadArray<int>();
+    const MappedVector<int> ratings = documents.ReadArray<int>();
+    const MappedVector<DocumentStatus> statuses = documents.ReadArray<DocumentStatus>();
+    const MappedVector<double> inverse_word_counts = documents.ReadArray<double>();
+    const size_t document_count = ids.size();
+    if (ratings.size() != document_count || statuses.size() != document_count
+        || inverse_word_counts.size() != document_count || document_count >= NO_ORDINAL) {
+        throw corrupted;
+    }
+    ImageReader document_words = image_->GetSection(IndexImage::DOCUMENT_WORDS);
+    mapped_word_offsets_ = document_words.ReadArray<uint64_t>();
+    mapped_words_ = document_words.ReadArray<ImageDocumentWord>();
+    if (mapped_word_offsets_.size() != document_count + 1 || mapped_word_offsets_.front() != 0
+        || !is_sorted(mapped_word_offsets_.begin(), mapped_word_offsets_.end())
+        || mapped_word_offsets_.back() != mapped_words_.size()
+        || any_of(mapped_words_.begin(), mapped_words_.end(), [term_count](const ImageDocumentWord& word) {
+            return word.term_id >= term_count;
+        })) {
+        throw corrupted;
+    }
+
+    // документы образа пронумерованы в порядке добавления
+    for (uint32_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        const size_t status = static_cast<size_t>(statuses[ordinal]);
+        if (ids[ordinal] < 0 || status >= status_bitmaps_.size() || !document_to_ordinal_.Insert(ids[ordinal], ordinal)) {
+            throw corrupted;
+        }
+        status_bitmaps_[status].Mutable().Add(ordinal);
+        document_ids_.push_back(ids[ordinal]);
+        document_ratings_.push_back(ratings[ordinal]);
+        document_statuses_.push_back(statuses[ordinal]);
+        inverse_word_counts_.push_back(inverse_word_counts[ordinal]);
+        word_frequencies_.push_back(nullptr);
+        previous_ordinals_.push_back(ordinal == 0 ? NO_ORDINAL : ordinal - 1);
+        next_ordinals_.push_back(ordinal + 1 == document_count ? NO_ORDINAL : ordinal + 1);
+        document_ranks_.Add(ordinal);
+    }
+    mapped_document_count_ = static_cast<uint32_t>(document_count);
+    mapped_word_frequencies_ = make_shared<MappedWordFrequencies>(document_count);
+    if (document_count > 0) {
+        first_ordinal_ = 0;
+        last_ordinal_ = static_cast<uint32_t>(document_count - 1);
+        log_document_count_ = log(GetDocumentCount());
+    }
+
+    // списки вхождений ссылаются на образ, сегмент продлевает его жизнь
+    ImageReader posting_lists = image_->GetSection(IndexImage::POSTINGS);
+    unordered_map<TermId, PostingList> postings;
+    postings.reserve(term_count);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        PostingList term_postings = PostingList::ReadFrom(posting_lists);
+        if (term_postings.size() != document_freqs_[term_id]) {
+            throw corrupted;
+        }
+        postings.emplace(term_id, move(term_postings));
+    }
+    if (document_count > 0) {
+        index_.AddSegment(make_shared<const IndexSegment>(0, vector<double>(inverse_word_counts.begin(), inverse_word_counts.end()),
+                                                          move(postings), image_));
+    }
+    PublishSnapshot();
+}
+
+void SearchServer::SaveImage(const string& path) const {
+    // документы нумеруются заново в порядке добавления, слова - в порядке
+    // идентификаторов без слов, которых нет ни в одном документе
+    vector<uint32_t> new_ordinals(document_ids_.size(), NO_ORDINAL);
+    vector<uint32_t> ordinals;
+    for (uint32_t ordinal = first_ordinal_; ordinal != NO_ORDINAL; ordinal = next_ordinals_[ordinal]) {
+        new_ordinals[ordinal] = static_cast<uint32_t>(ordinals.size());
+        ordinals.push_back(ordinal);
+    }
+    vector<TermId> new_term_ids(term_words_.size(), numeric_limits<TermId>::max());
+    vector<TermId> term_ids;
+    for (TermId term_id = 0; term_id < term_words_.size(); ++term_id) {
+        if (document_freqs_[term_id] > 0) {
+            new_term_ids[term_id] = static_cast<TermId>(term_ids.size());
+            term_ids.push_back(term_id);
+        }
+    }
+
+    ImageWriter writer(path);
+    writer.BeginSection(IndexImage::STOP_WORDS);
+    writer.Write<uint64_t>(stop_words_.size());
+    for (const string& word : stop_words_) {
+        writer.WriteString(word);
+    }
+
+    writer.BeginSection(IndexImage::TERMS);
+    writer.Write<uint64_t>(term_ids.size());
+    vector<uint32_t> document_freqs;
+    document_freqs.reserve(term_ids.size());
+    for (const TermId term_id : term_ids) {
+        writer.WriteString(term_words_[term_id]);
+        document_freqs.push_back(document_freqs_[term_id]);
+    }
+    writer.WriteArray(document_freqs.data(), document_freqs.size());
+
+    vector<int> ids;
+    vector<int> ratings;
+    vector<DocumentStatus> statuses;
+    vector<double> inverse_word_counts;
+    vector<uint64_t> word_offsets = {0};
+    vector<ImageDocumentWord> words;
+    for (const uint32_t ordinal : ordinals) {
+        ids.push_back(document_ids_[ordinal]);
+        ratings.push_back(document_ratings_[ordinal]);
+        statuses.push_back(document_statuses_[ordinal]);
+        inverse_word_counts.push_back(inverse_word_counts_[ordinal]);
+        ForEachDocumentWord(ordinal, [&](TermId term_id, double freq) {
+            words.push_back({new_term_ids[term_id], 0, freq});
+        });
+        word_offsets.push_back(words.size());
+    }
+    writer.BeginSection(IndexImage::DOCUMENTS);
+    writer.WriteArray(ids.data(), ids.size());
+    writer.WriteArray(ratings.data(), ratings.size());
+    writer.WriteArray(statuses.data(), statuses.size());
+    writer.WriteArray(inverse_word_counts.data(), inverse_word_counts.size());
+    writer.BeginSection(IndexImage::DOCUMENT_WORDS);
+    writer.WriteArray(word_offsets.data(), word_offsets.size());
+    writer.WriteArray(words.data(), words.size());
+
+    // списки вхождений собираются из всех сегментов без удалённых документов
+    writer.BeginSection(IndexImage::POSTINGS);
+    const IndexSnapshot snapshot = index_.GetSnapshot();
+    for (const TermId term_id : term_ids) {
+        PostingList postings;
+        snapshot.ForEachPosting(term_id, [&](uint32_t ordinal, uint32_t term_count) {
+            if (new_ordinals[ordinal] != NO_ORDINAL) {
+                postings.Append(new_ordinals[ordinal], term_count, term_count * inverse_word_counts_[ordinal]);
+            }
+        });
+        postings.WriteTo(writer);
+    }
+    writer.Finish(POSTING_FORMAT);
+}
+
+SearchServer::~SearchServer() {
+    if (published_snapshot_.load() != this) {
+        delete published_snapshot_.load();
+    }
+}
+
+SearchServer::Snapshot::Snapshot(const EpochManager* epochs, size_t slot, const SearchServer* server)
+    : epochs_(epochs)
+    , slot_(slot)
+    , server_(server)
+{}
+
+SearchServer::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : epochs_(exchange(other.epochs_, nullptr))
+    , slot_(other.slot_)
+    , server_(exchange(other.server_, nullptr))
+{}
+
+SearchServer::Snapshot& SearchServer::Snapshot::operator=(Snapshot&& other) noexcept {
+    if (this != &other) {
+        if (epochs_ != nullptr) {
+            epochs_->Leave(slot_);
+        }
+        epochs_ = exchange(other.epochs_, nullptr);
+        slot_ = other.slot_;
+        server_ = exchange(other.server_, nullptr);
+    }
+    return *this;
+}
+
+SearchServer::Snapshot::~Snapshot() {
+    if (epochs_ != nullptr) {
+        epochs_->Leave(slot_);
+    }
+}
+
+uint64_t SearchServer::Snapshot::GetVersion() const {
+    return server_->snapshot_version_;
+}
+
+SearchServer::Snapshot SearchServer::GetSnapshot() const {
+    // версия читается после занятия слота: версию, прочитанную раньше замены,
+    // писатель не освободит, пока слот занят
+    const size_t slot = epochs_.Enter();
+    return Snapshot(&epochs_, slot, published_snapshot_.load());
+}
+
+void SearchServer::PublishSnapshot() {
+    // буфер записи изменяется на месте, поэтому в версию попадает только сегментами
+    index_.Flush();
+    ++snapshot_version_;
+    const SearchServer* snapshot = new SearchServer(*this, SnapshotTag{});
+    const SearchServer* replaced = published_snapshot_.exchange(snapshot);
+    if (replaced != nullptr) {
+        retired_snapshots_.push_back({epochs_.Advance(), unique_ptr<const SearchServer>(replaced)});
+    }
+    unpublished_write_count_ = 0;
+    ReclaimSnapshots();
+}
+
+void SearchServer::SetSnapshotPublishInterval(size_t write_count) {
+    snapshot_publish_interval_ = write_count;
+}
+
+void SearchServer::OnDocumentsChanged() {
+    ++index_epoch_;
+    ++unpublished_write_count_;
+    if (snapshot_publish_interval_ > 0 && unpublished_write_count_ >= snapshot_publish_interval_) {
+        PublishSnapshot();
+    }
+}
+
+void SearchServer::ReclaimSnapshots() {
+    const uint64_t min_active_epoch = epochs_.GetMinActiveEpoch();
+    retired_snapshots_.erase(remove_if(retired_snapshots_.begin(), retired_snapshots_.end(), [min_active_epoch](const RetiredSnapshot& retired) {
+        return retired.epoch < min_active_epoch;
+    }), retired_snapshots_.end());
+}
+
 void SearchServer::SetStopWords(const string_view& text) {
-        InsertCorrectStopWords(SplitIntoWords(text));
+        InsertCorrectStopWords(SplitIntoValidWords(text));
+        ++index_epoch_;
 }    
 
+void SearchServer::SetDenseTermShare(double share) {
+    dense_term_share_ = share;
+    for (TermId term_id = 0; term_id < document_freqs_.size(); ++term_id) {
+        if (document_freqs_[term_id] > 0 && document_freqs_[term_id] >= dense_term_share_ * GetDocumentCount()) {
+            term_bitmaps_.Mutable(term_id).emplace(BuildTermBitmap(term_id));
+        } else if (term_bitmaps_[term_id]) {
+            term_bitmaps_.Mutable(term_id).reset();
+        }
+    }
+}
+
+void SearchServer::SetWriteBufferSize(size_t document_count) {
+    index_.SetWriteBufferSize(document_count);
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return index_.GetSegmentCount();
+}
+
+void SearchServer::WaitForSegmentMerges() const {
+    index_.WaitForMerges();
+}
+
 vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query) const { 
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL); 
 }
@@ -29,73 +354,581 @@ vector<Document> SearchServer::FindTopDocuments(execution::parallel_policy polic
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL); 
 }
 
-vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, DocumentStatus status) const {
-    auto key_l = [status](int document_id, DocumentStatus compare_status, int rating) { 
-        return status == compare_status;  };
-    return FindTopDocuments(raw_query, key_l); 
+vector<Document> SearchServer::FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query) const { 
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL); 
+}
+
+vector<Document> SearchServer::FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count) const {
+    const DocumentStatusPredicate key_l{status};
+    return FindTopDocuments(policy, raw_query, key_l, max_result_count); 
 }
 
-vector<Document> SearchServer::FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, DocumentStatus status) const {
-    auto key_l = [status](int document_id, DocumentStatus compare_status, int rating) { 
-        return status == compare_status;  };
-    return FindTopDocuments(raw_query, key_l); 
+vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, DocumentStatus status, int max_result_count, QueryMode mode) const {
+    const DocumentStatusPredicate key_l{status};
+    return FindTopDocuments(raw_query, key_l, max_result_count, mode); 
 }
 
-vector<Document> SearchServer::FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, DocumentStatus status) const {
-    auto key_l = [status](int document_id, DocumentStatus compare_status, int rating) { 
-        return status == compare_status;  };
-    return FindTopDocuments(policy, raw_query, key_l); 
+vector<Document> SearchServer::FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count, QueryMode mode) const {
+    const DocumentStatusPredicate key_l{status};
+    return FindTopDocuments(raw_query, key_l, max_result_count, mode); 
+}
+
+vector<Document> SearchServer::FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count, QueryMode mode) const {
+    const DocumentStatusPredicate key_l{status};
+    return FindTopDocuments(policy, raw_query, key_l, max_result_count, mode); 
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& queries, DocumentStatus status, int max_result_count, QueryMode mode) const {
+    return FindTopDocumentsBatch(queries, 0, queries.size(), status, max_result_count, mode);
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& queries, size_t first, size_t last, DocumentStatus status, int max_result_count, QueryMode mode) const {
+    // запросы, одинаковые после разбора, выполняются один раз; ключ - как у кеша результатов
+    const DocumentStatusPredicate predicant{status};
+    vector<Query> unique_queries;
+    vector<size_t> unique_query_indices;
+    vector<size_t> query_to_unique(last - first);
+    unordered_map<string, size_t> query_keys;
+    for (size_t i = first; i < last; ++i) {
+        Query query = ParseQuery(queries[i], pmr::get_default_resource());
+        pmr::string key(pmr::get_default_resource());
+        BuildResultCacheKey(query, predicant, 0, mode, SearchMethod::SEQUENTIAL, key);
+        const auto [it, is_inserted] = query_keys.emplace(string(key), unique_queries.size());
+        if (is_inserted) {
+            unique_queries.push_back(move(query));
+            unique_query_indices.push_back(i);
+        }
+        query_to_unique[i - first] = it->second;
+    }
+
+    vector<vector<Document>> unique_results(unique_queries.size());
+    if (mode == QueryMode::ALL_WORDS) {
+        // пересечение списков вхождений у каждого запроса своё
+        executor_->ParallelFor(unique_queries.size(), [&](size_t i) {
+            unique_results[i] = FindTopDocuments(queries[unique_query_indices[i]], status, max_result_count, mode);
+        });
+    } else {
+        const size_t group_count = (unique_queries.size() + BATCH_GROUP_SIZE - 1) / BATCH_GROUP_SIZE;
+        executor_->ParallelFor(group_count, [&](size_t group) {
+            const size_t first = group * BATCH_GROUP_SIZE;
+            FindTopDocumentsBatchGroup(unique_queries, first, min(first + BATCH_GROUP_SIZE, unique_queries.size()), predicant, max_result_count, unique_results);
+        });
+    }
+
+    vector<vector<Document>> results(last - first);
+    for (size_t i = 0; i < results.size(); ++i) {
+        results[i] = unique_results[query_to_unique[i]];
+    }
+    return results;
+}
+
+void SearchServer::FindTopDocumentsBatchGroup(const vector<Query>& queries, size_t first, size_t last, DocumentStatusPredicate predicant, int max_result_count, vector<vector<Document>>& results) const {
+    // Плюс-слова разобранного запроса упорядочены, поэтому при обходе слов группы
+    // по возрастанию каждый запрос получает свои слова в том же порядке, что и в
+    // FindAllDocuments, и оценки документов складываются в том же порядке
+    vector<pair<string_view, TermId>> group_terms;
+    for (size_t i = first; i < last; ++i) {
+        for (const string_view& word : queries[i].plus_words) {
+            if (const optional<TermId> term_id = FindTermId(word)) {
+                group_terms.push_back({word, *term_id});
+            }
+        }
+    }
+    const size_t query_term_count = group_terms.size();
+    sort(group_terms.begin(), group_terms.end());
+    group_terms.erase(unique(group_terms.begin(), group_terms.end()), group_terms.end());
+    const size_t count = max(max_result_count, 0);
+
+    // при малой доле общих слов запросы считаются по одному: накопитель одного
+    // запроса остаётся в кеше процессора
+    if (query_term_count < MIN_BATCH_TERM_SHARING * group_terms.size()) {
+        for (size_t i = first; i < last; ++i) {
+            QueryArena::Lease arena;
+            auto matched_documents = FindAllDocuments(queries[i], predicant, arena.GetResource());
+            SelectTopDocuments(matched_documents, count);
+            results[i].assign(matched_documents.begin(), matched_documents.end());
+        }
+        return;
+    }
+
+    // запросы группы с каждым словом, по возрастанию номера запроса
+    const size_t group_size = last - first;
+    vector<vector<uint32_t>> term_queries(group_terms.size());
+    vector<pmr::vector<TermId>> minus_term_ids;
+    for (size_t i = first; i < last; ++i) {
+        for (const string_view& word : queries[i].plus_words) {
+            if (const optional<TermId> term_id = FindTermId(word)) {
+                const auto term = lower_bound(group_terms.begin(), group_terms.end(), make_pair(word, *term_id));
+                term_queries[term - group_terms.begin()].push_back(static_cast<uint32_t>(i - first));
+            }
+        }
+        minus_term_ids.push_back(FindMinusTermIds(queries[i], pmr::get_default_resource()));
+    }
+    // найденных документов не больше, чем вхождений слов запроса
+    for (size_t i = first; i < last; ++i) {
+        size_t posting_count = 0;
+        for (const string_view& word : queries[i].plus_words) {
+            if (const optional<TermId> term_id = FindTermId(word)) {
+                posting_count += document_freqs_[*term_id];
+            }
+        }
+        results[i].reserve(min<size_t>(posting_count, document_ids_.size()));
+    }
+    vector<double> inverse_document_freqs;
+    for (const auto& [word, term_id] : group_terms) {
+        inverse_document_freqs.push_back(HasZeroInverseDocumentFreq(term_id) ? 0.0 : ComputeWordInverseDocumentFreq(term_id));
+    }
+
+    // Документы обходятся окнами порядковых номеров. В окне список вхождений каждого
+    // слова обходится один раз: статус и вклад документа считаются один раз и
+    // добавляются в накопители всех запросов со словом. Накопители группы - по
+    // BATCH_SCATTER_WINDOW_SIZE оценок и бит исключения на запрос
+    constexpr uint32_t WINDOW_WORD_COUNT = BATCH_SCATTER_WINDOW_SIZE / 64;
+    const IndexSnapshot snapshot = index_.GetSnapshot();
+    const DocumentBitmap& removed = index_.GetRemovedDocuments();
+    const uint32_t document_count = static_cast<uint32_t>(document_ids_.size());
+    vector<double> scores(group_size * BATCH_SCATTER_WINDOW_SIZE);
+    vector<uint8_t> found(group_size * BATCH_SCATTER_WINDOW_SIZE, false);
+    vector<uint64_t> excluded(group_size * WINDOW_WORD_COUNT);
+    vector<uint64_t> removed_words(WINDOW_WORD_COUNT);
+    vector<vector<uint32_t>> found_offsets(group_size);
+    for (uint32_t window_first = 0; window_first < document_count; window_first += BATCH_SCATTER_WINDOW_SIZE) {
+        const uint32_t window_last = min(window_first + BATCH_SCATTER_WINDOW_SIZE, document_count);
+        const uint32_t window_word_count = (window_last - window_first + 63) / 64;
+        fill(removed_words.begin(), removed_words.end(), 0);
+        if (!removed.empty()) {
+            removed.CopyWords(window_first / 64, window_first / 64 + window_word_count, removed_words.data());
+        }
+        for (size_t q = 0; q < group_size; ++q) {
+            uint64_t* query_excluded = excluded.data() + q * WINDOW_WORD_COUNT;
+            copy(removed_words.begin(), removed_words.end(), query_excluded);
+            for (const TermId term_id : minus_term_ids[q]) {
+                snapshot.ForEachPostingInRange(term_id, window_first, window_last, [query_excluded, window_first](uint32_t ordinal, uint32_t) {
+                    const uint32_t offset = ordinal - window_first;
+                    query_excluded[offset / 64] |= uint64_t{1} << (offset % 64);
+                });
+            }
+        }
+
+        for (size_t t = 0; t < group_terms.size(); ++t) {
+            const vector<uint32_t>& term_query_indices = term_queries[t];
+            const double inverse_document_freq = inverse_document_freqs[t];
+            snapshot.ForEachPostingInRange(group_terms[t].second, window_first, window_last, [&](uint32_t ordinal, uint32_t term_count) {
+                if (!predicant(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                    return;
+                }
+                const double term_freq = term_count * inverse_word_counts_[ordinal];
+                const double relevance = term_freq * inverse_document_freq;
+                const uint32_t offset = ordinal - window_first;
+                for (const uint32_t q : term_query_indices) {
+                    if ((excluded[q * WINDOW_WORD_COUNT + offset / 64] >> (offset % 64)) & 1) {
+                        continue;
+                    }
+                    const size_t cell = q * BATCH_SCATTER_WINDOW_SIZE + offset;
+                    if (!found[cell]) {
+                        found[cell] = true;
+                        scores[cell] = relevance;
+                        found_offsets[q].push_back(offset);
+                    } else {
+                        scores[cell] += relevance;
+                    }
+                }
+            });
+        }
+
+        // документы выдаются по возрастанию номера, как в FindAllDocuments: отметки
+        // окна с многими найденными документами просматриваются подряд, иначе
+        // сортируются номера найденных
+        for (size_t q = 0; q < group_size; ++q) {
+            vector<uint32_t>& offsets = found_offsets[q];
+            const auto emit = [&](uint32_t offset) {
+                const uint32_t ordinal = window_first + offset;
+                const size_t cell = q * BATCH_SCATTER_WINDOW_SIZE + offset;
+                results[first + q].push_back({document_ids_[ordinal], scores[cell], document_ratings_[ordinal]});
+                found[cell] = false;
+            };
+            if (offsets.size() * 16 >= window_last - window_first) {
+                for (uint32_t offset = 0; offset < window_last - window_first; ++offset) {
+                    if (found[q * BATCH_SCATTER_WINDOW_SIZE + offset]) {
+                        emit(offset);
+                    }
+                }
+            } else {
+                sort(offsets.begin(), offsets.end());
+                for_each(offsets.begin(), offsets.end(), emit);
+            }
+            offsets.clear();
+        }
+    }
+    for (size_t i = first; i < last; ++i) {
+        SelectTopDocuments(results[i], count);
+    }
+}
+
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < MAXIMUM_MEASUREMENT_ERROR) {
+        return lhs.rating > rhs.rating;
+    } else {
+        return lhs.relevance > rhs.relevance;
+    }
 }
 
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if (document_id < 0 || documents_.count(document_id)) {
+    if (document_id < 0 || document_to_ordinal_.Contains(document_id)) {
         throw invalid_argument("invalid_argument"s);
     }
     const vector<string_view> words = SplitIntoWordsNoStop(document);
     const double inv_word_count = 1.0 / words.size();
-    for (const string_view word_view : words) {
-        string word(word_view);
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        word_frequencies_[document_id][word_to_document_freqs_.find(word)->first] += inv_word_count;
-    }
-    documents_.emplace(document_id, 
-        DocumentData{
-            ComputeAverageRating(ratings), 
-            status
+    const uint32_t ordinal = document_ids_.size();
+    vector<TermId> term_ids;
+    term_ids.reserve(words.size());
+    auto word_freqs = make_shared<map<string_view, double>>();
+    for (const string_view word : words) {
+        const TermId term_id = InternTerm(word);
+        term_ids.push_back(term_id);
+        (*word_freqs)[term_words_[term_id]] += inv_word_count;
+    }
+    sort(term_ids.begin(), term_ids.end());
+    vector<pair<TermId, uint32_t>> term_counts;
+    for (auto it = term_ids.begin(); it != term_ids.end();) {
+        const auto next = find_if(it, term_ids.end(), [term_id = *it](TermId other) {
+            return other != term_id;
         });
-    sequence_of_adding_id_.push_back(document_id);
+        term_counts.push_back({*it, static_cast<uint32_t>(next - it)});
+        ++document_freqs_.Mutable(*it);
+        UpdateDocumentFreq(*it);
+        it = next;
+    }
+    index_.AddDocument(ordinal, inv_word_count, term_counts);
+    document_to_ordinal_.Insert(document_id, ordinal);
+    log_document_count_ = log(GetDocumentCount());
+    for (const auto& [term_id, _] : term_counts) {
+        UpdateTermBitmap(term_id, ordinal, true);
+    }
+    status_bitmaps_[static_cast<size_t>(status)].Mutable().Add(ordinal);
+    document_ids_.push_back(document_id);
+    document_ratings_.push_back(ComputeAverageRating(ratings));
+    document_statuses_.push_back(status);
+    inverse_word_counts_.push_back(inv_word_count);
+    word_frequencies_.push_back(move(word_freqs));
+    previous_ordinals_.push_back(last_ordinal_);
+    next_ordinals_.push_back(NO_ORDINAL);
+    if (last_ordinal_ == NO_ORDINAL) {
+        first_ordinal_ = ordinal;
+    } else {
+        next_ordinals_.Mutable(last_ordinal_) = ordinal;
+    }
+    last_ordinal_ = ordinal;
+    document_ranks_.Add(ordinal);
+    OnDocumentsChanged();
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    for (const NewDocument& document : documents) {
+        AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+}
+
+void SearchServer::AddDocuments(execution::sequenced_policy policy, const vector<NewDocument>& documents) {
+    AddDocuments(documents);
+}
+
+void SearchServer::AddDocuments(execution::parallel_policy policy, const vector<NewDocument>& documents) {
+    vector<size_t> rejected;
+    AddDocumentBatch(documents, false, rejected);
+    if (!rejected.empty()) {
+        throw invalid_argument("invalid_argument"s);
+    }
+}
+
+void SearchServer::AddDocuments(execution::parallel_policy policy, const vector<NewDocument>& documents, vector<size_t>& rejected) {
+    rejected.clear();
+    AddDocumentBatch(documents, true, rejected);
+}
+
+void SearchServer::AddDocumentBatch(const vector<NewDocument>& documents, bool skip_rejected, vector<size_t>& rejected) {
+    // части пакета разбираются независимо, каждая со своим словарём
+    const size_t slice_count = clamp<size_t>(documents.size() / MIN_INGEST_SLICE_SIZE, 1, INGEST_SLICE_COUNT);
+    vector<size_t> slice_starts(slice_count + 1);
+    for (size_t slice = 0; slice <= slice_count; ++slice) {
+        slice_starts[slice] = documents.size() * slice / slice_count;
+    }
+    vector<bool> is_excluded(documents.size(), false);
+    vector<PartialIndex> partials(slice_count);
+    executor_->ParallelFor(slice_count, [&](size_t slice) {
+        partials[slice] = BuildPartialIndex(documents, slice_starts[slice], slice_starts[slice + 1], is_excluded, !skip_rejected);
+    });
+
+    // Повторы id внутри пакета выясняются по порядку среди принятых документов.
+    // Без пропуска добавляются документы до первого отвергнутого; с пропуском
+    // части с повторами разбираются ещё раз без них, чтобы слова повторов
+    // не получили идентификаторов
+    vector<bool> is_rejected(documents.size(), false);
+    for (const PartialIndex& partial : partials) {
+        for (const size_t i : partial.rejected_documents) {
+            is_rejected[i] = true;
+        }
+    }
+    size_t document_count = documents.size();
+    vector<size_t> reparsed_slices;
+    unordered_set<int> batch_ids;
+    for (size_t i = 0; i < document_count; ++i) {
+        if (!is_rejected[i] && !batch_ids.insert(documents[i].id).second) {
+            is_rejected[i] = true;
+            is_excluded[i] = true;
+            const size_t slice = upper_bound(slice_starts.begin(), slice_starts.end(), i) - slice_starts.begin() - 1;
+            if (reparsed_slices.empty() || reparsed_slices.back() != slice) {
+                reparsed_slices.push_back(slice);
+            }
+        }
+        if (is_rejected[i] && !skip_rejected) {
+            document_count = i;
+        }
+    }
+    if (skip_rejected) {
+        executor_->ParallelFor(reparsed_slices.size(), [&](size_t i) {
+            const size_t slice = reparsed_slices[i];
+            partials[slice] = BuildPartialIndex(documents, slice_starts[slice], slice_starts[slice + 1], is_excluded, false);
+        });
+    }
+
+    // порядковые номера получают принятые документы подряд
+    const size_t NOT_ADDED = numeric_limits<size_t>::max();
+    vector<size_t> positions(documents.size(), NOT_ADDED);
+    vector<size_t> added_documents;
+    for (size_t i = 0; i < document_count; ++i) {
+        if (is_rejected[i]) {
+            rejected.push_back(i);
+        } else {
+            positions[i] = added_documents.size();
+            added_documents.push_back(i);
+        }
+    }
+    if (document_count < documents.size()) {
+        rejected.push_back(document_count);
+    }
+    const size_t added_count = added_documents.size();
+
+    // слова получают идентификаторы в том же порядке, что и при добавлении по одному
+    vector<vector<TermId>> term_ids(slice_count);
+    for (size_t slice = 0; slice < slice_count; ++slice) {
+        const PartialIndex& partial = partials[slice];
+        for (size_t i = 0; i < partial.words.size() && partial.first_documents[i] < document_count; ++i) {
+            term_ids[slice].push_back(InternTerm(partial.words[i]));
+        }
+    }
+
+    // слова документов в общей нумерации, упорядоченные по идентификатору
+    vector<vector<pair<TermId, uint32_t>>> term_counts(added_count);
+    vector<double> inverse_word_counts(added_count);
+    vector<shared_ptr<const map<string_view, double>>> word_frequencies(added_count);
+    executor_->ParallelFor(slice_count, [&](size_t slice) {
+        const PartialIndex& partial = partials[slice];
+        for (size_t i = slice_starts[slice]; i < min(slice_starts[slice + 1], document_count); ++i) {
+            const size_t position = positions[i];
+            if (position == NOT_ADDED) {
+                continue;
+            }
+            const size_t local_index = i - slice_starts[slice];
+            const double inv_word_count = 1.0 / partial.word_counts[local_index];
+            auto word_freqs = make_shared<map<string_view, double>>();
+            for (const auto& [local_id, count] : partial.term_counts[local_index]) {
+                const TermId term_id = term_ids[slice][local_id];
+                term_counts[position].push_back({term_id, count});
+                // частота слова накапливается так же, как в AddDocument
+                double& word_freq = (*word_freqs)[term_words_[term_id]];
+                for (uint32_t j = 0; j < count; ++j) {
+                    word_freq += inv_word_count;
+                }
+            }
+            sort(term_counts[position].begin(), term_counts[position].end());
+            inverse_word_counts[position] = inv_word_count;
+            word_frequencies[position] = move(word_freqs);
+        }
+    });
+
+    // вхождения группируются по словам подсчётом: идентификаторы слов плотные
+    const uint32_t first_ordinal = document_ids_.size();
+    GroupedPostings grouped;
+    vector<uint32_t> term_positions(term_words_.size(), 0);
+    for (const auto& document_term_counts : term_counts) {
+        for (const auto& [term_id, _] : document_term_counts) {
+            if (term_positions[term_id] == 0) {
+                grouped.term_ids.push_back(term_id);
+                grouped.offsets.push_back(0);
+                term_positions[term_id] = grouped.term_ids.size();
+            }
+            ++grouped.offsets[term_positions[term_id] - 1];
+        }
+    }
+    grouped.offsets.insert(grouped.offsets.begin(), 0);
+    partial_sum(grouped.offsets.begin(), grouped.offsets.end(), grouped.offsets.begin());
+    grouped.postings.resize(grouped.offsets.back());
+    vector<size_t> term_fill(grouped.offsets.begin(), grouped.offsets.end() - 1);
+    for (size_t i = 0; i < added_count; ++i) {
+        for (const auto& [term_id, count] : term_counts[i]) {
+            grouped.postings[term_fill[term_positions[term_id] - 1]++] = {first_ordinal + static_cast<uint32_t>(i), count};
+        }
+    }
+    index_.AddDocuments(*executor_, inverse_word_counts, grouped);
+
+    // части массивов, разделяемые с опубликованными версиями, копируются
+    // до параллельного обхода: копирование не потокобезопасно
+    for (const TermId term_id : grouped.term_ids) {
+        document_freqs_.Mutable(term_id);
+        log_document_freqs_.Mutable(term_id);
+        term_bitmaps_.Mutable(term_id);
+    }
+    const size_t previous_document_count = GetDocumentCount();
+    executor_->ParallelFor(grouped.term_ids.size(), [&](size_t position) {
+        const TermId term_id = grouped.term_ids[position];
+        const auto first = grouped.postings.begin() + grouped.offsets[position];
+        const auto last = grouped.postings.begin() + grouped.offsets[position + 1];
+        const uint32_t previous_freq = document_freqs_[term_id];
+        document_freqs_.Mutable(term_id) += static_cast<uint32_t>(last - first);
+        UpdateDocumentFreq(term_id);
+        if (term_bitmaps_[term_id]) {
+            DocumentBitmap& bitmap = term_bitmaps_.Mutable(term_id).Mutable();
+            for (auto it = first; it != last; ++it) {
+                bitmap.Add(it->first);
+            }
+            return;
+        }
+        // карта строится, если слово стало частым после какого-либо документа пакета
+        for (auto it = first; it != last; ++it) {
+            const size_t document_freq = previous_freq + (it - first) + 1;
+            const size_t total_count = previous_document_count + (it->first - first_ordinal) + 1;
+            if (document_freq >= dense_term_share_ * total_count) {
+                term_bitmaps_.Mutable(term_id).emplace(BuildTermBitmap(term_id));
+                return;
+            }
+        }
+    });
+
+    for (size_t i = 0; i < added_count; ++i) {
+        const NewDocument& document = documents[added_documents[i]];
+        const uint32_t ordinal = first_ordinal + i;
+        document_to_ordinal_.Insert(document.id, ordinal);
+        status_bitmaps_[static_cast<size_t>(document.status)].Mutable().Add(ordinal);
+        document_ids_.push_back(document.id);
+        document_ratings_.push_back(ComputeAverageRating(document.ratings));
+        document_statuses_.push_back(document.status);
+        inverse_word_counts_.push_back(inverse_word_counts[i]);
+        word_frequencies_.push_back(move(word_frequencies[i]));
+        previous_ordinals_.push_back(last_ordinal_);
+        next_ordinals_.push_back(NO_ORDINAL);
+        if (last_ordinal_ == NO_ORDINAL) {
+            first_ordinal_ = ordinal;
+        } else {
+            next_ordinals_.Mutable(last_ordinal_) = ordinal;
+        }
+        last_ordinal_ = ordinal;
+        document_ranks_.Add(ordinal);
+    }
+    if (added_count > 0) {
+        log_document_count_ = log(GetDocumentCount());
+        // пакет учитывается как added_count изменений, но версия публикуется
+        // только после добавления всего пакета
+        unpublished_write_count_ += added_count - 1;
+        OnDocumentsChanged();
+    }
+}
+
+SearchServer::PartialIndex SearchServer::BuildPartialIndex(const vector<NewDocument>& documents, size_t first, size_t last,
+                                                           const vector<bool>& is_excluded, bool stop_at_rejected) const {
+    PartialIndex partial;
+    unordered_map<string_view, uint32_t> local_ids;
+    vector<uint32_t> document_local_ids;
+    for (size_t i = first; i < last; ++i) {
+        // отвергнутые и исключённые документы занимают пустые места, их слова не учитываются
+        if (is_excluded[i]) {
+            partial.word_counts.push_back(0);
+            partial.term_counts.emplace_back();
+            continue;
+        }
+        vector<string_view> words;
+        try {
+            if (documents[i].id < 0 || document_to_ordinal_.Contains(documents[i].id)) {
+                throw invalid_argument("invalid_argument"s);
+            }
+            words = SplitIntoWordsNoStop(documents[i].text);
+        } catch (const invalid_argument&) {
+            partial.rejected_documents.push_back(i);
+            if (stop_at_rejected) {
+                break;
+            }
+            partial.word_counts.push_back(0);
+            partial.term_counts.emplace_back();
+            continue;
+        }
+        document_local_ids.clear();
+        for (const string_view word : words) {
+            const auto [it, is_inserted] = local_ids.emplace(word, static_cast<uint32_t>(partial.words.size()));
+            if (is_inserted) {
+                partial.words.push_back(word);
+                partial.first_documents.push_back(i);
+            }
+            document_local_ids.push_back(it->second);
+        }
+        sort(document_local_ids.begin(), document_local_ids.end());
+        vector<pair<uint32_t, uint32_t>> term_counts;
+        for (auto it = document_local_ids.begin(); it != document_local_ids.end();) {
+            const auto next = upper_bound(it, document_local_ids.end(), *it);
+            term_counts.push_back({*it, static_cast<uint32_t>(next - it)});
+            it = next;
+        }
+        partial.word_counts.push_back(words.size());
+        partial.term_counts.push_back(move(term_counts));
+    }
+    return partial;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_->SetCapacity(capacity);
+}
+
+ResultCacheStats SearchServer::GetResultCacheStats() const {
+    return result_cache_->GetStats();
+}
+
+void SearchServer::SetExecutorThreadCount(size_t thread_count, vector<int> cpu_ids) {
+    executor_ = make_shared<TaskExecutor>(thread_count, move(cpu_ids));
+    index_.SetExecutor(executor_);
+}
+
+TaskExecutor& SearchServer::GetExecutor() const {
+    return *executor_;
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return static_cast<int>(document_to_ordinal_.size());
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
         
-    const Query query = ParseQuery(raw_query);
+    QueryArena::Lease arena;
+    const Query query = ParseQuery(raw_query, arena.GetResource());
 
     vector<string_view> matched_words;
+    const uint32_t ordinal = GetOrdinal(document_id);
+    const IndexSnapshot snapshot = index_.GetSnapshot(arena.GetResource());
 
     for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-            return {matched_words, documents_.at(document_id).status};
+        const optional<TermId> term_id = FindTermId(word);
+        if (term_id && ContainsTerm(snapshot, *term_id, ordinal)) {
+            return {matched_words, document_statuses_[ordinal]};
         }
     }
     
     for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-            matched_words.push_back(word_to_document_freqs_.find(word)->first);
+        const optional<TermId> term_id = FindTermId(word);
+        if (term_id && ContainsTerm(snapshot, *term_id, ordinal)) {
+            matched_words.push_back(term_words_[*term_id]);
         }
     }
 
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, document_statuses_[ordinal]};
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::sequenced_policy policy, const string_view raw_query, int document_id) const {
@@ -104,43 +937,83 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::parallel_policy policy, const string_view raw_query, int document_id) const {
 
-    Query query = ParseQuery(raw_query, true);
+    QueryArena::Lease arena;
+    Query query = ParseQuery(raw_query, arena.GetResource(), true);
 
     vector<string_view> matched_words(query.plus_words.size());
 
-    const auto word_checker = [this, document_id](const string_view word){
-        const auto it = word_to_document_freqs_.find(word);
-        return it != word_to_document_freqs_.end() && it->second.count(document_id);
+    const uint32_t ordinal = GetOrdinal(document_id);
+    const IndexSnapshot snapshot = index_.GetSnapshot(arena.GetResource());
+    const auto word_checker = [this, &snapshot, ordinal](const string_view word){
+        const optional<TermId> term_id = FindTermId(word);
+        return term_id && ContainsTerm(snapshot, *term_id, ordinal);
     };
 
-    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), word_checker)) {
+    atomic<bool> has_minus_word = false;
+    executor_->ParallelFor(query.minus_words.size(), [&](size_t i) {
+        if (!has_minus_word.load(memory_order_relaxed) && word_checker(query.minus_words[i])) {
+            has_minus_word.store(true, memory_order_relaxed);
+        }
+    });
+    if (has_minus_word) {
         matched_words.clear();
-        return {matched_words, documents_.at(document_id).status};
+        return {matched_words, document_statuses_[ordinal]};
     }
 
     atomic<int> index = 0;
 
-    for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](const string_view word)
+    executor_->ParallelFor(query.plus_words.size(), [&](size_t i)
     {
-        const auto it = word_frequencies_.at(document_id).find(word);
-        if (it != word_frequencies_.at(document_id).end()) {
-            matched_words.at(index++) = it->first;
+        const optional<TermId> term_id = FindTermId(query.plus_words[i]);
+        if (term_id && ContainsTerm(snapshot, *term_id, ordinal)) {
+            matched_words.at(index++) = term_words_[*term_id];
         }
     });
 
     matched_words.resize(index);
-    sort(policy, matched_words.begin(), matched_words.end());
-    auto words_end = unique(policy, matched_words.begin(), matched_words.end());
+    sort(matched_words.begin(), matched_words.end());
+    auto words_end = unique(matched_words.begin(), matched_words.end());
     matched_words.erase(words_end, matched_words.end());
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, document_statuses_[ordinal]};
 }
 
 int SearchServer::GetDocumentId(int index) const {
     if ((index < 0) || (index >= GetDocumentCount())) {
         throw out_of_range("out_of_range"s);
     }
-    return sequence_of_adding_id_[index];
+    return document_ids_[document_ranks_.Select(index)];
+}
+
+SearchServer::DocumentIdIterator::DocumentIdIterator(const SearchServer* server, uint32_t ordinal)
+    : server_(server)
+    , ordinal_(ordinal)
+{}
+
+SearchServer::DocumentIdIterator::reference SearchServer::DocumentIdIterator::operator*() const {
+    return server_->document_ids_[ordinal_];
+}
+
+SearchServer::DocumentIdIterator& SearchServer::DocumentIdIterator::operator++() {
+    ordinal_ = server_->next_ordinals_[ordinal_];
+    return *this;
+}
+
+SearchServer::DocumentIdIterator SearchServer::DocumentIdIterator::operator++(int) {
+    DocumentIdIterator result = *this;
+    ++*this;
+    return result;
+}
+
+SearchServer::DocumentIdIterator& SearchServer::DocumentIdIterator::operator--() {
+    ordinal_ = ordinal_ == NO_ORDINAL ? server_->last_ordinal_ : server_->previous_ordinals_[ordinal_];
+    return *this;
+}
+
+SearchServer::DocumentIdIterator SearchServer::DocumentIdIterator::operator--(int) {
+    DocumentIdIterator result = *this;
+    --*this;
+    return result;
 }
 
 bool SearchServer::IsValidWord(const string_view& word) {
@@ -150,21 +1023,25 @@ bool SearchServer::IsValidWord(const string_view& word) {
 }
 
 bool SearchServer::IsStopWord(const string_view& word) const {
-    return stop_words_.count(word) > 0;
+    return stop_word_filter_.Contains(word);
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view& text) const {
+vector<string_view> SearchServer::SplitIntoValidWords(const string_view& text) {
     vector<string_view> words;
-    for (const string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("invalid_argument"s);
-        } else if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+    if (!SplitIntoWords(text, words)) {
+        throw invalid_argument("invalid_argument"s);
     }
     return words;
 }
 
+vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view& text) const {
+    vector<string_view> words = SplitIntoValidWords(text);
+    words.erase(remove_if(words.begin(), words.end(), [this](const string_view word) {
+        return IsStopWord(word);
+    }), words.end());
+    return words;
+}
+
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
@@ -179,10 +1056,10 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
         is_minus = true;
         word = word.substr(1);
     }
-    // Проверка на отсутствие в поисковом запросе текста после символа «минус», 
-    // на отсутствие спецсимволов и на на указание в поисковом запросе 
-    // более чем одного минуса перед словами
-    if ((word.size() == 0) || (!IsValidWord(word)) || (word[0] == '-')) {
+    // Проверка на отсутствие в поисковом запросе текста после символа «минус» 
+    // и на указание в поисковом запросе более чем одного минуса перед словами.
+    // Спецсимволы проверяются при разбиении запроса на слова
+    if ((word.size() == 0) || (word[0] == '-')) {
         throw invalid_argument("invalid_argument"s);
     }
     return {
@@ -192,9 +1069,13 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
     };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const string_view raw_query, bool skip_sort) const {
-    Query query;
-    for (const string_view word : SplitIntoWords(raw_query)) {
+SearchServer::Query SearchServer::ParseQuery(const string_view raw_query, pmr::memory_resource* resource, bool skip_sort) const {
+    Query query(resource);
+    pmr::vector<string_view> words(resource);
+    if (!SplitIntoWords(raw_query, words)) {
+        throw invalid_argument("invalid_argument"s);
+    }
+    for (const string_view word : words) {
         const QueryWord query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -218,45 +1099,185 @@ SearchServer::Query SearchServer::ParseQuery(const string_view raw_query, bool s
     return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(string(word)).size());
+TermId SearchServer::InternTerm(const string_view& word) {
+    if (const TermId* term_id = term_ids_.Find(word)) {
+        return *term_id;
+    }
+    // слова образа хранятся не в terms_, поэтому номер берётся по term_words_
+    const TermId term_id = static_cast<TermId>(term_words_.size());
+    terms_.emplace_back(word);
+    term_words_.push_back(terms_.back());
+    term_ids_.Insert(terms_.back(), term_id);
+    document_freqs_.push_back(0);
+    log_document_freqs_.push_back(0.0);
+    term_bitmaps_.push_back({});
+    return term_id;
+}
+
+optional<TermId> SearchServer::FindTermId(const string_view& word) const {
+    const TermId* term_id = term_ids_.Find(word);
+    if (term_id == nullptr || document_freqs_[*term_id] == 0) {
+        return nullopt;
+    }
+    return *term_id;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return log_document_count_ - log_document_freqs_[term_id];
+}
+
+bool SearchServer::HasZeroInverseDocumentFreq(TermId term_id) const {
+    return document_freqs_[term_id] == static_cast<uint32_t>(GetDocumentCount());
+}
+
+void SearchServer::UpdateDocumentFreq(TermId term_id) {
+    const uint32_t document_freq = document_freqs_[term_id];
+    log_document_freqs_.Mutable(term_id) = document_freq == 0 ? 0.0 : log(document_freq);
 }
 
-vector<int>::const_iterator SearchServer::begin() const {
-    return sequence_of_adding_id_.begin();
+void SearchServer::UpdateTermBitmap(TermId term_id, uint32_t ordinal, bool is_added) {
+    // часть массива копируется, только если карта слова действительно меняется
+    const bool has_bitmap = static_cast<bool>(term_bitmaps_[term_id]);
+    const double dense_size = dense_term_share_ * GetDocumentCount();
+    if (!is_added) {
+        // карта удаляется с запасом, чтобы не перестраивать её на каждом изменении
+        if (has_bitmap && document_freqs_[term_id] < dense_size / 2) {
+            term_bitmaps_.Mutable(term_id).reset();
+        } else if (has_bitmap) {
+            term_bitmaps_.Mutable(term_id).Mutable().Remove(ordinal);
+        }
+    } else if (has_bitmap) {
+        term_bitmaps_.Mutable(term_id).Mutable().Add(ordinal);
+    } else if (document_freqs_[term_id] >= dense_size) {
+        term_bitmaps_.Mutable(term_id).emplace(BuildTermBitmap(term_id));
+    }
+}
+
+DocumentBitmap SearchServer::BuildTermBitmap(TermId term_id) const {
+    DocumentBitmap bitmap;
+    index_.GetSnapshot().ForEachPosting(term_id, [this, &bitmap](uint32_t ordinal, uint32_t) {
+        if (!index_.IsRemoved(ordinal)) {
+            bitmap.Add(ordinal);
+        }
+    });
+    return bitmap;
+}
+
+bool SearchServer::ContainsTerm(const IndexSnapshot& snapshot, TermId term_id, uint32_t ordinal) const {
+    if (term_bitmaps_[term_id]) {
+        return term_bitmaps_[term_id]->Contains(ordinal);
+    }
+    return snapshot.Contains(term_id, ordinal);
+}
+
+pmr::vector<TermId> SearchServer::FindMinusTermIds(const Query& query, pmr::memory_resource* resource) const {
+    pmr::vector<TermId> minus_term_ids(resource);
+    for (const string_view& word : query.minus_words) {
+        if (const optional<TermId> term_id = FindTermId(word)) {
+            minus_term_ids.push_back(*term_id);
+        }
+    }
+    return minus_term_ids;
+}
+
+void SearchServer::ExcludeMinusWords(const IndexSnapshot& snapshot, ScoreAccumulator& accumulator, const pmr::vector<TermId>& minus_term_ids, uint32_t first, uint32_t last) const {
+    for (const TermId term_id : minus_term_ids) {
+        if (term_bitmaps_[term_id]) {
+            accumulator.Exclude(*term_bitmaps_[term_id], first, last);
+        } else {
+            snapshot.ForEachPostingInRange(term_id, first, last, [&accumulator](uint32_t ordinal, uint32_t) {
+                accumulator.Exclude(ordinal);
+            });
+        }
+    }
+}
+
+void SearchServer::ExcludeRemovedDocuments(ScoreAccumulator& accumulator, uint32_t first, uint32_t last) const {
+    const DocumentBitmap& removed = index_.GetRemovedDocuments();
+    if (removed.empty()) {
+        return;
+    }
+    // редкие удалённые документы исключаются по одному, частые - словами битовой карты
+    if (removed.size() * 64 < last - first) {
+        removed.ForEach([&accumulator, first, last](uint32_t ordinal) {
+            if (ordinal >= first && ordinal < last) {
+                accumulator.Exclude(ordinal);
+            }
+        });
+    } else {
+        accumulator.Exclude(removed, first, last);
+    }
+}
+
+SearchServer::DocumentIdIterator SearchServer::begin() const {
+    return DocumentIdIterator(this, first_ordinal_);
 }
 
-vector<int>::const_iterator SearchServer::end() const {
-    return sequence_of_adding_id_.end();
+SearchServer::DocumentIdIterator SearchServer::end() const {
+    return DocumentIdIterator(this, NO_ORDINAL);
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
     static const map<string_view, double> empty_map = {};
-    if (!word_frequencies_.count(document_id)) {
+    const uint32_t* ordinal = document_to_ordinal_.Find(document_id);
+    if (ordinal == nullptr) {
         return empty_map;
-    } else {
-        return word_frequencies_.at(document_id);
+    } else if (word_frequencies_[*ordinal]) {
+        return *word_frequencies_[*ordinal];
+    }
+    atomic<const map<string_view, double>*>& slot = mapped_word_frequencies_->maps[*ordinal];
+    if (const map<string_view, double>* word_freqs = slot.load(memory_order_acquire)) {
+        return *word_freqs;
     }
+    // словарь может одновременно построить другой поток; остаётся опубликованный первым
+    auto word_freqs = make_unique<map<string_view, double>>();
+    ForEachDocumentWord(*ordinal, [this, &word_freqs](TermId term_id, double freq) {
+        word_freqs->emplace_hint(word_freqs->end(), term_words_[term_id], freq);
+    });
+    const map<string_view, double>* published = nullptr;
+    if (slot.compare_exchange_strong(published, word_freqs.get(), memory_order_acq_rel, memory_order_acquire)) {
+        return *word_freqs.release();
+    }
+    return *published;
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-    if (documents_.count(document_id) == 0) {
-        return;
+uint32_t SearchServer::GetOrdinal(int document_id) const {
+    const uint32_t* ordinal = document_to_ordinal_.Find(document_id);
+    if (ordinal == nullptr) {
+        throw out_of_range("out_of_range"s);
     }
+    return *ordinal;
+}
 
-    for (auto it = word_frequencies_.at(document_id).begin(); it != word_frequencies_.at(document_id).end(); ++it) {
-        if (word_to_document_freqs_.count(it->first)) {
-            if (word_to_document_freqs_.at(string(it->first)).size() == 1) {
-                word_to_document_freqs_.erase(string(it->first));
-            } else if (word_to_document_freqs_.at(string(it->first)).size() > 1) {
-                word_to_document_freqs_.at(string(it->first)).erase(document_id);
-            }
+template <typename Callback>
+void SearchServer::ForEachDocumentWord(uint32_t ordinal, Callback callback) const {
+    if (ordinal < mapped_document_count_) {
+        for (uint64_t i = mapped_word_offsets_[ordinal]; i < mapped_word_offsets_[ordinal + 1]; ++i) {
+            callback(mapped_words_[i].term_id, mapped_words_[i].freq);
         }
+        return;
     }
+    for (const auto& [word, freq] : *word_frequencies_[ordinal]) {
+        callback(*term_ids_.Find(word), freq);
+    }
+}
 
-    documents_.erase(document_id);
-    word_frequencies_.erase(document_id);
-    sequence_of_adding_id_.erase(find(sequence_of_adding_id_.begin(), sequence_of_adding_id_.end(), document_id));
+void SearchServer::RemoveDocument(int document_id) {
+    if (!document_to_ordinal_.Contains(document_id)) {
+        return;
+    }
+
+    const uint32_t ordinal = GetOrdinal(document_id);
+    // вхождения документа остаются в сегментах до сжатия,
+    // а количество документов со словом нужно для IDF сразу
+    ForEachDocumentWord(ordinal, [this, ordinal](TermId term_id, double) {
+        --document_freqs_.Mutable(term_id);
+        UpdateDocumentFreq(term_id);
+        UpdateTermBitmap(term_id, ordinal, false);
+    });
+    index_.RemoveDocument(ordinal);
+    UnlinkDocument(document_id, ordinal);
+    OnDocumentsRemoved();
 }
 
 void SearchServer::RemoveDocument(execution::sequenced_policy policy, int document_id) {
@@ -264,25 +1285,154 @@ void SearchServer::RemoveDocument(execution::sequenced_policy policy, int docume
 }
 
 void SearchServer::RemoveDocument(execution::parallel_policy policy, int document_id) {
-    if (documents_.count(document_id) == 0) {
+    if (!document_to_ordinal_.Contains(document_id)) {
         return;
     }
 
-    vector<string_view> words_to_remove(word_frequencies_.at(document_id).size());
- 
-    transform(policy, word_frequencies_.at(document_id).begin(), word_frequencies_.at(document_id).end(), words_to_remove.begin(),
-        [](const auto& i) {
-            return (i.first);
+    const uint32_t ordinal = GetOrdinal(document_id);
+    vector<TermId> terms_to_remove;
+    ForEachDocumentWord(ordinal, [&terms_to_remove](TermId term_id, double) {
+        terms_to_remove.push_back(term_id);
+    });
+
+    // части массивов, разделяемые с опубликованными версиями, копируются
+    // до параллельного обхода: копирование не потокобезопасно
+    for (const TermId term_id : terms_to_remove) {
+        document_freqs_.Mutable(term_id);
+        log_document_freqs_.Mutable(term_id);
+        term_bitmaps_.Mutable(term_id);
+    }
+    executor_->ParallelFor(terms_to_remove.size(), [&](size_t i){
+        const TermId term_id = terms_to_remove[i];
+        --document_freqs_.Mutable(term_id);
+        UpdateDocumentFreq(term_id);
+        UpdateTermBitmap(term_id, ordinal, false);
+    });
+    index_.RemoveDocument(ordinal);
+    UnlinkDocument(document_id, ordinal);
+    OnDocumentsRemoved();
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocumentsImpl(execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(execution::sequenced_policy policy, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
+}
+
+void SearchServer::RemoveDocuments(execution::parallel_policy policy, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocumentsImpl(ExecutionPolicy policy, const vector<int>& document_ids) {
+    // вхождения удаляемых документов: (слово, порядковый номер документа)
+    vector<pair<TermId, uint32_t>> postings;
+    vector<uint32_t> ordinals;
+    // идентификаторы слов плотные, поэтому вхождения группируются по словам
+    // подсчётом, без сортировки. Позиция слова в touched_term_ids, начиная с 1
+    vector<uint32_t> term_positions(term_words_.size(), 0);
+    vector<TermId> touched_term_ids;
+    vector<size_t> term_ends;
+    for (const int document_id : document_ids) {
+        const uint32_t* ordinal = document_to_ordinal_.Find(document_id);
+        if (ordinal == nullptr) {
+            continue;
+        }
+        ForEachDocumentWord(*ordinal, [&](TermId term_id, double) {
+            if (term_positions[term_id] == 0) {
+                touched_term_ids.push_back(term_id);
+                term_ends.push_back(0);
+                term_positions[term_id] = touched_term_ids.size();
+            }
+            ++term_ends[term_positions[term_id] - 1];
+            postings.push_back({term_id, *ordinal});
         });
+        ordinals.push_back(*ordinal);
+        // повторный id в списке уже не будет найден
+        UnlinkDocument(document_id, *ordinal);
+    }
+    if (ordinals.empty()) {
+        return;
+    }
+    index_.RemoveDocuments(ordinals);
 
-    for_each(policy, words_to_remove.begin(), words_to_remove.end(), [&](string_view word){
-        if (word_to_document_freqs_.count(word)) {
-            word_to_document_freqs_.at(string(word)).erase(document_id);
+    // порядковые номера документов, сгруппированные по словам:
+    // слову touched_term_ids[i] соответствует [term_ends[i - 1], term_ends[i])
+    partial_sum(term_ends.begin(), term_ends.end(), term_ends.begin());
+    vector<size_t> term_fill = term_ends;
+    vector<uint32_t> term_ordinals(postings.size());
+    for (auto it = postings.rbegin(); it != postings.rend(); ++it) {
+        term_ordinals[--term_fill[term_positions[it->first] - 1]] = it->second;
+    }
+
+    // части массивов, разделяемые с опубликованными версиями, копируются
+    // до параллельного обхода: копирование не потокобезопасно
+    for (const TermId term_id : touched_term_ids) {
+        document_freqs_.Mutable(term_id);
+        log_document_freqs_.Mutable(term_id);
+        term_bitmaps_.Mutable(term_id);
+    }
+
+    const double dense_size = dense_term_share_ * GetDocumentCount();
+    ForEachIndex(policy, touched_term_ids.size(), [&](size_t position) {
+        const TermId term_id = touched_term_ids[position];
+        const size_t start = position == 0 ? 0 : term_ends[position - 1];
+        const size_t end = term_ends[position];
+        document_freqs_.Mutable(term_id) -= static_cast<uint32_t>(end - start);
+        UpdateDocumentFreq(term_id);
+        if (!term_bitmaps_[term_id]) {
+            return;
         }
+        // карта удаляется с запасом, как и при удалении одного документа
+        if (document_freqs_[term_id] == 0 || document_freqs_[term_id] < dense_size / 2) {
+            term_bitmaps_.Mutable(term_id).reset();
+            return;
+        }
+        sort(term_ordinals.begin() + start, term_ordinals.begin() + end);
+        term_bitmaps_.Mutable(term_id).Mutable().RemoveSorted(term_ordinals.data() + start, term_ordinals.data() + end);
     });
-    
-    documents_.erase(document_id);
-    word_frequencies_.erase(document_id);
-    sequence_of_adding_id_.erase(find(sequence_of_adding_id_.begin(), sequence_of_adding_id_.end(), document_id));
+    OnDocumentsRemoved();
+}
+
+void SearchServer::UnlinkDocument(int document_id, uint32_t ordinal) {
+    document_to_ordinal_.Erase(document_id);
+    status_bitmaps_[static_cast<size_t>(document_statuses_[ordinal])].Mutable().Remove(ordinal);
+    word_frequencies_.Mutable(ordinal).reset();
+    document_ranks_.Remove(ordinal);
+
+    const uint32_t previous_ordinal = previous_ordinals_[ordinal];
+    const uint32_t next_ordinal = next_ordinals_[ordinal];
+    if (previous_ordinal == NO_ORDINAL) {
+        first_ordinal_ = next_ordinal;
+    } else {
+        next_ordinals_.Mutable(previous_ordinal) = next_ordinal;
+    }
+    if (next_ordinal == NO_ORDINAL) {
+        last_ordinal_ = previous_ordinal;
+    } else {
+        previous_ordinals_.Mutable(next_ordinal) = previous_ordinal;
+    }
+}
+
+void SearchServer::OnDocumentsRemoved() {
+    log_document_count_ = GetDocumentCount() == 0 ? 0.0 : log(GetDocumentCount());
+    const size_t removed_count = GetRemovedDocumentCount();
+    if (removed_count >= compaction_threshold_ * (GetDocumentCount() + removed_count)) {
+        Compact();
+    }
+    OnDocumentsChanged();
+}
+
+void SearchServer::Compact() {
+    index_.Compact();
+}
+
+void SearchServer::SetCompactionThreshold(double removed_share) {
+    compaction_threshold_ = removed_share;
+}
 
+size_t SearchServer::GetRemovedDocumentCount() const {
+    return index_.GetRemovedDocuments().size();
 }
\ No newline at end of file
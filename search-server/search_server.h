@@ -7,42 +7,222 @@
 #include <numeric>
 #include <execution>
 #include <string_view>
-#include <future>
 #include <atomic>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <limits>
+#include <thread>
+#include <array>
+#include <type_traits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 
 #include "log_duration.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "copy_on_write.h"
+#include "document_bitmap.h"
+#include "ordinal_ranks.h"
+#include "epoch_manager.h"
+#include "score_accumulator.h"
+#include "segmented_index.h"
+#include "index_image.h"
+#include "query_arena.h"
+#include "stop_word_filter.h"
+#include "result_cache.h"
+#include "task_executor.h"
 
 const double MAXIMUM_MEASUREMENT_ERROR = 1e-6;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+// Доля документов, начиная с которой для слова строится битовая карта документов
+const double DEFAULT_DENSE_TERM_SHARE = 1.0 / 16;
+// Доля удалённых документов среди проиндексированных, при которой индекс сжимается
+const double DEFAULT_COMPACTION_THRESHOLD = 0.25;
+
+// Политики поиска в дополнение к std::execution
+namespace search_policy {
+    // Поиск с динамическим отсечением по верхним оценкам блоков (Block-Max):
+    // документы обходятся окнами порядковых номеров, и окно, в котором по оценкам
+    // блоков слов ни один документ не попадёт в max_result_count лучших,
+    // пропускается без распаковки. В остальных окнах релевантность набирается
+    // по словам в небольшом массиве окна, что быстрее полного перебора и на
+    // длинных запросах, когда отсекать почти нечего
+    struct block_max_wand_policy {};
+    inline constexpr block_max_wand_policy block_max_wand;
+}
+
+// Какие документы находит запрос: содержащие хотя бы одно плюс-слово
+// или все плюс-слова запроса
+enum class QueryMode {
+    ANY_WORD,
+    ALL_WORDS,
+};
+
+// Фильтр документов с именем, под которым результаты поиска с ним кешируются.
+// Фильтры с одинаковым именем должны отбирать одни и те же документы
+template <typename KeyMapper>
+struct CacheTaggedKeyMapper {
+    string tag;
+    KeyMapper key_mapper;
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const {
+        return key_mapper(document_id, status, rating);
+    }
+};
+
+template <typename KeyMapper>
+CacheTaggedKeyMapper<KeyMapper> WithCacheTag(string tag, KeyMapper key_mapper) {
+    return {move(tag), move(key_mapper)};
+}
+
+// Документ для пакетного добавления. Текст должен жить до конца вызова AddDocuments
+struct NewDocument {
+    int id = 0;
+    string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+};
 
 class SearchServer {
 public:
+    // Число частей, на которые делится диапазон документов при параллельном поиске,
+    // и наименьший размер части
+    static constexpr uint32_t PARTITION_COUNT = 64;
+    static constexpr uint32_t MIN_PARTITION_SIZE = 1024;
+    // Число частей пакета документов, разбираемых параллельно, и наименьший размер части
+    static constexpr size_t INGEST_SLICE_COUNT = 64;
+    static constexpr size_t MIN_INGEST_SLICE_SIZE = 128;
+    // Окно порядковых номеров, по которому search_policy::block_max_wand
+    // отсекает документы и набирает релевантность; кратно 64
+    static constexpr uint32_t BLOCK_MAX_WINDOW_SIZE = 1024;
+    // Пакетный поиск: число запросов группы и наименьшее среднее число запросов
+    // группы на слово, при котором слова группы обходятся один раз
+    static constexpr size_t BATCH_GROUP_SIZE = 64;
+    static constexpr double MIN_BATCH_TERM_SHARING = 1.5;
+    // Окно порядковых номеров, в котором слово группы раздаёт вклады накопителям
+    // запросов; кратно 64. Накопители окна для всей группы помещаются в кеш L2
+    static constexpr uint32_t BATCH_SCATTER_WINDOW_SIZE = 512;
 
     template<typename StringCollection>
     explicit SearchServer(const StringCollection& stop_words);
     explicit SearchServer(const string_view& stop_words);
     explicit SearchServer(const string& stop_words);
+    // Сервер над образом индекса, открытым IndexImage::Open(path, POSTING_FORMAT).
+    // Списки вхождений и строки словаря не копируются, а читаются из отображённого
+    // в память файла; копируются только столбцы данных документов. Сервер можно
+    // изменять, изменённые списки вхождений копируются. Битовые карты частых слов
+    // в образе не хранятся и строятся по мере изменений или в SetDenseTermShare
+    explicit SearchServer(shared_ptr<const IndexImage> image);
+    ~SearchServer();
+
+    // В отличие от первых версий сервер не копируется и не перемещается: опубликованные
+    // версии и снимки ссылаются на него, а слияние сегментов выполняется задачей
+    // пула, которая ссылается на индекс сервера. Независимую копию индекса даёт
+    // SaveImage с последующим открытием образа
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+
+    // Сохраняет образ индекса: стоп-слова, словарь, данные документов в порядке
+    // добавления и списки вхождений без удалённых документов. Документы в образе
+    // нумеруются заново, поэтому образ не зависит от удалений и сегментов.
+    // Можно вызывать у снимка, пока сервер изменяется
+    void SaveImage(const string& path) const;
+
+    // Неизменяемое состояние сервера для чтения из других потоков, пока этот
+    // сервер изменяется. Версия состояния не освобождается, пока есть её снимки.
+    // Снимок должен быть уничтожен раньше сервера
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot&& other) noexcept;
+        ~Snapshot();
+
+        const SearchServer& operator*() const {
+            return *server_;
+        }
+
+        const SearchServer* operator->() const {
+            return server_;
+        }
+
+        // Номер опубликованной версии, растёт с каждой публикацией
+        uint64_t GetVersion() const;
+
+    private:
+        friend class SearchServer;
+
+        Snapshot(const EpochManager* epochs, size_t slot, const SearchServer* server);
+
+        const EpochManager* epochs_;
+        size_t slot_;
+        const SearchServer* server_;
+    };
+
+    // Последняя опубликованная версия. Можно вызывать из любого потока одновременно
+    // с изменением сервера; снимок не блокирует ни читателей, ни писателя
+    Snapshot GetSnapshot() const;
+
+    // Публикует текущее состояние. Новая версия разделяет с предыдущими неизменённые
+    // части индекса, заменённые версии освобождаются, когда их перестают читать
+    void PublishSnapshot();
+
+    // Публиковать состояние после каждых write_count изменений документов; 0 - только
+    // явным вызовом PublishSnapshot
+    void SetSnapshotPublishInterval(size_t write_count);
 
     void SetStopWords(const string_view& text);
+
+    // Слова, которые встречаются не менее чем в share всех документов, дополнительно
+    // хранят битовую карту документов. Битовые карты перестраиваются для всех слов
+    void SetDenseTermShare(double share);
     
     void AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings);
 
+    // Добавляет документы пакета по порядку; индекс получается тем же, что и при
+    // вызовах AddDocument. Если документ отвергается, документы до него остаются
+    // добавленными и выбрасывается invalid_argument. Параллельная версия разбирает
+    // части пакета в отдельные частичные индексы и сливает их пословно
+    void AddDocuments(const vector<NewDocument>& documents);
+    void AddDocuments(execution::sequenced_policy, const vector<NewDocument>& documents);
+    void AddDocuments(execution::parallel_policy, const vector<NewDocument>& documents);
+    // Добавляет все документы пакета, которые принял бы AddDocument, и записывает
+    // номера остальных в rejected по возрастанию вместо исключения. Пакет
+    // разбирается один раз, сколько бы документов ни было отвергнуто
+    void AddDocuments(execution::parallel_policy, const vector<NewDocument>& documents, vector<size_t>& rejected);
+
+    // max_result_count - сколько лучших документов вернуть,
+    // mode - нужны ли документы со всеми плюс-словами запроса
     template <typename KeyMapper>
-    vector<Document> FindTopDocuments(const string_view& raw_query, KeyMapper key_mapper) const;
-    vector<Document> FindTopDocuments(const string_view& raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(const string_view& raw_query, KeyMapper key_mapper, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
+    vector<Document> FindTopDocuments(const string_view& raw_query, DocumentStatus status, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
     vector<Document> FindTopDocuments(const string_view& raw_query) const;
 
     template <typename KeyMapper>
-    vector<Document> FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, KeyMapper key_mapper) const;
-    vector<Document> FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
+    vector<Document> FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
     vector<Document> FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query) const;
 
     template <typename KeyMapper>
-    vector<Document> FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, KeyMapper key_mapper) const;
-    vector<Document> FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
+    vector<Document> FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
     vector<Document> FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query) const;
+
+    template <typename KeyMapper>
+    vector<Document> FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    vector<Document> FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query, DocumentStatus status, int max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    vector<Document> FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query) const;
+
+    // Поиск по пакету запросов: результат i совпадает с FindTopDocuments(queries[i], status,
+    // max_result_count, mode). Запросы, одинаковые после разбора, выполняются один раз.
+    // Остальные делятся на группы, группы выполняются параллельно. Список вхождений
+    // каждого слова группы обходится один раз, и вклад документа добавляется в
+    // накопители всех запросов группы с этим словом. В группах с малой долей общих
+    // слов и в режиме ALL_WORDS запросы выполняются по одному
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<string>& queries, DocumentStatus status = DocumentStatus::ACTUAL, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
+    // То же для запросов [first, last) пакета
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<string>& queries, size_t first, size_t last, DocumentStatus status = DocumentStatus::ACTUAL, int max_result_count = MAX_RESULT_DOCUMENT_COUNT, QueryMode mode = QueryMode::ANY_WORD) const;
     
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const string_view raw_query, int document_id) const;
     tuple<vector<string_view>, DocumentStatus> MatchDocument(execution::sequenced_policy, const string_view raw_query, int document_id) const;
@@ -52,26 +232,105 @@ public:
     void RemoveDocument(execution::sequenced_policy, int document_id);
     void RemoveDocument(execution::parallel_policy, int document_id);
 
+    // Удаляет несколько документов за один проход по их словам: вхождения
+    // группируются по словам, и каждое слово обновляется один раз. Отсутствующие
+    // id пропускаются. Параллельная версия обновляет слова параллельно
+    void RemoveDocuments(const vector<int>& document_ids);
+    void RemoveDocuments(execution::sequenced_policy, const vector<int>& document_ids);
+    void RemoveDocuments(execution::parallel_policy, const vector<int>& document_ids);
+
     int GetDocumentCount() const;
 
+    // Кеш результатов FindTopDocuments на capacity запросов; 0 - кеш выключен (по умолчанию).
+    // Ключ - плюс- и минус-слова запроса без стоп-слов и повторов, фильтр, число
+    // документов, режим и способ поиска. Кешируются только поиски с фильтром по
+    // статусу или с именованным фильтром WithCacheTag. Изменение документов и
+    // стоп-слов делает записи недействительными. Кеш общий у сервера и его снимков
+    void SetResultCacheCapacity(size_t capacity);
+    ResultCacheStats GetResultCacheStats() const;
+
+    // Пул потоков для перегрузок с execution::par, пакетного поиска и слияния сегментов: thread_count
+    // рабочих потоков (по умолчанию на один меньше числа процессоров), закреплённых
+    // по кругу за процессорами cpu_ids. Вложенные параллельные вызовы выполняются
+    // тем же пулом. Пул общий у сервера и его снимков, ранее полученные снимки
+    // продолжают использовать прежний пул
+    void SetExecutorThreadCount(size_t thread_count, vector<int> cpu_ids = {});
+    TaskExecutor& GetExecutor() const;
+
+    // Количество документов в буфере записи, после которого он становится
+    // неизменяемым сегментом индекса
+    void SetWriteBufferSize(size_t document_count);
+
+    // Количество неизменяемых сегментов индекса
+    size_t GetSegmentCount() const;
+
+    // Ожидает завершения фонового слияния сегментов. Слияния выполняются задачами
+    // пула GetExecutor(); если в пуле нет рабочих потоков, здесь же
+    void WaitForSegmentMerges() const;
+
+    // Удалённый документ сразу исчезает из выдачи и обхода, но его вхождения
+    // остаются в сегментах до сжатия. Compact переписывает сегменты без удалённых
+    // документов; сжатие выполняется и само, когда доля удалённых документов
+    // достигает порога
+    void Compact();
+    void SetCompactionThreshold(double removed_share);
+
+    // Количество удалённых документов, ожидающих сжатия
+    size_t GetRemovedDocumentCount() const;
+
+    // Обходит id документов в порядке добавления
+    class DocumentIdIterator {
+    public:
+        using iterator_category = bidirectional_iterator_tag;
+        using value_type = int;
+        using difference_type = ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        reference operator*() const;
+
+        DocumentIdIterator& operator++();
+        DocumentIdIterator operator++(int);
+        DocumentIdIterator& operator--();
+        DocumentIdIterator operator--(int);
+
+        bool operator==(const DocumentIdIterator& other) const {
+            return ordinal_ == other.ordinal_;
+        }
+
+        bool operator!=(const DocumentIdIterator& other) const {
+            return ordinal_ != other.ordinal_;
+        }
+
+    private:
+        friend class SearchServer;
+
+        DocumentIdIterator(const SearchServer* server, uint32_t ordinal);
+
+        const SearchServer* server_;
+        uint32_t ordinal_;
+    };
+
+    // Документ с номером index в порядке добавления, за O(log N)
     int GetDocumentId(int index) const;
 
-    vector<int>::const_iterator begin() const;
+    DocumentIdIterator begin() const;
 
-    vector<int>::const_iterator end() const;
+    DocumentIdIterator end() const;
 
     const map<string_view, double>& GetWordFrequencies(int document_id) const;
 
 private:
 
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
-
+    // Слова запроса размещаются в памяти запроса
     struct Query {
-        vector<string_view> plus_words;
-        vector<string_view> minus_words;
+        explicit Query(pmr::memory_resource* resource)
+            : plus_words(resource)
+            , minus_words(resource)
+        {}
+
+        pmr::vector<string_view> plus_words;
+        pmr::vector<string_view> minus_words;
     };
     
     struct QueryWord {
@@ -80,16 +339,142 @@ private:
         bool is_stop;
     };
 
+    // Фильтр по статусу документа: вместо проверки каждого документа
+    // применяется битовая карта документов со статусом
+    struct DocumentStatusPredicate {
+        DocumentStatus status;
+
+        bool operator()(int document_id, DocumentStatus document_status, int rating) const {
+            return document_status == status;
+        }
+    };
+
+    struct SnapshotTag {};
+
+    // Способ поиска в ключе кеша: при равной релевантности и рейтинге
+    // разные способы могут отобрать разные документы
+    enum class SearchMethod : char {
+        SEQUENTIAL = 's',
+        PARALLEL = 'p',
+        BLOCK_MAX_WAND = 'w',
+    };
+
+    template <typename KeyMapper>
+    struct IsCacheTagged : false_type {};
+    template <typename KeyMapper>
+    struct IsCacheTagged<CacheTaggedKeyMapper<KeyMapper>> : true_type {};
+
+    // Слово документа в образе индекса
+    struct ImageDocumentWord {
+        TermId term_id;
+        uint32_t padding;
+        double freq;
+    };
+
+    // Частоты слов документов образа строятся при первом запросе и разделяются
+    // всеми версиями сервера. Построенный словарь документа публикуется в его
+    // ячейке сравнением с обменом, поэтому чтение не блокирует другие версии
+    struct MappedWordFrequencies {
+        explicit MappedWordFrequencies(size_t document_count);
+        ~MappedWordFrequencies();
+
+        MappedWordFrequencies(const MappedWordFrequencies&) = delete;
+        MappedWordFrequencies& operator=(const MappedWordFrequencies&) = delete;
+
+        vector<atomic<const map<string_view, double>*>> maps;
+    };
+
+    // Разобранная часть пакета документов с собственной нумерацией слов
+    struct PartialIndex {
+        // слова в порядке первого вхождения и номер документа пакета с первым вхождением
+        vector<string_view> words;
+        vector<size_t> first_documents;
+        // для каждого документа: число слов без стоп-слов и пары
+        // (локальный номер слова, количество вхождений)
+        vector<size_t> word_counts;
+        vector<vector<pair<uint32_t, uint32_t>>> term_counts;
+        // номера документов пакета, которые отверг бы AddDocument, по возрастанию
+        vector<size_t> rejected_documents;
+    };
+
+    struct RetiredSnapshot {
+        // эпоха, в которую версия была заменена
+        uint64_t epoch;
+        unique_ptr<const SearchServer> server;
+    };
+
+    // Копия состояния other для публикации; части индекса разделяются с other
+    SearchServer(const SearchServer& other, SnapshotTag);
+
+    // Части состояния хранятся в структурах, копия которых разделяет данные
+    // с оригиналом, поэтому публикация версии не копирует весь индекс
     set<string, less<>> stop_words_;
-    map<string, map<int, double>, less<>> word_to_document_freqs_;
-    map<int, DocumentData> documents_;
-    vector<int> sequence_of_adding_id_;
-    map<int, map<string_view, double>> word_frequencies_;
+    // стоп-слова для проверки слов документов и запросов, пересобираются при изменении stop_words_
+    StopWordFilter stop_word_filter_;
+    // растёт при каждом изменении документов и стоп-слов; записи кеша результатов
+    // действительны только для своей эпохи
+    uint64_t index_epoch_ = 0;
+    shared_ptr<ResultCache> result_cache_ = make_shared<ResultCache>();
+    shared_ptr<TaskExecutor> executor_ = make_shared<TaskExecutor>();
+    // словарь: слово -> идентификатор слова; количество документов со словом.
+    // Строки слов хранятся в terms_ и не перемещаются, версии ссылаются на них
+    deque<string> terms_;
+    ChunkedVector<string_view> term_words_;
+    CopyOnWriteHashMap<string_view, TermId> term_ids_;
+    ChunkedVector<uint32_t> document_freqs_;
+    // IDF = log(N) - log(df). log(df) хранится для каждого слова и пересчитывается
+    // только для слов изменённого документа, log(N) - при изменении числа документов
+    double log_document_count_ = 0.0;
+    ChunkedVector<double> log_document_freqs_;
+    // битовые карты документов для частых слов и для каждого статуса
+    double dense_term_share_ = DEFAULT_DENSE_TERM_SHARE;
+    ChunkedVector<CopyOnWrite<DocumentBitmap>> term_bitmaps_;
+    array<CopyOnWrite<DocumentBitmap>, 4> status_bitmaps_;
+    // id документа -> порядковый номер документа
+    CopyOnWriteHashMap<int, uint32_t> document_to_ordinal_;
+    // данные документов хранятся по столбцам, индекс - порядковый номер документа
+    ChunkedVector<int> document_ids_;
+    ChunkedVector<int> document_ratings_;
+    ChunkedVector<DocumentStatus> document_statuses_;
+    ChunkedVector<double> inverse_word_counts_;
+    ChunkedVector<shared_ptr<const map<string_view, double>>> word_frequencies_;
+    // первые mapped_document_count_ документов прочитаны из образа: их слова -
+    // mapped_words_[mapped_word_offsets_[ordinal], mapped_word_offsets_[ordinal + 1])
+    // в порядке строк слов, а word_frequencies_ для них пусты
+    shared_ptr<const IndexImage> image_;
+    uint32_t mapped_document_count_ = 0;
+    MappedVector<uint64_t> mapped_word_offsets_;
+    MappedVector<ImageDocumentWord> mapped_words_;
+    shared_ptr<MappedWordFrequencies> mapped_word_frequencies_;
+    // порядок добавления - двусвязный список порядковых номеров документов,
+    // поэтому документ удаляется из него за O(1)
+    static constexpr uint32_t NO_ORDINAL = numeric_limits<uint32_t>::max();
+    ChunkedVector<uint32_t> previous_ordinals_;
+    ChunkedVector<uint32_t> next_ordinals_;
+    uint32_t first_ordinal_ = NO_ORDINAL;
+    uint32_t last_ordinal_ = NO_ORDINAL;
+    // номера живых документов по возрастанию, они же в порядке добавления:
+    // GetDocumentId находит документ по рангу за O(log n)
+    OrdinalRanks document_ranks_;
+    double compaction_threshold_ = DEFAULT_COMPACTION_THRESHOLD;
+    // списки вхождений слов, разбитые на сегменты; слияния выполняются в пуле executor_
+    SegmentedIndex index_{executor_};
+
+    // Публикация версий. У опубликованной версии последняя версия - она сама
+    EpochManager epochs_;
+    atomic<const SearchServer*> published_snapshot_ = nullptr;
+    vector<RetiredSnapshot> retired_snapshots_;
+    uint64_t snapshot_version_ = 0;
+    size_t snapshot_publish_interval_ = 0;
+    size_t unpublished_write_count_ = 0;
 
     template<typename StringCollection>
     void InsertCorrectStopWords(const StringCollection& stop_words);
     
     static bool IsValidWord(const string_view& word);
+
+    // Слова текста; при управляющих символах в тексте выбрасывает invalid_argument
+    static vector<string_view> SplitIntoValidWords(const string_view& text);
     
     bool IsStopWord(const string_view& word) const;
     
@@ -100,79 +485,220 @@ private:
     QueryWord ParseQueryWord(string_view word) const;
     
     
-    Query ParseQuery(const string_view raw_query, bool skip_sort = false) const;
+    Query ParseQuery(const string_view raw_query, pmr::memory_resource* resource, bool skip_sort = false) const;
     
-    double ComputeWordInverseDocumentFreq(const string_view& word) const;
+    TermId InternTerm(const string_view& word);
+
+    // Разбирает документы [first, last) пакета, пропуская исключённые. На отвергнутом
+    // документе останавливается, если stop_at_rejected, иначе пропускает его
+    PartialIndex BuildPartialIndex(const vector<NewDocument>& documents, size_t first, size_t last,
+                                   const vector<bool>& is_excluded, bool stop_at_rejected) const;
+
+    // Добавляет пакет параллельно. Номера отвергнутых документов дописываются
+    // в rejected; без skip_rejected добавляются только документы до первого из них
+    void AddDocumentBatch(const vector<NewDocument>& documents, bool skip_rejected, vector<size_t>& rejected);
+
+    // Порядковый номер документа; out_of_range, если документа нет
+    uint32_t GetOrdinal(int document_id) const;
+
+    // Вызывает callback(term_id, частота слова) для слов документа в порядке их строк
+    template <typename Callback>
+    void ForEachDocumentWord(uint32_t ordinal, Callback callback) const;
+
+    // Убирает документ из порядка добавления, словаря id и карты статуса.
+    // Отметку удаления в индексе ставит вызывающий
+    void UnlinkDocument(int document_id, uint32_t ordinal);
+
+    // Пересчитывает log(N) после удаления документов и сжимает индекс,
+    // если удалённых документов стало больше порога
+    void OnDocumentsRemoved();
+
+    template <typename ExecutionPolicy>
+    void RemoveDocumentsImpl(ExecutionPolicy policy, const vector<int>& document_ids);
+
+    // Вызывает function(i) для i из [0, count): по порядку или на пуле потоков сервера
+    template <typename Function>
+    void ForEachIndex(execution::sequenced_policy, size_t count, Function function) const;
+    template <typename Function>
+    void ForEachIndex(execution::parallel_policy, size_t count, Function function) const;
+
+    // Возвращает идентификатор слова, если оно встречается хотя бы в одном документе
+    optional<TermId> FindTermId(const string_view& word) const;
 
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+
+    // Слово есть во всех документах: его IDF равна нулю
+    bool HasZeroInverseDocumentFreq(TermId term_id) const;
+
+    void UpdateDocumentFreq(TermId term_id);
+
+    // Учитывает изменение документов для публикации по SetSnapshotPublishInterval
+    void OnDocumentsChanged();
+
+    // Освобождает заменённые версии, которые больше никто не читает
+    void ReclaimSnapshots();
+
+    // Строит или удаляет битовую карту слова после добавления или удаления документа
+    void UpdateTermBitmap(TermId term_id, uint32_t ordinal, bool is_added);
+
+    // Битовая карта документов со словом, без удалённых
+    DocumentBitmap BuildTermBitmap(TermId term_id) const;
+
+    bool ContainsTerm(const IndexSnapshot& snapshot, TermId term_id, uint32_t ordinal) const;
+
+    // Исключает документы с минус-словами с порядковыми номерами из [first, last).
+    // Для частых слов используется битовая карта
+    void ExcludeMinusWords(const IndexSnapshot& snapshot, ScoreAccumulator& accumulator, const pmr::vector<TermId>& minus_term_ids, uint32_t first, uint32_t last) const;
+
+    // Исключает удалённые документы, ещё не вычищенные из сегментов
+    void ExcludeRemovedDocuments(ScoreAccumulator& accumulator, uint32_t first, uint32_t last) const;
+
+    pmr::vector<TermId> FindMinusTermIds(const Query& query, pmr::memory_resource* resource) const;
+
+    // Применяет фильтр по статусу битовой картой, если для слов запроса это дешевле
+    // проверки каждого вхождения. Возвращает true, если фильтр применён
+    template <typename Predicant>
+    bool ExcludeByStatus(ScoreAccumulator& accumulator, const Predicant& predicant, size_t posting_count, uint32_t first, uint32_t last) const;
+
+    // Порядок выдачи: по убыванию релевантности, при равной релевантности - по убыванию рейтинга
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+    // Ключ кеша результатов; пустой, если поиск с таким фильтром не кешируется
+    template <typename KeyMapper>
+    static void BuildResultCacheKey(const Query& query, const KeyMapper& key_mapper, size_t count, QueryMode mode, SearchMethod method, pmr::string& key);
+
+    // Возвращает результат из кеша или выполняет search() и сохраняет результат
+    template <typename KeyMapper, typename Search>
+    vector<Document> FindTopDocumentsCached(const Query& query, const KeyMapper& key_mapper, size_t count, QueryMode mode, SearchMethod method, pmr::memory_resource* resource, Search search) const;
+
+    // Оставляет в documents не более count лучших документов в порядке выдачи
+    template <typename Documents>
+    static void SelectTopDocuments(Documents& documents, size_t count);
+
+    // Поиск без политики выполнения: временные данные и результат размещаются в resource
+    template <typename Predicant>
+    pmr::vector<Document> FindAllDocuments(const Query& query, Predicant predicant, pmr::memory_resource* resource) const;
+
+    // Параллельный поиск: части диапазона порядковых номеров документов
+    // обрабатываются независимо, их лучшие документы объединяются
+    template <typename Predicant>
+    vector<Document> FindTopDocumentsPartitioned(execution::parallel_policy policy, const Query& query, Predicant predicant, size_t count, QueryMode mode) const;
+
+    // Документы с порядковыми номерами из [first, last), содержащие все плюс-слова.
+    // Списки вхождений пересекаются начиная с самого короткого
     template <typename Predicant>
-    vector<Document> FindAllDocuments(const Query& query, Predicant predicant) const;
+    pmr::vector<Document> FindAllDocumentsConjunctive(const IndexSnapshot& snapshot, const Query& query, Predicant predicant, uint32_t first, uint32_t last, pmr::memory_resource* resource) const;
+
+    // Запросы [first, last) пакета с общим обходом слов. Результаты добавляются в
+    // пустые results[first, last)
+    void FindTopDocumentsBatchGroup(const vector<Query>& queries, size_t first, size_t last, DocumentStatusPredicate predicant, int max_result_count, vector<vector<Document>>& results) const;
 
     template <typename Predicant>
-    vector<Document> FindAllDocuments(execution::parallel_policy policy, const Query& query, Predicant predicant) const;
+    pmr::vector<Document> FindTopDocumentsBlockMaxWand(const Query& query, Predicant predicant, size_t count, pmr::memory_resource* resource) const;
 };
 
 template<typename StringCollection>
 SearchServer::SearchServer(const StringCollection& stop_words) {
     InsertCorrectStopWords(stop_words);
+    for (CopyOnWrite<DocumentBitmap>& bitmap : status_bitmaps_) {
+        bitmap.emplace();
+    }
+    PublishSnapshot();
 }
 
 template <typename KeyMapper>
-vector<Document> SearchServer::FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, KeyMapper key_mapper) const {
-    return FindTopDocuments(raw_query, key_mapper);
+vector<Document> SearchServer::FindTopDocuments(execution::sequenced_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count, QueryMode mode) const {
+    return FindTopDocuments(raw_query, key_mapper, max_result_count, mode);
 }
 
 template <typename KeyMapper>
-vector<Document> SearchServer::FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, KeyMapper key_mapper) const {
-    Query query = ParseQuery(raw_query, true);
+vector<Document> SearchServer::FindTopDocuments(execution::parallel_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count, QueryMode mode) const {
+    Query query = ParseQuery(raw_query, pmr::get_default_resource(), true);
 
-	sort(policy, query.minus_words.begin(), query.minus_words.end());
-    sort(policy, query.plus_words.begin(), query.plus_words.end());
+    // слов в запросе немного, параллелится только обход документов
+    sort(query.minus_words.begin(), query.minus_words.end());
+    sort(query.plus_words.begin(), query.plus_words.end());
+    query.minus_words.erase(unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+    query.plus_words.erase(unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
 
-    auto end_minus_words = unique(policy, query.minus_words.begin(), query.minus_words.end());
-    auto end_plus_words = unique(policy, query.plus_words.begin(), query.plus_words.end());
+    const size_t count = max(max_result_count, 0);
+    return FindTopDocumentsCached(query, key_mapper, count, mode, SearchMethod::PARALLEL, pmr::get_default_resource(), [&] {
+        return FindTopDocumentsPartitioned(policy, query, key_mapper, count, mode);
+    });
+}
 
-    auto future_erase_minus_words = async([&query, &end_minus_words]{
-		query.minus_words.erase(end_minus_words, query.minus_words.end());
-	});
-    query.plus_words.erase(end_plus_words, query.plus_words.end());
+template <typename KeyMapper>
+vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, KeyMapper key_mapper, int max_result_count, QueryMode mode) const {   
+    //LOG_DURATION_STREAM("Operation time"s, cout);         
+    // вся память запроса, кроме результата, берётся из арены потока
+    QueryArena::Lease arena;
+    const Query query = ParseQuery(raw_query, arena.GetResource());
 
-    future_erase_minus_words.get();
+    const size_t count = max(max_result_count, 0);
+    return FindTopDocumentsCached(query, key_mapper, count, mode, SearchMethod::SEQUENTIAL, arena.GetResource(), [&] {
+        auto matched_documents = mode == QueryMode::ALL_WORDS
+            ? FindAllDocumentsConjunctive(index_.GetSnapshot(arena.GetResource()), query, key_mapper, 0, static_cast<uint32_t>(document_ids_.size()), arena.GetResource())
+            : FindAllDocuments(query, key_mapper, arena.GetResource());
+        SelectTopDocuments(matched_documents, count);
+        return vector<Document>(matched_documents.begin(), matched_documents.end());
+    });
+}
 
-    auto matched_documents = FindAllDocuments(policy, query, key_mapper);
-    
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-            [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MAXIMUM_MEASUREMENT_ERROR) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-            });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+template <typename KeyMapper>
+vector<Document> SearchServer::FindTopDocuments(search_policy::block_max_wand_policy policy, const string_view& raw_query, KeyMapper key_mapper, int max_result_count) const {
+    QueryArena::Lease arena;
+    const Query query = ParseQuery(raw_query, arena.GetResource());
+    const size_t count = max(max_result_count, 0);
+    return FindTopDocumentsCached(query, key_mapper, count, QueryMode::ANY_WORD, SearchMethod::BLOCK_MAX_WAND, arena.GetResource(), [&] {
+        const auto top_documents = FindTopDocumentsBlockMaxWand(query, key_mapper, count, arena.GetResource());
+        return vector<Document>(top_documents.begin(), top_documents.end());
+    });
 }
 
 template <typename KeyMapper>
-vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, KeyMapper key_mapper) const {   
-    //LOG_DURATION_STREAM("Operation time"s, cout);         
-    const Query query = ParseQuery(raw_query);
+void SearchServer::BuildResultCacheKey(const Query& query, const KeyMapper& key_mapper, size_t count, QueryMode mode, SearchMethod method, pmr::string& key) {
+    if constexpr (is_same_v<KeyMapper, DocumentStatusPredicate>) {
+        key.push_back('s');
+        key.push_back(static_cast<char>('0' + static_cast<int>(key_mapper.status)));
+    } else if constexpr (IsCacheTagged<KeyMapper>::value) {
+        // длина имени отделяет его от слов запроса
+        key.push_back('t');
+        key.append(to_string(key_mapper.tag.size()));
+        key.push_back(':');
+        key.append(key_mapper.tag);
+    } else {
+        return;
+    }
+    key.push_back(static_cast<char>(method));
+    key.push_back(mode == QueryMode::ALL_WORDS ? 'a' : 'o');
+    key.append(to_string(count));
+    // слова не содержат пробельных символов, а минус-слова записываются после плюс-слов
+    for (const string_view word : query.plus_words) {
+        key.push_back(' ');
+        key.append(word);
+    }
+    for (const string_view word : query.minus_words) {
+        key.append(" -"sv);
+        key.append(word);
+    }
+}
 
-    auto matched_documents = FindAllDocuments(query, key_mapper);
-    
-    sort(matched_documents.begin(), matched_documents.end(),
-            [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MAXIMUM_MEASUREMENT_ERROR) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-            });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename KeyMapper, typename Search>
+vector<Document> SearchServer::FindTopDocumentsCached(const Query& query, const KeyMapper& key_mapper, size_t count, QueryMode mode, SearchMethod method, pmr::memory_resource* resource, Search search) const {
+    if (!result_cache_->IsEnabled()) {
+        return search();
     }
-    return matched_documents;
+    pmr::string key(resource);
+    BuildResultCacheKey(query, key_mapper, count, mode, method, key);
+    if (key.empty()) {
+        return search();
+    }
+    if (optional<vector<Document>> documents = result_cache_->Find(key, index_epoch_)) {
+        return move(*documents);
+    }
+    vector<Document> documents = search();
+    result_cache_->Insert(key, index_epoch_, documents);
+    return documents;
 }
 
 template<typename StringCollection>
@@ -186,81 +712,380 @@ void SearchServer::InsertCorrectStopWords(const StringCollection& stop_words) {
             stop_words_.insert(word);
         }
     }
+    stop_word_filter_ = StopWordFilter(stop_words_);
 }
 
 template <typename Predicant>
-vector<Document> SearchServer::FindAllDocuments(const Query& query, Predicant predicant) const {
-    map<int, double> document_to_relevance;
+bool SearchServer::ExcludeByStatus(ScoreAccumulator& accumulator, const Predicant& predicant, size_t posting_count, uint32_t first, uint32_t last) const {
+    if constexpr (is_same_v<Predicant, DocumentStatusPredicate>) {
+        // маска обходит (last - first) / 64 слов, проверка статусов - все вхождения слов запроса
+        if (posting_count * 16 >= last - first) {
+            accumulator.ExcludeAllExcept(*status_bitmaps_[static_cast<size_t>(predicant.status)], first, last);
+            return true;
+        }
+    }
+    return false;
+}
 
+template <typename Documents>
+void SearchServer::SelectTopDocuments(Documents& documents, size_t count) {
+    if (documents.size() > count) {
+        partial_sort(documents.begin(), documents.begin() + count, documents.end(), IsMoreRelevant);
+        documents.resize(count);
+    } else {
+        sort(documents.begin(), documents.end(), IsMoreRelevant);
+    }
+}
+
+template <typename Predicant>
+pmr::vector<Document> SearchServer::FindAllDocuments(const Query& query, Predicant predicant, pmr::memory_resource* resource) const {
+    const uint32_t document_count = static_cast<uint32_t>(document_ids_.size());
+    const IndexSnapshot snapshot = index_.GetSnapshot(resource);
+    ScoreAccumulator::Lease accumulator(document_count);
+
+    pmr::vector<TermId> plus_term_ids(resource);
+    size_t posting_count = 0;
     for (const string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+        if (const optional<TermId> term_id = FindTermId(word)) {
+            plus_term_ids.push_back(*term_id);
+            posting_count += document_freqs_[*term_id];
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(string(word))) {
-            if (predicant(document_id, documents_.at(document_id).status, documents_.at(document_id).rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+    }
+
+    // документы с минус-словами и другим статусом исключаются до подсчёта релевантности
+    ExcludeRemovedDocuments(*accumulator, 0, document_count);
+    ExcludeMinusWords(snapshot, *accumulator, FindMinusTermIds(query, resource), 0, document_count);
+    const bool is_status_excluded = ExcludeByStatus(*accumulator, predicant, posting_count, 0, document_count);
+
+    for (const TermId term_id : plus_term_ids) {
+        // вклад слова с нулевой IDF нулевой, документы только отмечаются как найденные
+        const double inverse_document_freq = HasZeroInverseDocumentFreq(term_id) ? 0.0 : ComputeWordInverseDocumentFreq(term_id);
+        snapshot.ForEachPosting(term_id, [&](uint32_t ordinal, uint32_t term_count) {
+            if (!accumulator->IsExcluded(ordinal)
+                && (is_status_excluded || predicant(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]))) {
+                const double term_freq = term_count * inverse_word_counts_[ordinal];
+                accumulator->Add(ordinal, term_freq * inverse_document_freq);
             }
-        }
+        });
     }
- 
-    for (const string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+
+    pmr::vector<Document> matched_documents(resource);
+    accumulator->ForEach([&](uint32_t ordinal, double relevance) {
+        matched_documents.push_back({
+            document_ids_[ordinal],
+            relevance,
+            document_ratings_[ordinal]
+        });
+    });
+    return matched_documents;
+}
+
+template <typename Predicant>
+pmr::vector<Document> SearchServer::FindAllDocumentsConjunctive(const IndexSnapshot& snapshot, const Query& query, Predicant predicant, uint32_t first, uint32_t last, pmr::memory_resource* resource) const {
+    pmr::vector<Document> matched_documents(resource);
+    if (query.plus_words.empty()) {
+        return matched_documents;
+    }
+
+    // слова с нулевой IDF есть во всех документах и не сужают пересечение
+    pmr::vector<pair<TermId, double>> plus_terms(resource);
+    TermId any_term_id = 0;
+    for (const string_view& word : query.plus_words) {
+        const optional<TermId> term_id = FindTermId(word);
+        if (!term_id) {
+            return matched_documents;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(string(word))) {
-            document_to_relevance.erase(document_id);
+        any_term_id = *term_id;
+        if (!HasZeroInverseDocumentFreq(*term_id)) {
+            plus_terms.push_back({*term_id, ComputeWordInverseDocumentFreq(*term_id)});
         }
     }
+    sort(plus_terms.begin(), plus_terms.end(), [this](const auto& lhs, const auto& rhs) {
+        return document_freqs_[lhs.first] < document_freqs_[rhs.first];
+    });
 
-    vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({
-            document_id,
-            relevance,
-            documents_.at(document_id).rating
+    const uint32_t document_count = static_cast<uint32_t>(document_ids_.size());
+    ScoreAccumulator::Lease accumulator(document_count);
+    ExcludeRemovedDocuments(*accumulator, first, last);
+    ExcludeMinusWords(snapshot, *accumulator, FindMinusTermIds(query, resource), first, last);
+    const size_t candidate_count = document_freqs_[plus_terms.empty() ? any_term_id : plus_terms[0].first];
+    const bool is_status_excluded = ExcludeByStatus(*accumulator, predicant, candidate_count * (last - first) / max(document_count, 1u), first, last);
+
+    const auto add_document = [&](uint32_t ordinal, double relevance) {
+        matched_documents.push_back({document_ids_[ordinal], relevance, document_ratings_[ordinal]});
+    };
+    const auto is_accepted = [&](uint32_t ordinal) {
+        return !accumulator->IsExcluded(ordinal)
+            && (is_status_excluded || predicant(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]));
+    };
+
+    if (plus_terms.empty()) {
+        // все слова запроса есть во всех документах
+        snapshot.ForEachPostingInRange(any_term_id, first, last, [&](uint32_t ordinal, uint32_t) {
+            if (is_accepted(ordinal)) {
+                add_document(ordinal, 0.0);
+            }
         });
+        return matched_documents;
+    }
+
+    // Сегменты не пересекаются, поэтому списки вхождений пересекаются в каждом сегменте отдельно
+    pmr::vector<PostingList::Cursor> cursors(resource);
+    cursors.reserve(plus_terms.size());
+    for (const auto& segment : snapshot.GetSegments()) {
+        if (segment->GetEndOrdinal() <= first || segment->GetFirstOrdinal() >= last) {
+            continue;
+        }
+        cursors.clear();
+        for (const auto& [term_id, _] : plus_terms) {
+            const PostingList* postings = segment->FindPostings(term_id);
+            if (postings == nullptr) {
+                break;
+            }
+            cursors.emplace_back(*postings);
+            cursors.back().Advance(first);
+        }
+        if (cursors.size() < plus_terms.size()) {
+            continue;
+        }
+
+        // Кандидат берётся из самого короткого списка, остальные курсоры догоняют его.
+        // Если какой-то список перескочил кандидата, самый короткий список догоняет этот список
+        PostingList::Cursor& rarest = cursors[0];
+        while (!rarest.AtEnd() && rarest.GetOrdinal() < last) {
+            const uint32_t candidate = rarest.GetOrdinal();
+            uint32_t next_candidate = candidate;
+            for (size_t i = 1; i < cursors.size(); ++i) {
+                cursors[i].Advance(candidate);
+                if (cursors[i].AtEnd()) {
+                    next_candidate = numeric_limits<uint32_t>::max();
+                    break;
+                }
+                if (cursors[i].GetOrdinal() != candidate) {
+                    next_candidate = cursors[i].GetOrdinal();
+                    break;
+                }
+            }
+            if (next_candidate != candidate) {
+                rarest.Advance(next_candidate);
+                continue;
+            }
+            if (is_accepted(candidate)) {
+                double relevance = 0.0;
+                for (size_t i = 0; i < cursors.size(); ++i) {
+                    const double term_freq = cursors[i].GetTermCount() * inverse_word_counts_[candidate];
+                    relevance += term_freq * plus_terms[i].second;
+                }
+                add_document(candidate, relevance);
+            }
+            rarest.Next();
+        }
     }
     return matched_documents;
 }
 
+template <typename Function>
+void SearchServer::ForEachIndex(execution::sequenced_policy, size_t count, Function function) const {
+    for (size_t i = 0; i < count; ++i) {
+        function(i);
+    }
+}
+
+template <typename Function>
+void SearchServer::ForEachIndex(execution::parallel_policy, size_t count, Function function) const {
+    executor_->ParallelFor(count, function);
+}
+
 template <typename Predicant>
-vector<Document> SearchServer::FindAllDocuments(execution::parallel_policy policy, const Query& query, Predicant predicant) const {
-    //map<int, double> document_to_relevance;
-    ConcurrentMap<int, double> document_to_relevance(100);
-
-    for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](const string_view& word)
-    {
-        auto check_is_minus_word = any_of(policy, query.minus_words.begin(), query.minus_words.end(), [&word](const string_view& minus_word) 
-        {
-            return minus_word == word;
-        });
-        if (word_to_document_freqs_.count(word) && !check_is_minus_word) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for_each(policy, word_to_document_freqs_.at(string(word)).begin(), word_to_document_freqs_.at(string(word)).end(), [&](const auto& pair)
-            {
-                // pair.first -> document_id
-                // pair.second -> term_freq
-                if (predicant(pair.first, documents_.at(pair.first).status, documents_.at(pair.first).rating)) {
-                    document_to_relevance[pair.first].ref_to_value += pair.second * inverse_document_freq;
+vector<Document> SearchServer::FindTopDocumentsPartitioned(execution::parallel_policy policy, const Query& query, Predicant predicant, size_t count, QueryMode mode) const {
+    const IndexSnapshot snapshot = index_.GetSnapshot();
+    const pmr::vector<TermId> minus_term_ids = FindMinusTermIds(query, pmr::get_default_resource());
+    vector<pair<TermId, double>> plus_terms;
+    size_t posting_count = 0;
+    for (const string_view& word : query.plus_words) {
+        if (const optional<TermId> term_id = FindTermId(word)) {
+            plus_terms.push_back({*term_id, HasZeroInverseDocumentFreq(*term_id) ? 0.0 : ComputeWordInverseDocumentFreq(*term_id)});
+            posting_count += document_freqs_[*term_id];
+        }
+    }
+
+    // Диапазон порядковых номеров делится на части; каждая часть обрабатывается
+    // своим накопителем и отбирает свои лучшие документы без синхронизации
+    const uint32_t document_count = static_cast<uint32_t>(document_ids_.size());
+    const uint32_t part_size = max((document_count + PARTITION_COUNT - 1) / PARTITION_COUNT, MIN_PARTITION_SIZE);
+    const uint32_t part_count = (document_count + part_size - 1) / part_size;
+    vector<vector<Document>> parts(part_count);
+
+    executor_->ParallelFor(part_count, [&](size_t part) {
+        const uint32_t first = static_cast<uint32_t>(part) * part_size;
+        const uint32_t last = min(first + part_size, document_count);
+        vector<Document>& part_documents = parts[part];
+        if (mode == QueryMode::ALL_WORDS) {
+            QueryArena::Lease arena;
+            auto matched_documents = FindAllDocumentsConjunctive(snapshot, query, predicant, first, last, arena.GetResource());
+            SelectTopDocuments(matched_documents, count);
+            part_documents.assign(matched_documents.begin(), matched_documents.end());
+            return;
+        }
+        ScoreAccumulator::Lease accumulator(document_count);
+        ExcludeRemovedDocuments(*accumulator, first, last);
+        ExcludeMinusWords(snapshot, *accumulator, minus_term_ids, first, last);
+        const size_t part_posting_count = posting_count * (last - first) / document_count;
+        const bool is_status_excluded = ExcludeByStatus(*accumulator, predicant, part_posting_count, first, last);
+        for (const auto& [term_id, inverse_document_freq] : plus_terms) {
+            snapshot.ForEachPostingInRange(term_id, first, last, [&](uint32_t ordinal, uint32_t term_count) {
+                if (!accumulator->IsExcluded(ordinal)
+                    && (is_status_excluded || predicant(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal]))) {
+                    const double term_freq = term_count * inverse_word_counts_[ordinal];
+                    accumulator->Add(ordinal, term_freq * inverse_document_freq);
                 }
             });
         }
+        accumulator->ForEach([&](uint32_t ordinal, double relevance) {
+            part_documents.push_back({document_ids_[ordinal], relevance, document_ratings_[ordinal]});
+        });
+        SelectTopDocuments(part_documents, count);
     });
 
-    atomic<int> index = 0;
-    map<int, double> joint_document_to_relevance = document_to_relevance.BuildOrdinaryMap();
-    vector<Document> matched_documents(joint_document_to_relevance.size());
+    vector<Document> top_documents;
+    for (const vector<Document>& part_documents : parts) {
+        top_documents.insert(top_documents.end(), part_documents.begin(), part_documents.end());
+    }
+    SelectTopDocuments(top_documents, count);
+    return top_documents;
+}
 
-    for_each(policy, joint_document_to_relevance.begin(), joint_document_to_relevance.end(), [&](const auto& pair)
-    {
-        // pair.first -> document_id
-        // pair.second -> term_freq
-        matched_documents[index++] = {pair.first, pair.second, documents_.at(pair.first).rating};
+template <typename Predicant>
+pmr::vector<Document> SearchServer::FindTopDocumentsBlockMaxWand(const Query& query, Predicant predicant, size_t count, pmr::memory_resource* resource) const {
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+    };
 
-    });
+    // куча с наименее релевантным из отобранных документов в вершине
+    pmr::vector<Document> top_documents(resource);
+    if (count == 0) {
+        return top_documents;
+    }
 
-    matched_documents.resize(index);
+    pmr::vector<pair<TermId, double>> plus_terms(resource);
+    for (const string_view& word : query.plus_words) {
+        if (const optional<TermId> term_id = FindTermId(word)) {
+            plus_terms.push_back({*term_id, ComputeWordInverseDocumentFreq(*term_id)});
+        }
+    }
+    const pmr::vector<TermId> minus_term_ids = FindMinusTermIds(query, resource);
+    // для частых минус-слов проверяется битовая карта, для остальных - курсоры
+    pmr::vector<const DocumentBitmap*> minus_bitmaps(resource);
+    for (const TermId term_id : minus_term_ids) {
+        if (term_bitmaps_[term_id]) {
+            minus_bitmaps.push_back(&*term_bitmaps_[term_id]);
+        }
+    }
+    const DocumentBitmap& removed_documents = index_.GetRemovedDocuments();
 
-    return matched_documents;
-}
+    // Документ с релевантностью не больше bound не вытеснит ни один из отобранных
+    const auto is_prunable = [&top_documents, count](double bound) {
+        return top_documents.size() == count
+            && bound <= top_documents.front().relevance - MAXIMUM_MEASUREMENT_ERROR;
+    };
+    const auto is_excluded = [&](uint32_t ordinal, pmr::vector<PostingList::Cursor>& minus_cursors) {
+        return removed_documents.Contains(ordinal)
+            || !predicant(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])
+            || any_of(minus_bitmaps.begin(), minus_bitmaps.end(), [ordinal](const DocumentBitmap* bitmap) {
+                return bitmap->Contains(ordinal);
+            })
+            || any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](PostingList::Cursor& cursor) {
+                cursor.Advance(ordinal);
+                return !cursor.AtEnd() && cursor.GetOrdinal() == ordinal;
+            });
+    };
+
+    // Окно релевантностей: документы окна набирают релевантность по словам запроса,
+    // затем найденные документы окна проверяются по возрастанию номера
+    pmr::vector<double> window_scores(BLOCK_MAX_WINDOW_SIZE, 0.0, resource);
+    pmr::vector<uint64_t> window_found(BLOCK_MAX_WINDOW_SIZE / 64, 0, resource);
+
+    // Сегменты обходятся по очереди с общей кучей: порог, набранный в одном сегменте,
+    // отсекает окна следующих
+    const IndexSnapshot snapshot = index_.GetSnapshot(resource);
+    pmr::vector<TermCursor> term_cursors(resource);
+    pmr::vector<PostingList::Cursor> minus_cursors(resource);
+    for (const auto& segment : snapshot.GetSegments()) {
+        term_cursors.clear();
+        for (const auto& [term_id, inverse_document_freq] : plus_terms) {
+            if (const PostingList* postings = segment->FindPostings(term_id)) {
+                term_cursors.push_back({PostingList::Cursor(*postings), inverse_document_freq});
+            }
+        }
+        minus_cursors.clear();
+        for (const TermId term_id : minus_term_ids) {
+            if (!term_bitmaps_[term_id]) {
+                if (const PostingList* postings = segment->FindPostings(term_id)) {
+                    minus_cursors.emplace_back(*postings);
+                }
+            }
+        }
+
+        for (uint32_t window_first = segment->GetFirstOrdinal(); window_first < segment->GetEndOrdinal(); window_first += BLOCK_MAX_WINDOW_SIZE) {
+            const uint32_t window_last = min(window_first + BLOCK_MAX_WINDOW_SIZE, segment->GetEndOrdinal());
+
+            // Верхняя оценка окна - сумма наибольших оценок блоков, пересекающих окно.
+            // Курсоры при этом не сдвигаются: отсечённое окно не распаковывается
+            if (top_documents.size() == count) {
+                double window_upper_bound = 0.0;
+                for (TermCursor& term_cursor : term_cursors) {
+                    PostingList::Cursor& cursor = term_cursor.cursor;
+                    if (!cursor.ShallowAdvance(window_first)) {
+                        continue;
+                    }
+                    double block_max_term_freq = cursor.GetBlockMaxTermFreq();
+                    while (cursor.GetBlockLastOrdinal() + 1 < window_last && cursor.ShallowAdvance(cursor.GetBlockLastOrdinal() + 1)) {
+                        block_max_term_freq = max(block_max_term_freq, cursor.GetBlockMaxTermFreq());
+                    }
+                    window_upper_bound += block_max_term_freq * term_cursor.inverse_document_freq;
+                }
+                if (is_prunable(window_upper_bound)) {
+                    continue;
+                }
+            }
+
+            // Слова обходятся по порядку запроса, поэтому релевантность совпадает с полным перебором
+            for (TermCursor& term_cursor : term_cursors) {
+                PostingList::Cursor& cursor = term_cursor.cursor;
+                for (cursor.Advance(window_first); !cursor.AtEnd() && cursor.GetOrdinal() < window_last; cursor.Next()) {
+                    const uint32_t ordinal = cursor.GetOrdinal();
+                    const uint32_t offset = ordinal - window_first;
+                    const double term_freq = cursor.GetTermCount() * inverse_word_counts_[ordinal];
+                    window_scores[offset] += term_freq * term_cursor.inverse_document_freq;
+                    window_found[offset / 64] |= uint64_t{1} << (offset % 64);
+                }
+            }
+
+            for (size_t word_index = 0; word_index < window_found.size(); ++word_index) {
+                for (uint64_t word = window_found[word_index]; word != 0; word &= word - 1) {
+                    const uint32_t offset = static_cast<uint32_t>(word_index * 64 + __builtin_ctzll(word));
+                    const uint32_t ordinal = window_first + offset;
+                    const double relevance = window_scores[offset];
+                    window_scores[offset] = 0.0;
+                    if (is_prunable(relevance) || is_excluded(ordinal, minus_cursors)) {
+                        continue;
+                    }
+                    const Document document(document_ids_[ordinal], relevance, document_ratings_[ordinal]);
+                    if (top_documents.size() < count) {
+                        top_documents.push_back(document);
+                        push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                    } else if (IsMoreRelevant(document, top_documents.front())) {
+                        pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                        top_documents.back() = document;
+                        push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                    }
+                }
+                window_found[word_index] = 0;
+            }
+        }
+    }
+
+    sort_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+    return top_documents;
+}
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "segmented_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Уровень сегмента: сегменты из [MERGE_FACTOR^k, MERGE_FACTOR^(k+1)) документов имеют уровень k.
+// Уровень не зависит от размера буфера, потому что буфер сбрасывается и досрочно
+size_t GetSegmentLevel(size_t document_count) {
+    size_t level = 0;
+    for (size_t size = SegmentedIndex::MERGE_FACTOR; size <= document_count; size *= SegmentedIndex::MERGE_FACTOR) {
+        ++level;
+    }
+    return level;
+}
+
+} // namespace
+
+IndexSnapshot::IndexSnapshot(pmr::vector<shared_ptr<const IndexSegment>> segments)
+    : segments_(move(segments))
+{}
+
+bool IndexSnapshot::Contains(TermId term_id, uint32_t ordinal) const {
+    const auto it = upper_bound(segments_.begin(), segments_.end(), ordinal, [](uint32_t value, const auto& segment) {
+        return value < segment->GetFirstOrdinal();
+    });
+    if (it == segments_.begin()) {
+        return false;
+    }
+    const PostingList* postings = (*prev(it))->FindPostings(term_id);
+    return postings != nullptr && postings->Contains(ordinal);
+}
+
+SegmentedIndex::SegmentedIndex(shared_ptr<TaskExecutor> executor)
+    : write_buffer_(make_shared<IndexSegment>(0))
+    , executor_(move(executor))
+{
+    removed_.emplace();
+}
+
+SegmentedIndex::SegmentedIndex(const SegmentedIndex& other, Frozen)
+    : write_buffer_size_(other.write_buffer_size_)
+    , is_frozen_(true)
+    , is_stopped_(true)
+{
+    lock_guard lock(other.mutex_);
+    segments_ = other.segments_;
+    write_buffer_ = make_shared<IndexSegment>(*other.write_buffer_);
+    removed_ = other.removed_;
+    frozen_segments_.reserve(segments_.size() + 1);
+    frozen_segments_.assign(segments_.begin(), segments_.end());
+    frozen_segments_.push_back(write_buffer_);
+}
+
+SegmentedIndex::~SegmentedIndex() {
+    {
+        lock_guard lock(mutex_);
+        is_stopped_ = true;
+    }
+    // задача прекращает слияния после текущего
+    merge_.reset();
+}
+
+void SegmentedIndex::SetExecutor(shared_ptr<TaskExecutor> executor) {
+    executor_ = move(executor);
+}
+
+void SegmentedIndex::SetWriteBufferSize(size_t document_count) {
+    lock_guard lock(mutex_);
+    write_buffer_size_ = max<size_t>(document_count, 1);
+}
+
+void SegmentedIndex::AddDocument(uint32_t ordinal, double inverse_word_count, const vector<pair<TermId, uint32_t>>& term_counts) {
+    // буфер записи не виден фоновому потоку, поэтому дополняется без блокировки
+    write_buffer_->AddDocument(ordinal, inverse_word_count, term_counts);
+    if (write_buffer_->GetDocumentCount() >= write_buffer_size_) {
+        Flush();
+    }
+}
+
+void SegmentedIndex::AddDocuments(TaskExecutor& executor, const vector<double>& inverse_word_counts, const GroupedPostings& grouped) {
+    vector<size_t> cursors(grouped.offsets.begin(), grouped.offsets.end() - 1);
+    for (size_t added = 0; added < inverse_word_counts.size();) {
+        // после уменьшения размера буфер может оказаться переполнен, тогда
+        // он сбрасывается после первого же документа
+        const size_t buffer_count = write_buffer_->GetDocumentCount();
+        const size_t free_count = write_buffer_size_ > buffer_count ? write_buffer_size_ - buffer_count : 1;
+        const size_t count = min(inverse_word_counts.size() - added, free_count);
+        write_buffer_->AddDocuments(executor, inverse_word_counts.data() + added, count, grouped, cursors);
+        added += count;
+        if (write_buffer_->GetDocumentCount() >= write_buffer_size_) {
+            Flush();
+        }
+    }
+}
+
+void SegmentedIndex::RemoveDocument(uint32_t ordinal) {
+    lock_guard lock(mutex_);
+    removed_.Mutable().Add(ordinal);
+}
+
+void SegmentedIndex::RemoveDocuments(const vector<uint32_t>& ordinals) {
+    lock_guard lock(mutex_);
+    DocumentBitmap& removed = removed_.Mutable();
+    for (const uint32_t ordinal : ordinals) {
+        removed.Add(ordinal);
+    }
+}
+
+void SegmentedIndex::AddSegment(shared_ptr<const IndexSegment> segment) {
+    {
+        lock_guard lock(mutex_);
+        write_buffer_ = make_shared<IndexSegment>(segment->GetEndOrdinal());
+        segments_.push_back(move(segment));
+    }
+    RequestMerge();
+}
+
+void SegmentedIndex::Flush() {
+    if (write_buffer_->GetDocumentCount() == 0) {
+        return;
+    }
+    {
+        lock_guard lock(mutex_);
+        segments_.push_back(write_buffer_);
+        write_buffer_ = make_shared<IndexSegment>(write_buffer_->GetEndOrdinal());
+    }
+    RequestMerge();
+}
+
+IndexSnapshot SegmentedIndex::GetSnapshot(pmr::memory_resource* resource) const {
+    pmr::vector<shared_ptr<const IndexSegment>> segments(resource);
+    if (is_frozen_) {
+        segments.assign(frozen_segments_.begin(), frozen_segments_.end());
+        return IndexSnapshot(move(segments));
+    }
+    {
+        lock_guard lock(mutex_);
+        segments.reserve(segments_.size() + 1);
+        segments.assign(segments_.begin(), segments_.end());
+    }
+    segments.push_back(write_buffer_);
+    return IndexSnapshot(move(segments));
+}
+
+void SegmentedIndex::Compact() {
+    Flush();
+    // сливаемые задачей сегменты заменяются по окончании слияния
+    WaitForMerges();
+    lock_guard lock(mutex_);
+    if (removed_->empty()) {
+        return;
+    }
+    // сегменты, из которых слияние уже вычистило удалённые документы, не переписываются
+    vector<bool> has_removed(segments_.size(), false);
+    removed_->ForEach([&](uint32_t ordinal) {
+        const auto it = upper_bound(segments_.begin(), segments_.end(), ordinal, [](uint32_t value, const auto& segment) {
+            return value < segment->GetFirstOrdinal();
+        });
+        if (!(*prev(it))->IsPurged(ordinal)) {
+            has_removed[prev(it) - segments_.begin()] = true;
+        }
+    });
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (has_removed[i]) {
+            segments_[i] = make_shared<const IndexSegment>(IndexSegment::Merge({segments_[i].get()}, *removed_));
+        }
+    }
+    removed_.emplace();
+}
+
+size_t SegmentedIndex::GetSegmentCount() const {
+    lock_guard lock(mutex_);
+    return segments_.size();
+}
+
+void SegmentedIndex::WaitForMerges() const {
+    // задача не завершается, пока есть кандидаты, а новые сегменты
+    // добавляет только вызывающий поток
+    if (merge_) {
+        merge_->Get();
+        merge_.reset();
+        merge_executor_.reset();
+    }
+}
+
+bool SegmentedIndex::FindMergeCandidates(size_t& first) const {
+    size_t run_length = 0;
+    size_t run_level = 0;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const size_t level = GetSegmentLevel(segments_[i]->GetDocumentCount());
+        if (run_length > 0 && level == run_level) {
+            ++run_length;
+        } else {
+            run_length = 1;
+            run_level = level;
+        }
+        if (run_length == MERGE_FACTOR) {
+            first = i + 1 - MERGE_FACTOR;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SegmentedIndex::RequestMerge() {
+    {
+        lock_guard lock(mutex_);
+        size_t first = 0;
+        if (executor_ == nullptr || is_merging_ || !FindMergeCandidates(first)) {
+            return;
+        }
+        is_merging_ = true;
+    }
+    // предыдущая задача уже сняла is_merging_ и завершается
+    merge_.reset();
+    merge_executor_ = executor_;
+    merge_.emplace(*merge_executor_, [this] {
+        MergeSegments();
+        return true;
+    });
+}
+
+void SegmentedIndex::MergeSegments() {
+    unique_lock lock(mutex_);
+    size_t first = 0;
+    while (!is_stopped_ && FindMergeCandidates(first)) {
+        // Сегменты неизменяемы, поэтому сливаются без блокировки. Копируются только
+        // отметки удаления их документов: основной поток может добавлять новые
+        vector<shared_ptr<const IndexSegment>> candidates(segments_.begin() + first, segments_.begin() + first + MERGE_FACTOR);
+        DocumentBitmap removed;
+        removed_->ForEach([&](uint32_t ordinal) {
+            if (ordinal >= candidates.front()->GetFirstOrdinal() && ordinal < candidates.back()->GetEndOrdinal()) {
+                removed.Add(ordinal);
+            }
+        });
+        lock.unlock();
+
+        vector<const IndexSegment*> segments;
+        for (const auto& candidate : candidates) {
+            segments.push_back(candidate.get());
+        }
+        auto merged = make_shared<const IndexSegment>(IndexSegment::Merge(segments, removed));
+
+        lock.lock();
+        // Новые сегменты добавляются только в конец, а удаляет их только эта задача,
+        // поэтому слитые сегменты остались на прежних местах
+        segments_.erase(segments_.begin() + first + 1, segments_.begin() + first + MERGE_FACTOR);
+        segments_[first] = move(merged);
+    }
+    is_merging_ = false;
+}
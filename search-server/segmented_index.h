@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "copy_on_write.h"
+#include "document_bitmap.h"
+#include "index_segment.h"
+#include "task_executor.h"
+
+// Набор сегментов индекса на момент запроса. Сегменты упорядочены
+// по порядковым номерам документов и не пересекаются
+class IndexSnapshot {
+public:
+    explicit IndexSnapshot(std::pmr::vector<std::shared_ptr<const IndexSegment>> segments);
+
+    const std::pmr::vector<std::shared_ptr<const IndexSegment>>& GetSegments() const {
+        return segments_;
+    }
+
+    // Вызывает callback(ordinal, term_count) для всех вхождений слова по возрастанию ordinal
+    template <typename Callback>
+    void ForEachPosting(TermId term_id, Callback callback) const;
+
+    // То же для вхождений с порядковыми номерами из [first, last)
+    template <typename Callback>
+    void ForEachPostingInRange(TermId term_id, uint32_t first, uint32_t last, Callback callback) const;
+
+    bool Contains(TermId term_id, uint32_t ordinal) const;
+
+private:
+    std::pmr::vector<std::shared_ptr<const IndexSegment>> segments_;
+};
+
+// Сегментированный индекс в духе LSM-дерева: новые документы попадают в буфер
+// записи, заполненный буфер становится неизменяемым сегментом. Фоновая задача
+// пула потоков сливает соседние сегменты одного уровня (размера), пропуская
+// удалённые документы. Удаление документа только помечает его порядковый номер
+class SegmentedIndex {
+public:
+    static const size_t DEFAULT_WRITE_BUFFER_SIZE = 4096;
+    // Сколько соседних сегментов одного уровня сливаются в один
+    static const size_t MERGE_FACTOR = 4;
+
+    struct Frozen {};
+
+    // Слияния выполняются задачами executor; без пула сегменты не сливаются
+    explicit SegmentedIndex(std::shared_ptr<TaskExecutor> executor = nullptr);
+    // Неизменяемая копия: сегменты, буфер записи и отметки удаления на момент вызова.
+    // Копия не сливает сегменты и не должна изменяться, поэтому её снимки
+    // берутся без блокировки
+    SegmentedIndex(const SegmentedIndex& other, Frozen);
+    ~SegmentedIndex();
+
+    SegmentedIndex(const SegmentedIndex&) = delete;
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+
+    // Пул для следующих слияний; уже начатое слияние завершается в прежнем пуле
+    void SetExecutor(std::shared_ptr<TaskExecutor> executor);
+
+    // Количество документов, после которого буфер записи становится сегментом
+    void SetWriteBufferSize(size_t document_count);
+
+    void AddDocument(uint32_t ordinal, double inverse_word_count, const std::vector<std::pair<TermId, uint32_t>>& term_counts);
+
+    // Добавляет документы с номерами подряд от конца буфера записи. Буфер
+    // сбрасывается в тех же местах, что и при добавлении документов по одному
+    void AddDocuments(TaskExecutor& executor, const std::vector<double>& inverse_word_counts, const GroupedPostings& grouped);
+
+    void RemoveDocument(uint32_t ordinal);
+
+    // Помечает удалёнными несколько документов под одной блокировкой
+    void RemoveDocuments(const std::vector<uint32_t>& ordinals);
+
+    // Добавляет готовый сегмент, который начинается с конца индекса.
+    // Буфер записи должен быть пуст
+    void AddSegment(std::shared_ptr<const IndexSegment> segment);
+
+    // Делает непустой буфер записи сегментом
+    void Flush();
+
+    // Переписывает сегменты, в которых остались вхождения удалённых документов,
+    // и снимает отметки удаления
+    void Compact();
+
+    bool IsRemoved(uint32_t ordinal) const {
+        return removed_->Contains(ordinal);
+    }
+
+    const DocumentBitmap& GetRemovedDocuments() const {
+        return *removed_;
+    }
+
+    // Список сегментов снимка размещается в resource
+    IndexSnapshot GetSnapshot(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+    // Количество неизменяемых сегментов без буфера записи
+    size_t GetSegmentCount() const;
+
+    // Ожидает, пока фоновая задача не сольёт все сегменты, подлежащие слиянию.
+    // Вызывается из потока, изменяющего индекс
+    void WaitForMerges() const;
+
+private:
+    // Защищает список сегментов, буфер записи при его сбросе и отметки удаления
+    // от задачи слияния
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<const IndexSegment>> segments_;
+    std::shared_ptr<IndexSegment> write_buffer_;
+    size_t write_buffer_size_ = DEFAULT_WRITE_BUFFER_SIZE;
+    CopyOnWrite<DocumentBitmap> removed_;
+    // у неизменяемой копии - готовый список сегментов снимка вместе с буфером записи
+    bool is_frozen_ = false;
+    std::vector<std::shared_ptr<const IndexSegment>> frozen_segments_;
+    // задача слияния запущена и ещё не нашла, что сливать больше нечего
+    bool is_merging_ = false;
+    bool is_stopped_ = false;
+    std::shared_ptr<TaskExecutor> executor_;
+    // задача слияния и пул, в котором она запущена. Задачей управляет только
+    // поток, изменяющий индекс, поэтому ожидание в const-методах допустимо
+    mutable std::shared_ptr<TaskExecutor> merge_executor_;
+    mutable std::optional<TaskExecutor::Future<bool>> merge_;
+
+    // Находит MERGE_FACTOR соседних сегментов одного уровня: [first, first + MERGE_FACTOR)
+    bool FindMergeCandidates(size_t& first) const;
+
+    // Запускает задачу слияния, если она не запущена и есть что сливать
+    void RequestMerge();
+
+    // Сливает сегменты, пока есть кандидаты
+    void MergeSegments();
+};
+
+template <typename Callback>
+void IndexSnapshot::ForEachPosting(TermId term_id, Callback callback) const {
+    for (const auto& segment : segments_) {
+        if (const PostingList* postings = segment->FindPostings(term_id)) {
+            postings->ForEach(callback);
+        }
+    }
+}
+
+template <typename Callback>
+void IndexSnapshot::ForEachPostingInRange(TermId term_id, uint32_t first, uint32_t last, Callback callback) const {
+    for (const auto& segment : segments_) {
+        if (segment->GetEndOrdinal() <= first || segment->GetFirstOrdinal() >= last) {
+            continue;
+        }
+        const PostingList* postings = segment->FindPostings(term_id);
+        if (postings == nullptr) {
+            continue;
+        }
+        if (segment->GetFirstOrdinal() >= first && segment->GetEndOrdinal() <= last) {
+            postings->ForEach(callback);
+            continue;
+        }
+        PostingList::Cursor cursor(*postings);
+        for (cursor.Advance(first); !cursor.AtEnd() && cursor.GetOrdinal() < last; cursor.Next()) {
+            callback(cursor.GetOrdinal(), cursor.GetTermCount());
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#include "stop_word_filter.h"
+
+#include <functional>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+size_t StopWordFilter::Hash(string_view word) {
+    return hash<string_view>{}(word);
+}
+
+uint32_t StopWordFilter::MatchGroup(size_t group, uint8_t control) const {
+    const uint8_t* controls = controls_.data() + group * GROUP_SIZE;
+#if defined(__SSE2__)
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(controls));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(control)))));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < GROUP_SIZE; ++i) {
+        mask |= static_cast<uint32_t>(controls[i] == control) << i;
+    }
+    return mask;
+#endif
+}
+
+void StopWordFilter::Build(const vector<Slot>& words) {
+    // группы заполнены не больше чем наполовину, поэтому поиск почти всегда
+    // заканчивается в первой группе
+    size_t group_count = 1;
+    while (group_count * GROUP_SIZE < 2 * words.size()) {
+        group_count *= 2;
+    }
+    group_mask_ = group_count - 1;
+    controls_.assign(group_count * GROUP_SIZE, EMPTY);
+    slots_.assign(group_count * GROUP_SIZE, Slot{});
+    empty_slot_count_ = slots_.size();
+
+    for (const Slot& word_slot : words) {
+        const string_view word(chars_.data() + word_slot.offset, word_slot.length);
+        if (Contains(word)) {
+            continue;
+        }
+        const size_t word_hash = Hash(word);
+        for (size_t group = (word_hash >> 7) & group_mask_; ; group = (group + 1) & group_mask_) {
+            const uint32_t empty = MatchGroup(group, EMPTY);
+            if (empty != 0) {
+                const size_t slot = group * GROUP_SIZE + static_cast<size_t>(__builtin_ctz(empty));
+                controls_[slot] = static_cast<uint8_t>(word_hash & 0x7F);
+                slots_[slot] = word_slot;
+                --empty_slot_count_;
+                break;
+            }
+        }
+        length_mask_ |= GetLengthBit(word.size());
+    }
+}
+
+bool StopWordFilter::Contains(string_view word) const {
+    if ((length_mask_ & GetLengthBit(word.size())) == 0) {
+        return false;
+    }
+    const size_t word_hash = Hash(word);
+    const uint8_t control = static_cast<uint8_t>(word_hash & 0x7F);
+    for (size_t group = (word_hash >> 7) & group_mask_; ; group = (group + 1) & group_mask_) {
+        for (uint32_t match = MatchGroup(group, control); match != 0; match &= match - 1) {
+            const Slot& slot = slots_[group * GROUP_SIZE + static_cast<size_t>(__builtin_ctz(match))];
+            if (slot.length == word.size() && string_view(chars_.data() + slot.offset, slot.length) == word) {
+                return true;
+            }
+        }
+        // группа со свободной ячейкой завершает цепочку: дальше слово не переносилось
+        if (MatchGroup(group, EMPTY) != 0) {
+            return false;
+        }
+    }
+}
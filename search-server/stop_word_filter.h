@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Неизменяемое множество стоп-слов, собранное один раз при их задании.
+// Слова хранятся в одном буфере, поиск идёт по открытой хеш-таблице
+// с группами по 16 ячеек: 7 бит хеша каждой ячейки лежат в отдельном
+// байте группы и сравниваются со словом одной SIMD-инструкцией.
+// Перед хешированием слово отсеивается по длине: большинство слов
+// документов и запросов стоп-словами не являются
+class StopWordFilter {
+public:
+    static constexpr size_t GROUP_SIZE = 16;
+
+    StopWordFilter() = default;
+
+    template <typename StringCollection>
+    explicit StopWordFilter(const StringCollection& words);
+
+    bool Contains(std::string_view word) const;
+
+    size_t size() const {
+        return slots_.size() - empty_slot_count_;
+    }
+
+private:
+    static constexpr uint8_t EMPTY = 0x80;
+    // Бит маски длин для слов длиннее 62 байт
+    static constexpr size_t LONG_WORD_BIT = 63;
+
+    struct Slot {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    std::string chars_;
+    // Байты групп: EMPTY или младшие 7 бит хеша слова в ячейке
+    std::vector<uint8_t> controls_;
+    std::vector<Slot> slots_;
+    size_t group_mask_ = 0;
+    size_t empty_slot_count_ = 0;
+    uint64_t length_mask_ = 0;
+
+    static uint64_t GetLengthBit(size_t length) {
+        return uint64_t{1} << (length < LONG_WORD_BIT ? length : LONG_WORD_BIT);
+    }
+
+    static size_t Hash(std::string_view word);
+
+    // Маска ячеек группы, байт которых равен control
+    uint32_t MatchGroup(size_t group, uint8_t control) const;
+
+    // Раскладывает слова из chars_ по таблице
+    void Build(const std::vector<Slot>& words);
+};
+
+template <typename StringCollection>
+StopWordFilter::StopWordFilter(const StringCollection& words) {
+    std::vector<Slot> word_slots;
+    for (const auto& word : words) {
+        const std::string_view word_view(word);
+        word_slots.push_back({static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(word_view.size())});
+        chars_.append(word_view);
+    }
+    Build(word_slots);
+}
@@ -1,18 +1,94 @@
 #include "string_processing.h"
 
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text) {
+namespace {
 
-    vector<string_view> result;
-    auto pos_end = text.npos;
-    while (true) {
-        uint64_t space = text.find(' ');
-        result.push_back(text.substr(0, space));
-        text.remove_prefix(space + 1);
-        if (space == pos_end) {
-            break;
+#if defined(__SSE2__)
+
+#if defined(__AVX2__)
+// Беззнаковое сравнение value <= limit по байтам: min(value, limit) == value
+__m256i LessOrEqual(__m256i value, __m256i limit) {
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(value, limit), value);
+}
+
+TextBlockMasks ClassifyFullBlock(const char* data) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i last_space_control = _mm256_set1_epi8('\r' - '\t');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    TextBlockMasks masks;
+    for (size_t offset = 0; offset < TEXT_BLOCK_SIZE; offset += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+        const __m256i space_controls = LessOrEqual(_mm256_sub_epi8(bytes, tab), last_space_control);
+        const __m256i separators = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), space_controls);
+        const __m256i invalid = _mm256_andnot_si256(space_controls, LessOrEqual(bytes, last_control));
+        masks.separators |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(separators))} << offset;
+        masks.invalid |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(invalid))} << offset;
+    }
+    return masks;
+}
+#else
+__m128i LessOrEqual(__m128i value, __m128i limit) {
+    return _mm_cmpeq_epi8(_mm_min_epu8(value, limit), value);
+}
+
+TextBlockMasks ClassifyFullBlock(const char* data) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i last_space_control = _mm_set1_epi8('\r' - '\t');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    TextBlockMasks masks;
+    for (size_t offset = 0; offset < TEXT_BLOCK_SIZE; offset += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+        const __m128i space_controls = LessOrEqual(_mm_sub_epi8(bytes, tab), last_space_control);
+        const __m128i separators = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), space_controls);
+        const __m128i invalid = _mm_andnot_si128(space_controls, LessOrEqual(bytes, last_control));
+        masks.separators |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(separators))} << offset;
+        masks.invalid |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(invalid))} << offset;
+    }
+    return masks;
+}
+#endif
+
+#else
+TextBlockMasks ClassifyFullBlock(const char* data) {
+    TextBlockMasks masks;
+    for (size_t i = 0; i < TEXT_BLOCK_SIZE; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            masks.separators |= uint64_t{1} << i;
+        } else if (c < ' ') {
+            masks.invalid |= uint64_t{1} << i;
         }
     }
+    return masks;
+}
+#endif
+
+} // namespace
+
+TextBlockMasks ClassifyTextBlock(const char* data, size_t size) {
+    if (size >= TEXT_BLOCK_SIZE) {
+        return ClassifyFullBlock(data);
+    }
+    // короткий хвост дополняется пробелами, чтобы не читать за концом текста
+    char block[TEXT_BLOCK_SIZE];
+    memcpy(block, data, size);
+    memset(block + size, ' ', TEXT_BLOCK_SIZE - size);
+    return ClassifyFullBlock(block);
+}
+
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> result;
+    SplitIntoWords(text, result);
     return result;
-} 
\ No newline at end of file
+}
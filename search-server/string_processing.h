@@ -1,5 +1,52 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string_view>
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text);
\ No newline at end of file
+// Классы байтов блока текста длиной до TEXT_BLOCK_SIZE: бит i маски
+// относится к байту i. Байты за концом блока считаются пробелами
+struct TextBlockMasks {
+    uint64_t separators = 0;
+    uint64_t invalid = 0;
+};
+
+inline constexpr size_t TEXT_BLOCK_SIZE = 64;
+
+// Находит в блоке пробельные символы ASCII (' ', '\t', '\n', '\v', '\f', '\r')
+// и остальные управляющие символы с кодами 0-31. Использует SSE2/AVX2, если они доступны
+TextBlockMasks ClassifyTextBlock(const char* data, size_t size);
+
+// Дописывает непустые слова text в words; распределитель words задаёт вызывающий.
+// Слова разделяются любыми пробельными символами ASCII.
+// Возвращает false, если в тексте есть другие управляющие символы
+template <typename Allocator>
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view, Allocator>& words) {
+    uint64_t invalid = 0;
+    size_t word_begin = text.npos;
+    for (size_t base = 0; base < text.size(); base += TEXT_BLOCK_SIZE) {
+        const TextBlockMasks masks = ClassifyTextBlock(text.data() + base, text.size() - base);
+        invalid |= masks.invalid;
+        // начала и концы слов чередуются: ищется первый непробельный байт, затем первый пробельный
+        uint64_t boundaries = word_begin == text.npos ? ~masks.separators : masks.separators;
+        while (boundaries != 0) {
+            const size_t position = base + static_cast<size_t>(__builtin_ctzll(boundaries));
+            if (word_begin == text.npos) {
+                word_begin = position;
+                boundaries = masks.separators;
+            } else {
+                words.push_back(text.substr(word_begin, position - word_begin));
+                word_begin = text.npos;
+                boundaries = ~masks.separators;
+            }
+            const size_t next = position - base + 1;
+            boundaries = next < TEXT_BLOCK_SIZE ? boundaries & (~uint64_t{0} << next) : 0;
+        }
+    }
+    if (word_begin != text.npos) {
+        words.push_back(text.substr(word_begin));
+    }
+    return invalid == 0;
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text);
@@ -0,0 +1,179 @@
+#include "task_executor.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// пул, которому принадлежит текущий рабочий поток, и номер его очереди
+thread_local const TaskExecutor* current_executor = nullptr;
+thread_local size_t current_queue_index = 0;
+
+}  // namespace
+
+TaskExecutor::TaskExecutor(size_t thread_count, vector<int> cpu_ids)
+    : thread_count_(thread_count)
+    , cpu_ids_(move(cpu_ids))
+{
+    for (size_t i = 0; i <= thread_count_; ++i) {
+        queues_.push_back(make_unique<TaskQueue>());
+    }
+}
+
+TaskExecutor::~TaskExecutor() {
+    {
+        lock_guard lock(sleep_mutex_);
+        is_stopped_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker : threads_) {
+        worker.join();
+    }
+}
+
+size_t TaskExecutor::GetDefaultThreadCount() {
+    const size_t hardware_threads = thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+}
+
+void TaskExecutor::Start() {
+    for (size_t i = 0; i < thread_count_; ++i) {
+        threads_.emplace_back([this, i] {
+            RunWorker(i);
+        });
+#if defined(__linux__)
+        if (!cpu_ids_.empty()) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu_ids_[i % cpu_ids_.size()], &cpus);
+            // недоступный процессор оставляет поток без закрепления
+            pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpus), &cpus);
+        }
+#endif
+    }
+}
+
+void TaskExecutor::RunWorker(size_t index) {
+    current_executor = this;
+    current_queue_index = index;
+    while (true) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return is_stopped_ || pending_task_count_.load(memory_order_acquire) > 0;
+        });
+        if (is_stopped_) {
+            return;
+        }
+    }
+}
+
+void TaskExecutor::Push(Task task) {
+    if (thread_count_ > 0) {
+        call_once(start_flag_, [this] {
+            Start();
+        });
+    }
+    // счётчик увеличивается заранее, чтобы не оказаться меньше числа задач в очередях
+    pending_task_count_.fetch_add(1, memory_order_release);
+    {
+        TaskQueue& queue = *queues_[GetQueueIndex()];
+        lock_guard lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    // блокировка не даёт уведомлению проскочить между проверкой условия и засыпанием
+    bool has_waiters = false;
+    {
+        lock_guard lock(sleep_mutex_);
+        has_waiters = waiter_count_ > 0;
+    }
+    wake_up_.notify_one();
+    // ожидающий поток может оказаться единственным, кто возьмёт задачу
+    if (has_waiters) {
+        progress_.notify_all();
+    }
+}
+
+bool TaskExecutor::RunPendingTask() {
+    if (pending_task_count_.load(memory_order_acquire) == 0) {
+        return false;
+    }
+    const size_t own_index = GetQueueIndex();
+    optional<Task> task;
+    // своя очередь - с конца, чужие - с начала, начиная со следующей за своей
+    for (size_t i = 0; i < queues_.size() && !task; ++i) {
+        TaskQueue& queue = *queues_[(own_index + i) % queues_.size()];
+        lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        } else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    pending_task_count_.fetch_sub(1, memory_order_relaxed);
+    task->run(task->context);
+    return true;
+}
+
+void TaskExecutor::WaitFor(const atomic<size_t>& counter, size_t target) {
+    while (counter.load(memory_order_acquire) < target) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        ++waiter_count_;
+        progress_.wait(lock, [this, &counter, target] {
+            return counter.load(memory_order_acquire) >= target || pending_task_count_.load(memory_order_acquire) > 0;
+        });
+        --waiter_count_;
+    }
+}
+
+void TaskExecutor::NotifyProgress() {
+    bool has_waiters = false;
+    {
+        lock_guard lock(sleep_mutex_);
+        has_waiters = waiter_count_ > 0;
+    }
+    if (has_waiters) {
+        progress_.notify_all();
+    }
+}
+
+size_t TaskExecutor::GetQueueIndex() const {
+    return current_executor == this ? current_queue_index : thread_count_;
+}
+
+void TaskExecutor::RunParallelJob(void* context) {
+    ParallelJob& job = *static_cast<ParallelJob*>(context);
+    for (size_t index = job.next_index.fetch_add(1, memory_order_relaxed); index < job.count;
+         index = job.next_index.fetch_add(1, memory_order_relaxed)) {
+        try {
+            job.body(job.function, index);
+        } catch (...) {
+            lock_guard lock(job.error_mutex);
+            if (!job.error) {
+                job.error = current_exception();
+            }
+            job.next_index.store(job.count, memory_order_relaxed);
+        }
+    }
+    // после этого ParallelFor может завершиться, и job больше не используется
+    TaskExecutor& executor = *job.executor;
+    job.finished_runner_count.fetch_add(1, memory_order_release);
+    executor.NotifyProgress();
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом задач. У каждого рабочего потока своя очередь: поток
+// берёт задачи с её конца, а простаивающие потоки забирают задачи из начала чужих
+// очередей. Задачи сторонних потоков попадают в общую очередь. Поток, ожидающий
+// завершения своих задач, сам выполняет задачи пула, поэтому вложенный
+// параллельный обход не создаёт потоков, а делится на задачи того же пула или
+// выполняется на месте; когда задач нет, ожидающий поток засыпает до завершения
+// задачи или появления новой. Рабочие потоки запускаются при первой задаче
+class TaskExecutor {
+public:
+    // thread_count - число рабочих потоков; вызывающий поток работает вместе с ними,
+    // поэтому при 0 всё выполняется в вызывающем потоке. cpu_ids - процессоры,
+    // за которыми по кругу закрепляются рабочие потоки; пустой список - без закрепления
+    explicit TaskExecutor(size_t thread_count = GetDefaultThreadCount(), std::vector<int> cpu_ids = {});
+    ~TaskExecutor();
+
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    // Рабочие потоки и вызывающий поток заняты все процессоры
+    static size_t GetDefaultThreadCount();
+
+    size_t GetThreadCount() const {
+        return thread_count_;
+    }
+
+    // Вызывает function(i) для каждого i из [0, count) и дожидается завершения.
+    // Индексы раздаются по одному исполнителям, число которых не больше числа
+    // потоков пула. Первое исключение function передаётся вызывающему, оставшиеся
+    // индексы после него не обрабатываются
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    // Результат функции, выполняемой пулом в фоне. Get и деструктор дожидаются
+    // выполнения, выполняя задачи пула; если пул без рабочих потоков, функция
+    // выполняется в Get
+    template <typename Result>
+    class Future {
+    public:
+        template <typename Function>
+        Future(TaskExecutor& executor, Function function);
+        ~Future();
+
+        Future(const Future&) = delete;
+        Future& operator=(const Future&) = delete;
+
+        Result Get();
+
+    private:
+        TaskExecutor& executor_;
+        std::function<Result()> function_;
+        std::optional<Result> result_;
+        std::exception_ptr error_;
+        std::atomic<size_t> is_done_ = 0;
+
+        static void Run(void* context);
+    };
+
+private:
+    struct Task {
+        void (*run)(void* context);
+        void* context;
+    };
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Общее состояние исполнителей одного ParallelFor
+    struct ParallelJob {
+        TaskExecutor* executor;
+        size_t count;
+        void (*body)(void* function, size_t index);
+        void* function;
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> finished_runner_count = 0;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    size_t thread_count_;
+    std::vector<int> cpu_ids_;
+    // очереди рабочих потоков и последняя - общая для сторонних потоков
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::atomic<size_t> pending_task_count_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    // будит потоки в WaitFor при завершении задачи и при появлении новой
+    std::condition_variable progress_;
+    size_t waiter_count_ = 0;
+    bool is_stopped_ = false;
+    std::once_flag start_flag_;
+    std::vector<std::thread> threads_;
+
+    void Start();
+    void RunWorker(size_t index);
+    void Push(Task task);
+    // Выполняет одну ожидающую задачу; false, если задач нет
+    bool RunPendingTask();
+    // Выполняет задачи пула, пока counter не достигнет target; если задач нет,
+    // спит до NotifyProgress или Push
+    void WaitFor(const std::atomic<size_t>& counter, size_t target);
+    // Будит ожидающих в WaitFor после увеличения счётчика завершения
+    void NotifyProgress();
+    // Очередь текущего потока, если он рабочий поток пула, иначе общая
+    size_t GetQueueIndex() const;
+
+    static void RunParallelJob(void* context);
+};
+
+template <typename Function>
+void TaskExecutor::ParallelFor(size_t count, Function function) {
+    const size_t runner_count = std::min(count, thread_count_ + 1);
+    if (runner_count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+    ParallelJob job;
+    job.executor = this;
+    job.count = count;
+    job.body = [](void* function, size_t index) {
+        (*static_cast<Function*>(function))(index);
+    };
+    job.function = &function;
+    for (size_t i = 1; i < runner_count; ++i) {
+        Push({&RunParallelJob, &job});
+    }
+    RunParallelJob(&job);
+    // задачи, ещё не взятые другими потоками, выполняются здесь же и сразу завершаются
+    WaitFor(job.finished_runner_count, runner_count);
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+template <typename Result>
+template <typename Function>
+TaskExecutor::Future<Result>::Future(TaskExecutor& executor, Function function)
+    : executor_(executor)
+    , function_(std::move(function))
+{
+    executor_.Push({&Run, this});
+}
+
+template <typename Result>
+TaskExecutor::Future<Result>::~Future() {
+    executor_.WaitFor(is_done_, 1);
+}
+
+template <typename Result>
+Result TaskExecutor::Future<Result>::Get() {
+    executor_.WaitFor(is_done_, 1);
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    return std::move(*result_);
+}
+
+template <typename Result>
+void TaskExecutor::Future<Result>::Run(void* context) {
+    Future& future = *static_cast<Future*>(context);
+    try {
+        future.result_.emplace(future.function_());
+    } catch (...) {
+        future.error_ = std::current_exception();
+    }
+    // после сохранения флага future может быть уничтожен
+    TaskExecutor& executor = future.executor_;
+    future.is_done_.store(1, std::memory_order_release);
+    executor.NotifyProgress();
+}
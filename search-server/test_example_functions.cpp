@@ -2,8 +2,23 @@
 #include "search_server.h"
 #include "remove_duplicates.h"
 #include "process_queries.h"
-
+#include "request_queue.h"
+#include "bounded_queue.h"
+#include "corpus_ingestion.h"
+#include "index_image.h"
+#include "string_processing.h"
+#include "stop_word_filter.h"
+#include "task_executor.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
 #include <execution>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <set>
+#include <thread>
 
 void ASSERTImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
                 const string& hint) {
@@ -26,6 +41,63 @@ void ASSERTImpl(bool value, const string& expr_str, const string& file, const st
 
 #define ASSERT_HINT(expr, hint) ASSERTImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
 
+// Счётчик выделений памяти в куче текущим потоком для тестов выделения памяти
+// при поиске. Глобальные operator new заменяются только в сборке с
+// -DSEARCH_SERVER_COUNT_ALLOCATIONS, чтобы остальная программа и замеры
+// производительности работали со стандартным распределителем
+namespace {
+
+thread_local size_t heap_allocation_count = 0;
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+constexpr bool IS_HEAP_ALLOCATION_COUNTED = true;
+#else
+constexpr bool IS_HEAP_ALLOCATION_COUNTED = false;
+#endif
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+
+void* AllocateCounted(size_t size, size_t alignment) {
+    ++heap_allocation_count;
+    // aligned_alloc требует размер, кратный выравниванию
+    void* data = alignment <= alignof(max_align_t)
+        ? malloc(size == 0 ? 1 : size)
+        : aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (data == nullptr) {
+        throw bad_alloc();
+    }
+    return data;
+}
+#endif
+
+} // namespace
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+void* operator new(size_t size) {
+    return AllocateCounted(size, alignof(max_align_t));
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return AllocateCounted(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* data) noexcept {
+    free(data);
+}
+
+void operator delete(void* data, size_t) noexcept {
+    free(data);
+}
+
+void operator delete(void* data, align_val_t) noexcept {
+    free(data);
+}
+
+void operator delete(void* data, size_t, align_val_t) noexcept {
+    free(data);
+}
+#endif
+
 // -------- Начало модульных тестов поисковой системы ----------
 
 // ----0----
@@ -808,7 +880,7 @@ void TestGetWordFrequencies() {
 // Тест метода RemoveDocument.
 // Метод должен удалять документ по его id
 void TestRemoveDocument() {
-    // проверка удаления из word_to_document_freqs_ и из из documents_
+    // проверка удаления из списков вхождений и из documents_
     {
         SearchServer server(""s);
         server.AddDocument(0, "test test test_1"s, DocumentStatus::ACTUAL, {0});
@@ -826,7 +898,7 @@ void TestRemoveDocument() {
         }
         const auto iter_1 = find(documents_id.begin(), documents_id.end(), 0);
         const auto iter_2 = documents_id.end();
-        ASSERT_EQUAL(*iter_1, *iter_2);
+        ASSERT(iter_1 == iter_2);
     }
     
     // проверка удаления из word_frequencies_
@@ -995,6 +1067,1946 @@ void TestProcessQueriesJoined() {
         "{ document_id = 4, relevance = 0.167358, rating = 1 }"s);
 }
 
+// ----21----
+// Тест списков вхождений.
+// Обычный и сжатый списки должны хранить одни и те же вхождения по возрастанию
+// порядкового номера документа и находить их, в том числе внутри уже
+// упакованных блоков.
+template <typename List>
+void CheckPostingList(List& postings) {
+    vector<pair<uint32_t, uint32_t>> expected;
+    uint32_t ordinal = 0;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        // разности и количества вхождений разной разрядности
+        ordinal += 1 + (i * 7919) % (i % 3 == 0 ? 5 : 70000);
+        const uint32_t term_count = 1 + (i * 31) % (i % 5 == 0 ? 2 : 300);
+        postings.Append(ordinal, term_count, term_count / 300.0);
+        expected.push_back({ordinal, term_count});
+    }
+
+    const auto collect = [&postings]() {
+        vector<pair<uint32_t, uint32_t>> result;
+        postings.ForEach([&result](uint32_t ordinal, uint32_t term_count) {
+            result.push_back({ordinal, term_count});
+        });
+        return result;
+    };
+
+    ASSERT_EQUAL(postings.size(), expected.size());
+    ASSERT(collect() == expected);
+
+    ASSERT(postings.Contains(expected[0].first));
+    ASSERT(postings.Contains(expected[500].first));
+    ASSERT(postings.Contains(expected.back().first));
+    ASSERT(!postings.Contains(expected[500].first + 1));
+
+    // курсор: последовательный обход, переходы вперёд и верхние оценки блоков
+    {
+        typename List::Cursor cursor(postings);
+        for (const auto& [ordinal, term_count] : expected) {
+            ASSERT(!cursor.AtEnd());
+            ASSERT_EQUAL(cursor.GetOrdinal(), ordinal);
+            ASSERT_EQUAL(cursor.GetTermCount(), term_count);
+            ASSERT(cursor.ShallowAdvance(ordinal));
+            ASSERT(cursor.GetBlockLastOrdinal() >= ordinal);
+            ASSERT(cursor.GetBlockMaxTermFreq() >= term_count / 300.0);
+            cursor.Next();
+        }
+        ASSERT(cursor.AtEnd());
+    }
+    {
+        typename List::Cursor cursor(postings);
+        for (const size_t index : {3u, 3u, 127u, 128u, 400u, 998u}) {
+            cursor.Advance(expected[index].first);
+            ASSERT_EQUAL(cursor.GetOrdinal(), expected[index].first);
+        }
+        cursor.Advance(expected[999].first - 1);
+        ASSERT_EQUAL(cursor.GetOrdinal(), expected[999].first);
+        cursor.Advance(expected[999].first + 1);
+        ASSERT(cursor.AtEnd());
+    }
+}
+
+void TestPostingLists() {
+    {
+        RawPostingList postings;
+        CheckPostingList(postings);
+    }
+    {
+        CompressedPostingList postings;
+        CheckPostingList(postings);
+    }
+}
+
+// ----22----
+// Тест количества возвращаемых документов.
+// FindTopDocuments должен возвращать не более max_result_count лучших документов
+// (по умолчанию MAX_RESULT_DOCUMENT_COUNT) в том же порядке, что и полная сортировка,
+// в том числе при параллельном поиске.
+void TestMaxResultCount() {
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 1000; ++id) {
+        // у документов разная длина и разные рейтинги
+        string text = "pet"s;
+        for (int i = 0; i < id % 7; ++i) {
+            text += " rat"s;
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 13});
+    }
+
+    ASSERT_EQUAL(search_server.FindTopDocuments("pet"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT(search_server.FindTopDocuments("pet"s, DocumentStatus::ACTUAL, 0).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("pet rat"s, DocumentStatus::ACTUAL, 2000).size(), 1000U);
+
+    const auto all_documents = search_server.FindTopDocuments("pet rat"s, DocumentStatus::ACTUAL, 2000);
+    for (const int count : {1, 5, 37, 999}) {
+        const auto seq_documents = search_server.FindTopDocuments(execution::seq, "pet rat"s, DocumentStatus::ACTUAL, count);
+        const auto par_documents = search_server.FindTopDocuments(execution::par, "pet rat"s, DocumentStatus::ACTUAL, count);
+        ASSERT_EQUAL(seq_documents.size(), static_cast<size_t>(count));
+        ASSERT_EQUAL(par_documents.size(), static_cast<size_t>(count));
+        for (int i = 0; i < count; ++i) {
+            ASSERT(std::abs(seq_documents[i].relevance - all_documents[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(seq_documents[i].rating, all_documents[i].rating);
+            ASSERT(std::abs(par_documents[i].relevance - all_documents[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(par_documents[i].rating, all_documents[i].rating);
+        }
+    }
+}
+
+// ----23----
+// Тест поиска с отсечением Block-Max WAND.
+// Результаты search_policy::block_max_wand должны совпадать с полным перебором,
+// в том числе с минус-словами, фильтром по статусу и предикатом.
+void TestBlockMaxWand() {
+    SearchServer search_server("and with"s);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s, "funny"s, "very"s, "not"s};
+    for (int id = 0; id < 3000; ++id) {
+        // частые и редкие слова, документы разной длины
+        string text;
+        for (int i = 0; i < 1 + id % 11; ++i) {
+            text += words[(id * (i + 3) + i * i) % (i % 2 == 0 ? 3 : words.size())] + " "s;
+        }
+        const DocumentStatus status = id % 17 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        search_server.AddDocument(id, text, status, {id % 23 - 11});
+    }
+    for (int id = 0; id < 3000; id += 29) {
+        search_server.RemoveDocument(id);
+    }
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT(std::abs(lhs[i].relevance - rhs[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    const vector<string> queries = {
+        "pet"s, "pet rat cat"s, "curly hair -pet"s, "nasty funny very not -dog"s,
+        "dog hair curly nasty funny very not pet rat cat"s, "missing"s, "-pet rat"s
+    };
+    for (const string& query : queries) {
+        for (const int count : {1, 5, 50}) {
+            check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, query, DocumentStatus::ACTUAL, count),
+                        search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, count));
+            check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, query, DocumentStatus::BANNED, count),
+                        search_server.FindTopDocuments(query, DocumentStatus::BANNED, count));
+            const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+                return document_id % 3 == 0 && rating > 0;
+            };
+            check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, query, predicate, count),
+                        search_server.FindTopDocuments(query, predicate, count));
+        }
+        check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, query),
+                    search_server.FindTopDocuments(query));
+    }
+}
+
+// ----24----
+void TestInverseDocumentFreqCache() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(0, "белый кот и модный ошейник"s,        DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s,       DocumentStatus::ACTUAL, {2});
+    search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, {3});
+
+    // IDF пересчитывается после добавления документа
+    {
+        const auto find_document = search_server.FindTopDocuments("кот"s);
+        ASSERT_EQUAL(find_document.size(), 2U);
+        ASSERT_EQUAL(find_document[0].id, 1);
+        ASSERT(std::abs(find_document[0].relevance - (1.0 / 4.0) * log(3.0 / 2.0)) < MAXIMUM_MEASUREMENT_ERROR);
+    }
+    search_server.AddDocument(3, "кот"s, DocumentStatus::ACTUAL, {4});
+    {
+        const auto find_document = search_server.FindTopDocuments("кот"s);
+        ASSERT_EQUAL(find_document.size(), 3U);
+        ASSERT_EQUAL(find_document[0].id, 3);
+        ASSERT(std::abs(find_document[0].relevance - log(4.0 / 3.0)) < MAXIMUM_MEASUREMENT_ERROR);
+    }
+
+    // и после удаления, в том числе параллельного
+    search_server.RemoveDocument(2);
+    {
+        const auto find_document = search_server.FindTopDocuments(execution::par, "кот"s);
+        ASSERT_EQUAL(find_document.size(), 3U);
+        // слово есть во всех документах: релевантность нулевая, но документы найдены
+        for (const Document& document : find_document) {
+            ASSERT(std::abs(document.relevance) < MAXIMUM_MEASUREMENT_ERROR);
+        }
+        ASSERT_EQUAL(find_document[0].id, 3);
+        ASSERT_EQUAL(find_document[2].id, 0);
+        ASSERT_EQUAL(search_server.FindTopDocuments("кот"s).size(), 3U);
+        ASSERT_EQUAL(search_server.FindTopDocuments(search_policy::block_max_wand, "кот"s).size(), 3U);
+    }
+    search_server.RemoveDocument(execution::par, 3);
+    {
+        const auto find_document = search_server.FindTopDocuments(execution::par, "пушистый кот"s);
+        ASSERT_EQUAL(find_document.size(), 2U);
+        ASSERT_EQUAL(find_document[0].id, 1);
+        ASSERT(std::abs(find_document[0].relevance - 0.5 * log(2.0)) < MAXIMUM_MEASUREMENT_ERROR);
+        ASSERT(std::abs(find_document[1].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+    }
+    search_server.RemoveDocument(0);
+    search_server.RemoveDocument(1);
+    ASSERT(search_server.FindTopDocuments("кот"s).empty());
+}
+
+// ----25----
+void TestScoreAccumulator() {
+    {
+        ScoreAccumulator::Lease accumulator(10);
+        accumulator->Exclude(3);
+        accumulator->Add(7, 0.5);
+        accumulator->Add(3, 1.0);
+        accumulator->Add(1, 0.25);
+        accumulator->Add(7, 0.5);
+        {
+            // вложенный поиск получает отдельный накопитель
+            ScoreAccumulator::Lease nested_accumulator(10);
+            nested_accumulator->Add(7, 2.0);
+        }
+        vector<pair<uint32_t, double>> scores;
+        accumulator->ForEach([&scores](uint32_t ordinal, double relevance) {
+            scores.push_back({ordinal, relevance});
+        });
+        ASSERT_EQUAL(scores.size(), 2U);
+        ASSERT_EQUAL(scores[0].first, 1U);
+        ASSERT_EQUAL(scores[1].first, 7U);
+        ASSERT(std::abs(scores[1].second - 1.0) < MAXIMUM_MEASUREMENT_ERROR);
+    }
+    {
+        // накопитель потока очищен после предыдущего запроса
+        ScoreAccumulator::Lease accumulator(20);
+        int count = 0;
+        accumulator->ForEach([&count](uint32_t, double) {
+            ++count;
+        });
+        ASSERT_EQUAL(count, 0);
+        ASSERT(!accumulator->IsExcluded(3));
+    }
+
+    // параллельный поиск исключает документы с минус-словами так же, как последовательный
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 2000; ++id) {
+        search_server.AddDocument(id, id % 3 == 0 ? "curly cat"s : (id % 3 == 1 ? "curly dog"s : "nasty cat"s),
+                                  DocumentStatus::ACTUAL, {id % 7});
+    }
+    for (const string& query : {"curly -cat"s, "cat -nasty"s, "curly cat -dog -nasty"s}) {
+        const auto seq_documents = search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 3000);
+        const auto par_documents = search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 3000);
+        ASSERT_EQUAL(seq_documents.size(), 667U);
+        ASSERT_EQUAL(par_documents.size(), seq_documents.size());
+        for (size_t i = 0; i < seq_documents.size(); ++i) {
+            ASSERT(std::abs(seq_documents[i].relevance - par_documents[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(seq_documents[i].rating, par_documents[i].rating);
+        }
+    }
+}
+
+// ----26----
+void TestParallelPartitions() {
+    SearchServer search_server("and with"s);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s};
+    for (int id = 0; id < 5000; ++id) {
+        string text;
+        for (int i = 0; i < 1 + id % 5; ++i) {
+            text += words[(id * (i + 7) + i) % words.size()] + " "s;
+        }
+        search_server.AddDocument(id, text, id % 11 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 19});
+    }
+    // удалённые документы оставляют пропуски в диапазоне порядковых номеров
+    for (int id = 1000; id < 2500; ++id) {
+        search_server.RemoveDocument(id);
+    }
+
+    const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+        return document_id % 2 == 0;
+    };
+    for (const string& query : {"pet"s, "curly hair -rat"s, "cat dog nasty -pet -hair"s, "missing"s}) {
+        for (const int count : {1, 5, 100, 5000}) {
+            const auto seq_documents = search_server.FindTopDocuments(execution::seq, query, predicate, count);
+            const auto par_documents = search_server.FindTopDocuments(execution::par, query, predicate, count);
+            ASSERT_EQUAL(par_documents.size(), seq_documents.size());
+            for (size_t i = 0; i < seq_documents.size(); ++i) {
+                ASSERT(std::abs(seq_documents[i].relevance - par_documents[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+                ASSERT_EQUAL(seq_documents[i].rating, par_documents[i].rating);
+            }
+        }
+        ASSERT_EQUAL(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED).size(),
+                     search_server.FindTopDocuments(query, DocumentStatus::BANNED).size());
+    }
+}
+
+// ----27----
+void TestDocumentBitmaps() {
+    {
+        DocumentBitmap bitmap;
+        // плотный контейнер, разреженный контейнер и пустой контейнер между ними
+        for (uint32_t ordinal = 0; ordinal < 65536; ordinal += 3) {
+            bitmap.Add(ordinal);
+        }
+        bitmap.Add(3 * 65536 + 5);
+        bitmap.Add(3 * 65536 + 1);
+        ASSERT_EQUAL(bitmap.size(), 21846U + 2U);
+        ASSERT(bitmap.Contains(65535));
+        ASSERT(!bitmap.Contains(65534));
+        ASSERT(bitmap.Contains(3 * 65536 + 1));
+        ASSERT(!bitmap.Contains(2 * 65536 + 1));
+
+        uint64_t words[3];
+        bitmap.CopyWords(3 * 1024, 3 * 1024 + 3, words);
+        ASSERT_EQUAL(words[0], (uint64_t{1} << 1) | (uint64_t{1} << 5));
+        ASSERT_EQUAL(words[1], 0U);
+        bitmap.CopyWords(0, 1, words);
+        ASSERT_EQUAL(words[0], 0x9249249249249249U);
+
+        // плотный контейнер снова становится массивом
+        for (uint32_t ordinal = 0; ordinal < 65536; ordinal += 3) {
+            if (ordinal % 4 != 0) {
+                ASSERT(bitmap.Remove(ordinal));
+            }
+        }
+        ASSERT(!bitmap.Remove(1));
+        ASSERT(bitmap.Contains(12));
+        ASSERT(!bitmap.Contains(3));
+        vector<uint32_t> ordinals;
+        bitmap.ForEach([&ordinals](uint32_t ordinal) {
+            ordinals.push_back(ordinal);
+        });
+        ASSERT_EQUAL(ordinals.size(), bitmap.size());
+        ASSERT(is_sorted(ordinals.begin(), ordinals.end()));
+        ASSERT_EQUAL(ordinals.back(), 3U * 65536 + 5);
+    }
+    {
+        // пакетное удаление из плотного контейнера, массива и отсутствующего контейнера
+        DocumentBitmap bitmap;
+        DocumentBitmap expected;
+        for (uint32_t ordinal = 0; ordinal < 2 * 65536; ordinal += ordinal < 65536 ? 2 : 97) {
+            bitmap.Add(ordinal);
+            expected.Add(ordinal);
+        }
+        vector<uint32_t> to_remove;
+        for (uint32_t ordinal = 1; ordinal < 3 * 65536; ordinal += 5) {
+            to_remove.push_back(ordinal);
+        }
+        size_t removed_count = 0;
+        for (const uint32_t ordinal : to_remove) {
+            removed_count += expected.Remove(ordinal);
+        }
+        ASSERT_EQUAL(bitmap.RemoveSorted(to_remove.data(), to_remove.data() + to_remove.size()), removed_count);
+        ASSERT_EQUAL(bitmap.size(), expected.size());
+        vector<uint32_t> ordinals;
+        bitmap.ForEach([&ordinals](uint32_t ordinal) {
+            ordinals.push_back(ordinal);
+        });
+        vector<uint32_t> expected_ordinals;
+        expected.ForEach([&expected_ordinals](uint32_t ordinal) {
+            expected_ordinals.push_back(ordinal);
+        });
+        ASSERT(ordinals == expected_ordinals);
+    }
+
+    // результаты поиска не зависят от того, какие слова хранят битовые карты
+    SearchServer search_server("and with"s);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s};
+    for (int id = 0; id < 3000; ++id) {
+        string text;
+        for (int i = 0; i < 1 + id % 4; ++i) {
+            text += words[(id * (i + 5) + i) % (i == 0 ? 2 : words.size())] + " "s;
+        }
+        search_server.AddDocument(id, text, static_cast<DocumentStatus>(id % 3), {id % 17});
+    }
+    for (int id = 0; id < 3000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    const vector<string> queries = {"pet rat"s, "curly -pet"s, "cat dog -rat -hair"s, "nasty hair -cat"s};
+    const auto find_all = [&search_server, &queries]() {
+        vector<vector<Document>> results;
+        for (const string& query : queries) {
+            results.push_back(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 3000));
+            results.push_back(search_server.FindTopDocuments(execution::par, query, DocumentStatus::IRRELEVANT, 3000));
+            results.push_back(search_server.FindTopDocuments(search_policy::block_max_wand, query, DocumentStatus::BANNED, 10));
+            results.push_back(search_server.FindTopDocuments(query, [](int document_id, DocumentStatus status, int rating) {
+                return rating > 5;
+            }, 3000));
+        }
+        return results;
+    };
+    const auto match_all = [&search_server, &queries]() {
+        vector<vector<string_view>> results;
+        for (const string& query : queries) {
+            for (int id = 1; id < 3000; id += 97) {
+                if (id % 7 != 0) {
+                    results.push_back(get<0>(search_server.MatchDocument(query, id)));
+                    results.push_back(get<0>(search_server.MatchDocument(execution::par, query, id)));
+                }
+            }
+        }
+        return results;
+    };
+
+    search_server.SetDenseTermShare(2.0);
+    const auto sparse_documents = find_all();
+    const auto sparse_matches = match_all();
+    search_server.SetDenseTermShare(0.0);
+    const auto dense_documents = find_all();
+    const auto dense_matches = match_all();
+
+    ASSERT_EQUAL(sparse_documents.size(), dense_documents.size());
+    for (size_t i = 0; i < sparse_documents.size(); ++i) {
+        ASSERT_EQUAL(sparse_documents[i].size(), dense_documents[i].size());
+        for (size_t j = 0; j < sparse_documents[i].size(); ++j) {
+            ASSERT_EQUAL(sparse_documents[i][j].id, dense_documents[i][j].id);
+        }
+    }
+    ASSERT(sparse_matches == dense_matches);
+
+    // битовые карты обновляются при добавлении и удалении документов
+    search_server.AddDocument(5000, "pet curly"s, DocumentStatus::ACTUAL, {100});
+    ASSERT_EQUAL(search_server.FindTopDocuments("pet curly"s)[0].id, 5000);
+    ASSERT(search_server.FindTopDocuments("rat -pet"s).size() > 0U);
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument("curly"s, 5000)).size(), 1U);
+    search_server.RemoveDocument(5000);
+    for (const Document& document : search_server.FindTopDocuments("pet curly"s, DocumentStatus::ACTUAL, 3000)) {
+        ASSERT(document.id != 5000);
+    }
+}
+
+// ----28----
+void TestConjunctiveQueries() {
+    SearchServer search_server("and with"s);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s, "funny"s};
+    for (int id = 0; id < 4000; ++id) {
+        // слово "common" есть во всех документах, его IDF нулевая
+        string text = "common"s;
+        for (int i = 0; i < 1 + id % 6; ++i) {
+            text += " "s + words[(id * (i + 3) + i * i) % words.size()];
+        }
+        search_server.AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 13});
+    }
+    for (int id = 0; id < 4000; id += 9) {
+        search_server.RemoveDocument(id);
+    }
+
+    // документы со всеми словами - это найденные любым словом документы, в которых совпали все плюс-слова
+    const auto find_all_words = [&search_server](const string& query, size_t plus_word_count, auto predicate) {
+        vector<Document> documents;
+        for (const Document& document : search_server.FindTopDocuments(query, predicate, 5000)) {
+            if (get<0>(search_server.MatchDocument(query, document.id)).size() == plus_word_count) {
+                documents.push_back(document);
+            }
+        }
+        return documents;
+    };
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT(std::abs(lhs[i].relevance - rhs[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+    const auto actual = [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    const auto odd_rating = [](int document_id, DocumentStatus status, int rating) {
+        return rating % 2 == 1;
+    };
+
+    const vector<pair<string, size_t>> queries = {
+        {"pet rat"s, 2}, {"curly hair cat -dog"s, 3}, {"nasty funny -pet -rat"s, 2},
+        {"common pet"s, 2}, {"common"s, 1}, {"pet missing"s, 2}, {"pet -pet"s, 1}
+    };
+    for (const auto& [query, plus_word_count] : queries) {
+        const auto expected = find_all_words(query, plus_word_count, actual);
+        check_equal(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 5000, QueryMode::ALL_WORDS), expected);
+        check_equal(search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 5000, QueryMode::ALL_WORDS), expected);
+        check_equal(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 5000, QueryMode::ALL_WORDS), expected);
+
+        auto top_expected = expected;
+        top_expected.resize(min<size_t>(top_expected.size(), 7));
+        check_equal(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 7, QueryMode::ALL_WORDS), top_expected);
+
+        const auto expected_by_rating = find_all_words(query, plus_word_count, odd_rating);
+        check_equal(search_server.FindTopDocuments(query, odd_rating, 5000, QueryMode::ALL_WORDS), expected_by_rating);
+        check_equal(search_server.FindTopDocuments(execution::par, query, odd_rating, 5000, QueryMode::ALL_WORDS), expected_by_rating);
+    }
+    ASSERT(search_server.FindTopDocuments("pet missing"s, DocumentStatus::ACTUAL, 5, QueryMode::ALL_WORDS).empty());
+
+    const vector<string> raw_queries = {"pet rat"s, "curly hair cat -dog"s, "common"s};
+    const auto results = ProcessQueries(search_server, raw_queries, QueryMode::ALL_WORDS);
+    ASSERT_EQUAL(results.size(), raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        check_equal(results[i], search_server.FindTopDocuments(raw_queries[i], DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ALL_WORDS));
+    }
+}
+
+// ----29----
+void TestSegmentedIndex() {
+    // в первом сервере буфер записи вмещает весь индекс, во втором сегментов много
+    SearchServer single_segment_server("and with"s);
+    SearchServer search_server("and with"s);
+    search_server.SetWriteBufferSize(16);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s, "funny"s, "eye"s};
+    const auto add_documents = [&](int first_id, int last_id) {
+        for (int id = first_id; id < last_id; ++id) {
+            string text;
+            for (int i = 0; i < 1 + id % 5; ++i) {
+                text += " "s + words[(id * (i + 5) + i * i) % words.size()];
+            }
+            const DocumentStatus status = id % 7 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            single_segment_server.AddDocument(id, text, status, {id % 11});
+            search_server.AddDocument(id, text, status, {id % 11});
+        }
+    };
+    const auto remove_documents = [&](int first_id, int last_id, int step) {
+        for (int id = first_id; id < last_id; id += step) {
+            single_segment_server.RemoveDocument(id);
+            search_server.RemoveDocument(execution::par, id);
+        }
+    };
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT(std::abs(lhs[i].relevance - rhs[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+    const vector<string> queries = {"pet rat"s, "curly hair -dog"s, "nasty funny eye -pet"s, "cat"s, "dog -dog"s};
+    const auto check_servers = [&]() {
+        ASSERT_EQUAL(search_server.GetDocumentCount(), single_segment_server.GetDocumentCount());
+        for (const string& query : queries) {
+            const auto expected = single_segment_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 5000);
+            check_equal(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 5000), expected);
+            check_equal(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 5000), expected);
+            check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, query, DocumentStatus::ACTUAL, 10),
+                        single_segment_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 10));
+            check_equal(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED, 5000, QueryMode::ALL_WORDS),
+                        single_segment_server.FindTopDocuments(query, DocumentStatus::BANNED, 5000, QueryMode::ALL_WORDS));
+            for (const int document_id : search_server) {
+                ASSERT(search_server.MatchDocument(query, document_id) == single_segment_server.MatchDocument(query, document_id));
+            }
+        }
+    };
+
+    add_documents(0, 2000);
+    remove_documents(0, 2000, 3);
+    check_servers();
+
+    search_server.WaitForSegmentMerges();
+    ASSERT(search_server.GetSegmentCount() < 2000 / 16);
+    check_servers();
+
+    // документы, добавленные и удалённые после слияния
+    add_documents(2000, 2500);
+    remove_documents(1, 2500, 10);
+    check_servers();
+    search_server.WaitForSegmentMerges();
+    check_servers();
+
+    // слияния в пуле без рабочих потоков выполняются при ожидании; Compact
+    // не переписывает сегмент, из которого слияние уже вычистило удалённый документ
+    {
+        SegmentedIndex index(make_shared<TaskExecutor>(0));
+        index.SetWriteBufferSize(1);
+        const vector<pair<TermId, uint32_t>> term_counts = {{0, 1}};
+        for (uint32_t ordinal = 0; ordinal < SegmentedIndex::MERGE_FACTOR; ++ordinal) {
+            index.AddDocument(ordinal, 1.0, term_counts);
+        }
+        index.RemoveDocument(1);
+        index.WaitForMerges();
+        ASSERT_EQUAL(index.GetSegmentCount(), 1U);
+        index.AddDocument(SegmentedIndex::MERGE_FACTOR, 1.0, term_counts);
+        index.RemoveDocument(SegmentedIndex::MERGE_FACTOR);
+        const IndexSnapshot before = index.GetSnapshot();
+        ASSERT(before.GetSegments()[0]->IsPurged(1));
+        index.Compact();
+        const IndexSnapshot after = index.GetSnapshot();
+        ASSERT(after.GetSegments()[0] == before.GetSegments()[0]);
+        ASSERT(after.GetSegments()[1] != before.GetSegments()[1]);
+        ASSERT(!after.Contains(0, SegmentedIndex::MERGE_FACTOR));
+        ASSERT(after.Contains(0, 0));
+        ASSERT(!index.IsRemoved(1));
+    }
+}
+
+// ----30----
+void TestSnapshots() {
+    {
+        SearchServer search_server("and with"s);
+        search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7});
+        search_server.AddDocument(2, "funny dog"s, DocumentStatus::ACTUAL, {1});
+        // без публикации снимок видит пустой сервер
+        ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 0);
+        search_server.PublishSnapshot();
+
+        const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+        search_server.RemoveDocument(1);
+        search_server.AddDocument(3, "curly dog"s, DocumentStatus::ACTUAL, {2});
+        search_server.PublishSnapshot();
+
+        ASSERT_EQUAL(snapshot->GetDocumentCount(), 2);
+        const auto documents = snapshot->FindTopDocuments("curly"s);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT_EQUAL(documents[0].id, 1);
+        ASSERT(get<0>(snapshot->MatchDocument("curly dog"s, 1)) == vector<string_view>{"curly"sv});
+        ASSERT_EQUAL(snapshot->GetWordFrequencies(1).size(), 3u);
+
+        const SearchServer::Snapshot new_snapshot = search_server.GetSnapshot();
+        ASSERT(new_snapshot.GetVersion() > snapshot.GetVersion());
+        ASSERT_EQUAL(new_snapshot->GetDocumentCount(), 2);
+        const auto new_documents = new_snapshot->FindTopDocuments("curly"s);
+        ASSERT_EQUAL(new_documents.size(), 1u);
+        ASSERT_EQUAL(new_documents[0].id, 3);
+        ASSERT(new_snapshot->GetWordFrequencies(1).empty());
+
+        // публикация после каждого изменения
+        search_server.SetSnapshotPublishInterval(1);
+        search_server.AddDocument(4, "funny cat"s, DocumentStatus::ACTUAL, {3});
+        ASSERT_EQUAL(search_server.GetSnapshot()->GetDocumentCount(), 3);
+    }
+
+    SearchServer search_server("and with"s);
+    search_server.SetWriteBufferSize(64);
+    search_server.SetSnapshotPublishInterval(4);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "nasty"s, "funny"s};
+    const auto make_text = [&words](int id) {
+        string text = words[id % words.size()];
+        for (int i = 0; i < id % 4; ++i) {
+            text += " "s + words[(id * (i + 3)) % words.size()];
+        }
+        return text;
+    };
+
+    atomic<bool> is_stopped = false;
+    const auto read_snapshots = [&]() {
+        uint64_t last_version = 0;
+        while (!is_stopped) {
+            const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+            ASSERT(snapshot.GetVersion() >= last_version);
+            last_version = snapshot.GetVersion();
+            ASSERT_EQUAL(distance(snapshot->begin(), snapshot->end()), snapshot->GetDocumentCount());
+            for (const Document& document : snapshot->FindTopDocuments(execution::par, "pet curly -dog"s, DocumentStatus::ACTUAL, 50)) {
+                const auto [matched_words, status] = snapshot->MatchDocument("pet curly -dog"s, document.id);
+                ASSERT(!matched_words.empty());
+                ASSERT(!snapshot->GetWordFrequencies(document.id).empty());
+            }
+        }
+    };
+    vector<thread> readers;
+    for (int i = 0; i < 2; ++i) {
+        readers.emplace_back(read_snapshots);
+    }
+    for (int id = 0; id < 3000; ++id) {
+        search_server.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, {id % 7});
+        if (id % 3 == 2) {
+            search_server.RemoveDocument(id - 2);
+        }
+    }
+    is_stopped = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+
+    search_server.PublishSnapshot();
+    const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+    ASSERT_EQUAL(snapshot->GetDocumentCount(), search_server.GetDocumentCount());
+    const auto expected = search_server.FindTopDocuments("pet curly -dog"s, DocumentStatus::ACTUAL, 5000);
+    const auto documents = snapshot->FindTopDocuments("pet curly -dog"s, DocumentStatus::ACTUAL, 5000);
+    ASSERT_EQUAL(documents.size(), expected.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ASSERT_EQUAL(documents[i].id, expected[i].id);
+    }
+}
+
+// ----31----
+void TestCompaction() {
+    SearchServer search_server("and with"s);
+    // сжатие только явным вызовом
+    search_server.SetCompactionThreshold(2.0);
+    search_server.SetWriteBufferSize(32);
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s};
+    vector<int> document_ids;
+    for (int i = 0; i < 500; ++i) {
+        // id не совпадают с порядком добавления
+        const int id = (i * 7919) % 1000;
+        string text = words[i % words.size()];
+        for (int j = 0; j < i % 3; ++j) {
+            text += " "s + words[(i * (j + 2)) % words.size()];
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {i % 5});
+        document_ids.push_back(id);
+    }
+
+    const vector<string> queries = {"pet"s, "curly hair -dog"s, "rat cat"s};
+    const auto find_all = [&search_server, &queries]() {
+        vector<vector<Document>> results;
+        for (const string& query : queries) {
+            results.push_back(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 1000));
+        }
+        return results;
+    };
+    const auto check_equal = [](const vector<vector<Document>>& lhs, const vector<vector<Document>>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].size(), rhs[i].size());
+            for (size_t j = 0; j < lhs[i].size(); ++j) {
+                ASSERT_EQUAL(lhs[i][j].id, rhs[i][j].id);
+                ASSERT(std::abs(lhs[i][j].relevance - rhs[i][j].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            }
+        }
+    };
+
+    // удаляется каждый третий документ, в том числе первый и последний
+    vector<int> remaining_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        if (i % 3 == 0 || i + 1 == document_ids.size()) {
+            search_server.RemoveDocument(document_ids[i]);
+        } else {
+            remaining_ids.push_back(document_ids[i]);
+        }
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), static_cast<int>(remaining_ids.size()));
+    ASSERT_EQUAL(search_server.GetRemovedDocumentCount(), document_ids.size() - remaining_ids.size());
+    ASSERT(vector<int>(search_server.begin(), search_server.end()) == remaining_ids);
+    ASSERT_EQUAL(*prev(search_server.end()), remaining_ids.back());
+    // доступ по номеру в порядке добавления не обходит список документов
+    const auto check_document_ids = [&search_server](const vector<int>& expected_ids) {
+        for (size_t i = 0; i < expected_ids.size(); ++i) {
+            ASSERT_EQUAL(search_server.GetDocumentId(static_cast<int>(i)), expected_ids[i]);
+        }
+    };
+    check_document_ids(remaining_ids);
+
+    const auto before_compaction = find_all();
+    for (const auto& documents : before_compaction) {
+        for (const Document& document : documents) {
+            ASSERT(find(remaining_ids.begin(), remaining_ids.end(), document.id) != remaining_ids.end());
+        }
+    }
+    search_server.Compact();
+    ASSERT_EQUAL(search_server.GetRemovedDocumentCount(), 0u);
+    check_equal(find_all(), before_compaction);
+    ASSERT(vector<int>(search_server.begin(), search_server.end()) == remaining_ids);
+    check_document_ids(remaining_ids);
+
+    // повторное добавление удалённого id и сжатие по порогу
+    search_server.AddDocument(document_ids[0], "pet curly"s, DocumentStatus::ACTUAL, {1});
+    remaining_ids.push_back(document_ids[0]);
+    ASSERT_EQUAL(*prev(search_server.end()), document_ids[0]);
+    search_server.SetCompactionThreshold(0.1);
+    for (size_t i = 0; i < 40; ++i) {
+        search_server.RemoveDocument(remaining_ids[i]);
+    }
+    remaining_ids.erase(remaining_ids.begin(), remaining_ids.begin() + 40);
+    ASSERT(search_server.GetRemovedDocumentCount() < 40);
+    ASSERT(vector<int>(search_server.begin(), search_server.end()) == remaining_ids);
+    check_document_ids(remaining_ids);
+    const auto after_removal = find_all();
+    search_server.Compact();
+    check_equal(find_all(), after_removal);
+}
+
+// ----32----
+template <typename RemoveFunction>
+void CheckRemoveDocuments(RemoveFunction remove_documents) {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "fancy"s, "collar"s};
+    const auto build = [&words](SearchServer& search_server) {
+        search_server.SetCompactionThreshold(2.0);
+        search_server.SetDenseTermShare(0.3);
+        for (int i = 0; i < 300; ++i) {
+            string text = words[i % words.size()];
+            for (int j = 1; j <= i % 4; ++j) {
+                text += " "s + words[(i * j + j) % words.size()];
+            }
+            search_server.AddDocument(i, text, static_cast<DocumentStatus>(i % 2), {i % 7});
+        }
+        // слово только в удаляемых документах
+        search_server.AddDocument(1000, "unique pet"s, DocumentStatus::ACTUAL, {1});
+        search_server.AddDocument(1001, "unique cat"s, DocumentStatus::ACTUAL, {1});
+    };
+
+    SearchServer expected("and with"s);
+    build(expected);
+    SearchServer actual("and with"s);
+    build(actual);
+
+    vector<int> document_ids = {1000, 1001};
+    for (int i = 0; i < 300; i += 3) {
+        document_ids.push_back(i);
+    }
+    for (const int document_id : document_ids) {
+        expected.RemoveDocument(document_id);
+    }
+    // отсутствующий и повторный id
+    document_ids.push_back(5000);
+    document_ids.push_back(3);
+    remove_documents(actual, document_ids);
+
+    ASSERT_EQUAL(actual.GetDocumentCount(), expected.GetDocumentCount());
+    ASSERT(vector<int>(actual.begin(), actual.end()) == vector<int>(expected.begin(), expected.end()));
+    ASSERT(actual.FindTopDocuments("unique"s).empty());
+    for (const string& word : words) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT}) {
+            const auto actual_documents = actual.FindTopDocuments(word + " -hair"s, status, 1000);
+            const auto expected_documents = expected.FindTopDocuments(word + " -hair"s, status, 1000);
+            ASSERT_EQUAL(actual_documents.size(), expected_documents.size());
+            for (size_t i = 0; i < actual_documents.size(); ++i) {
+                ASSERT_EQUAL(actual_documents[i].id, expected_documents[i].id);
+                ASSERT(std::abs(actual_documents[i].relevance - expected_documents[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+            }
+        }
+    }
+    actual.Compact();
+    ASSERT_EQUAL(actual.FindTopDocuments("pet"s, DocumentStatus::ACTUAL, 1000).size(),
+        expected.FindTopDocuments("pet"s, DocumentStatus::ACTUAL, 1000).size());
+}
+
+void TestRemoveDocuments() {
+    CheckRemoveDocuments([](SearchServer& search_server, const vector<int>& document_ids) {
+        search_server.RemoveDocuments(document_ids);
+    });
+    CheckRemoveDocuments([](SearchServer& search_server, const vector<int>& document_ids) {
+        search_server.RemoveDocuments(execution::par, document_ids);
+    });
+
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, {1});
+    search_server.RemoveDocuments({});
+    search_server.RemoveDocuments({2, 3});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 1);
+    search_server.RemoveDocuments(execution::par, {1});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 0);
+    ASSERT(search_server.FindTopDocuments("cat"s).empty());
+}
+
+void CheckSameIndex(const SearchServer& actual, const SearchServer& expected, const vector<string>& queries) {
+    ASSERT_EQUAL(actual.GetDocumentCount(), expected.GetDocumentCount());
+    ASSERT(vector<int>(actual.begin(), actual.end()) == vector<int>(expected.begin(), expected.end()));
+    for (const int document_id : expected) {
+        ASSERT(actual.GetWordFrequencies(document_id) == expected.GetWordFrequencies(document_id));
+    }
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+    for (const string& query : queries) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            check_equal(actual.FindTopDocuments(query, status, 5000), expected.FindTopDocuments(query, status, 5000));
+            check_equal(actual.FindTopDocuments(execution::par, query, status, 5000), expected.FindTopDocuments(execution::par, query, status, 5000));
+        }
+        check_equal(actual.FindTopDocuments(search_policy::block_max_wand, query), expected.FindTopDocuments(search_policy::block_max_wand, query));
+    }
+}
+
+// ----33----
+void TestAddDocumentBatch() {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "and"s, "fancy"s, "collar"s, "nasty"s};
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        string text;
+        // редкие слова появляются только в конце пакета
+        const int word_count = 1 + i % 6;
+        for (int j = 0; j < word_count; ++j) {
+            text += words[(i * (j + 3) + j) % (i < 1500 ? 6 : words.size())] + " "s;
+        }
+        texts.push_back(text + (i % 500 == 0 ? "rare"s + to_string(i) : ""s));
+    }
+    vector<NewDocument> documents;
+    for (int i = 0; i < 3000; ++i) {
+        documents.push_back({(i * 37) % 3000, texts[i], static_cast<DocumentStatus>(i % 3), {i % 11, i % 5}});
+    }
+    const vector<string> queries = {"pet rat"s, "curly -pet"s, "cat dog -rat -hair"s, "nasty collar -cat"s, "rare500 fancy"s};
+
+    {
+        SearchServer expected("and with"s);
+        SearchServer actual("and with"s);
+        for (SearchServer* search_server : {&expected, &actual}) {
+            search_server->SetDenseTermShare(0.2);
+            search_server->SetWriteBufferSize(700);
+            search_server->AddDocument(5000, "pet curly"s, DocumentStatus::ACTUAL, {3});
+        }
+        for (const NewDocument& document : documents) {
+            expected.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        actual.AddDocuments(execution::par, documents);
+        CheckSameIndex(actual, expected, queries);
+
+        // следующий пакет дополняет уже построенный индекс
+        const vector<NewDocument> more_documents = {{6000, "fancy rat", DocumentStatus::ACTUAL, {}}, {6001, "rare collar", DocumentStatus::BANNED, {1}}};
+        expected.AddDocuments(more_documents);
+        actual.AddDocuments(execution::par, more_documents);
+        CheckSameIndex(actual, expected, queries);
+    }
+
+    // отвергнутый документ: недопустимый символ, повторный id внутри пакета, существующий id, отрицательный id
+    const string invalid_text = "curly d\x12og"s;
+    for (int variant = 0; variant < 4; ++variant) {
+        vector<NewDocument> batch = documents;
+        const size_t invalid_index = 1234;
+        if (variant == 0) {
+            batch[invalid_index].text = invalid_text;
+        } else if (variant == 1) {
+            batch[invalid_index].id = batch[17].id;
+        } else if (variant == 2) {
+            batch[invalid_index].id = 5000;
+        } else {
+            batch[invalid_index].id = -1;
+        }
+        SearchServer expected("and with"s);
+        SearchServer actual("and with"s);
+        for (SearchServer* search_server : {&expected, &actual}) {
+            search_server->AddDocument(5000, "pet curly"s, DocumentStatus::ACTUAL, {3});
+        }
+        for (size_t i = 0; i < invalid_index; ++i) {
+            expected.AddDocument(batch[i].id, batch[i].text, batch[i].status, batch[i].ratings);
+        }
+        try {
+            actual.AddDocuments(execution::par, batch);
+            ASSERT_HINT(false, "invalid document must be rejected"s);
+        } catch (const invalid_argument&) {
+        }
+        CheckSameIndex(actual, expected, queries);
+    }
+
+    // с пропуском отвергнутых добавляются все остальные документы, как вызовами
+    // AddDocument с перехватом исключений; id отвергнутого документа не занят
+    {
+        vector<NewDocument> batch = documents;
+        batch[100].text = invalid_text;
+        batch[300].text = invalid_text;
+        batch[2600].id = batch[300].id;
+        batch[1500].id = batch[17].id;
+        batch[2000].id = 5000;
+        batch[2500].id = -1;
+        SearchServer expected("and with"s);
+        SearchServer actual("and with"s);
+        for (SearchServer* search_server : {&expected, &actual}) {
+            search_server->SetWriteBufferSize(700);
+            search_server->AddDocument(5000, "pet curly"s, DocumentStatus::ACTUAL, {3});
+        }
+        vector<size_t> expected_rejected;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            try {
+                expected.AddDocument(batch[i].id, batch[i].text, batch[i].status, batch[i].ratings);
+            } catch (const invalid_argument&) {
+                expected_rejected.push_back(i);
+            }
+        }
+        vector<size_t> rejected = {42};
+        actual.AddDocuments(execution::par, batch, rejected);
+        ASSERT(rejected == expected_rejected);
+        ASSERT(rejected == vector<size_t>({100, 300, 1500, 2000, 2500}));
+        CheckSameIndex(actual, expected, {"pet rat"s, "rare1500"s, "rare2000 curly"s, "cat dog -rat -hair"s});
+    }
+}
+
+// ----34----
+void TestCorpusIngestion() {
+    {
+        BoundedQueue<int> queue(8);
+        const int value_count = 20000;
+        atomic<long long> sum = 0;
+        vector<thread> threads;
+        for (int producer = 0; producer < 2; ++producer) {
+            threads.emplace_back([&queue, producer] {
+                for (int value = producer; value < value_count; value += 2) {
+                    queue.Push(value);
+                }
+            });
+        }
+        for (int consumer = 0; consumer < 2; ++consumer) {
+            threads.emplace_back([&queue, &sum] {
+                int value = 0;
+                while (queue.Pop(value)) {
+                    sum += value;
+                }
+            });
+        }
+        threads[0].join();
+        threads[1].join();
+        queue.Close();
+        threads[2].join();
+        threads[3].join();
+        ASSERT_EQUAL(sum.load(), 1LL * value_count * (value_count - 1) / 2);
+    }
+    {
+        // писатель засыпает на заполненной очереди, читатель - на пустой,
+        // оба просыпаются от сигнала другой стороны или закрытия
+        BoundedQueue<int> queue(2);
+        const int value_count = 50;
+        thread producer([&queue] {
+            for (int value = 0; value < value_count; ++value) {
+                queue.Push(value);
+            }
+        });
+        vector<int> values;
+        int value = 0;
+        for (int i = 0; i < value_count; ++i) {
+            this_thread::sleep_for(chrono::microseconds(200));
+            ASSERT(queue.Pop(value));
+            values.push_back(value);
+        }
+        producer.join();
+        vector<int> expected_values(value_count);
+        iota(expected_values.begin(), expected_values.end(), 0);
+        ASSERT(values == expected_values);
+
+        thread consumer([&queue] {
+            int value = 0;
+            ASSERT(!queue.Pop(value));
+        });
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.Close();
+        consumer.join();
+    }
+
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "fancy"s, "collar"s};
+    const vector<string> statuses = {"ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s};
+    SearchServer expected("and with"s);
+    string corpus;
+    size_t rejected_count = 0;
+    for (int i = 0; i < 400; ++i) {
+        string text;
+        // строка длиннее блока чтения
+        const int word_count = i == 200 ? 40 : 1 + i % 5;
+        for (int j = 0; j < word_count; ++j) {
+            text += (j > 0 ? " "s : ""s) + words[(i * (j + 3) + j) % words.size()];
+        }
+        const vector<int> ratings = {i % 7, -(i % 3)};
+        if (i % 50 == 7) {
+            corpus += "x"s + to_string(i) + "\tACTUAL\t1\tcat\n"s;
+            ++rejected_count;
+        } else if (i % 50 == 13) {
+            corpus += to_string(i) + "\tUNKNOWN\t1\tcat\n"s;
+            ++rejected_count;
+        } else if (i % 50 == 21) {
+            corpus += to_string(i) + "\tACTUAL\tcat\n"s;
+            ++rejected_count;
+        } else if (i % 100 == 33) {
+            // повторный id и недопустимый символ отвергает AddDocument
+            corpus += to_string(i - 1) + "\tACTUAL\t1\tcat\n"s;
+            corpus += to_string(i) + "\tACTUAL\t1\tcurly d\x12og\n"s;
+            rejected_count += 2;
+        } else {
+            expected.AddDocument(i, text, static_cast<DocumentStatus>(i % 4), ratings);
+            corpus += to_string(i) + "\t"s + statuses[i % 4] + "\t"s + to_string(ratings[0]) + " "s + to_string(ratings[1]) + "\t"s + text;
+            corpus += i % 9 == 0 ? "\r\n\n"s : "\n"s;
+        }
+    }
+    // последняя строка без перевода строки
+    expected.AddDocument(1000, "fancy cat"s, DocumentStatus::ACTUAL, {});
+    corpus += "1000\tACTUAL\t\tfancy cat"s;
+
+    for (const size_t chunk_size : {64u, 1000u, 1u << 20}) {
+        SearchServer actual("and with"s);
+        istringstream input(corpus);
+        IngestionOptions options;
+        options.chunk_size = chunk_size;
+        options.parser_count = 3;
+        options.max_chunks_in_flight = 2;
+        const IngestionStats stats = IngestCorpus(actual, input, options);
+        ASSERT_EQUAL(stats.byte_count, corpus.size());
+        ASSERT_EQUAL(stats.document_count, static_cast<size_t>(expected.GetDocumentCount()));
+        ASSERT_EQUAL(stats.rejected_count, rejected_count);
+        CheckSameIndex(actual, expected, {"pet rat"s, "curly -pet"s, "fancy collar -cat"s});
+    }
+
+    SearchServer search_server("and with"s);
+    try {
+        IngestCorpusFile(search_server, "/nonexistent/corpus.tsv"s);
+        ASSERT_HINT(false, "missing file must be reported"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+// ----35----
+void TestIndexImage() {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "and"s, "fancy"s, "collar"s, "nasty"s};
+    vector<string> texts;
+    vector<NewDocument> documents;
+    for (int i = 0; i < 2000; ++i) {
+        string text;
+        const int word_count = 1 + i % 6;
+        for (int j = 0; j < word_count; ++j) {
+            text += words[(i * (j + 3) + j) % words.size()] + " "s;
+        }
+        texts.push_back(text + (i % 400 == 0 ? "rare"s + to_string(i) : ""s));
+    }
+    for (int i = 0; i < 2000; ++i) {
+        documents.push_back({(i * 37) % 2000, texts[i], static_cast<DocumentStatus>(i % 3), {i % 11, i % 5}});
+    }
+    documents.push_back({9000, "pet newword curly", DocumentStatus::ACTUAL, {5}});
+    documents.push_back({9001, "newword fancy", DocumentStatus::BANNED, {1}});
+    // при равной релевантности порядок параллельной выдачи зависит от нумерации
+    // документов, поэтому образ сравнивается с сервером, построенным из тех же
+    // документов без удалённых: у него та же нумерация, что и у образа
+    const auto build_server = [&documents](const set<int>& removed_ids, size_t document_count) {
+        auto search_server = make_unique<SearchServer>("and with"s);
+        search_server->SetDenseTermShare(0.2);
+        search_server->SetWriteBufferSize(300);
+        for (size_t i = 0; i < document_count; ++i) {
+            const NewDocument& document = documents[i];
+            if (removed_ids.count(document.id) == 0) {
+                search_server->AddDocument(document.id, document.text, document.status, document.ratings);
+            }
+        }
+        return search_server;
+    };
+    const set<int> removed_ids = {37, 74, 1000, 400 * 37 % 2000};
+    const vector<string> queries = {"pet rat"s, "curly -pet"s, "cat dog -rat -hair"s, "nasty collar -cat"s, "rare800 fancy"s, "rare400"s, "and with pet"s};
+
+    const filesystem::path directory = filesystem::temp_directory_path();
+    const string path = (directory / "search_server_test.image"s).string();
+    const string copy_path = (directory / "search_server_test_copy.image"s).string();
+    {
+        // удалённые документы и слова без документов в образ не попадают
+        const unique_ptr<SearchServer> original = build_server({}, 2000);
+        original->RemoveDocuments(vector<int>(removed_ids.begin(), removed_ids.end()));
+        original->SaveImage(path);
+    }
+    {
+        const unique_ptr<SearchServer> expected = build_server(removed_ids, 2000);
+        SearchServer actual(IndexImage::Open(path, POSTING_FORMAT));
+        CheckSameIndex(actual, *expected, queries);
+        ASSERT(actual.MatchDocument("pet and -nasty cat"s, 111) == expected->MatchDocument("pet and -nasty cat"s, 111));
+
+        // сервер над образом изменяется так же, как построенный в памяти
+        for (SearchServer* search_server : {&actual, expected.get()}) {
+            search_server->AddDocument(9000, documents[2000].text, documents[2000].status, documents[2000].ratings);
+            search_server->RemoveDocument(111);
+            search_server->RemoveDocument(execution::par, 222);
+            search_server->RemoveDocuments(execution::par, {333, 444, 9000});
+            search_server->AddDocument(9001, documents[2001].text, documents[2001].status, documents[2001].ratings);
+        }
+        const vector<string> more_queries = {"pet rat"s, "newword -fancy"s, "curly fancy"s, "rare400"s};
+        CheckSameIndex(actual, *expected, more_queries);
+        actual.Compact();
+        CheckSameIndex(actual, *expected, more_queries);
+
+        // образ сервера, открытого из образа
+        actual.SaveImage(copy_path);
+        set<int> all_removed_ids = removed_ids;
+        all_removed_ids.insert({111, 222, 333, 444, 9000});
+        SearchServer reopened(IndexImage::Open(copy_path, POSTING_FORMAT));
+        const unique_ptr<SearchServer> reopened_expected = build_server(all_removed_ids, documents.size());
+        CheckSameIndex(reopened, *reopened_expected, more_queries);
+
+        // читатели снимка строят частоты слов документов образа без блокировок
+        // и получают один и тот же словарь документа
+        {
+            reopened.PublishSnapshot();
+            const SearchServer::Snapshot snapshot = reopened.GetSnapshot();
+            vector<vector<const map<string_view, double>*>> word_frequencies(4);
+            vector<thread> readers;
+            for (auto& reader_word_frequencies : word_frequencies) {
+                readers.emplace_back([&snapshot, &reader_word_frequencies] {
+                    for (const int document_id : *snapshot) {
+                        reader_word_frequencies.push_back(&snapshot->GetWordFrequencies(document_id));
+                    }
+                });
+            }
+            for (thread& reader : readers) {
+                reader.join();
+            }
+            for (const auto& reader_word_frequencies : word_frequencies) {
+                ASSERT(reader_word_frequencies == word_frequencies[0]);
+            }
+            ASSERT_EQUAL(word_frequencies[0].size(), static_cast<size_t>(reopened.GetDocumentCount()));
+            ASSERT(snapshot->GetWordFrequencies(1) == reopened_expected->GetWordFrequencies(1));
+        }
+
+        // сохранение поверх открытого образа не портит отображённые в память данные
+        reopened.SaveImage(copy_path);
+        CheckSameIndex(reopened, *reopened_expected, more_queries);
+        CheckSameIndex(SearchServer(IndexImage::Open(copy_path, POSTING_FORMAT)), *reopened_expected, more_queries);
+        for (const auto& entry : filesystem::directory_iterator(directory)) {
+            ASSERT(entry.path().filename().string().rfind("search_server_test_copy.image."s, 0) != 0);
+        }
+        try {
+            reopened.SaveImage((directory / "search_server_missing_directory"s / "test.image"s).string());
+            ASSERT_HINT(false, "image in a missing directory must be rejected"s);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    string image;
+    {
+        ifstream input(path, ios::binary);
+        image.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    const auto check_rejected = [&copy_path](const string& bytes, uint32_t posting_format) {
+        {
+            ofstream output(copy_path, ios::binary | ios::trunc);
+            output << bytes;
+        }
+        try {
+            IndexImage::Open(copy_path, posting_format);
+            ASSERT_HINT(false, "corrupted image must be rejected"s);
+        } catch (const invalid_argument&) {
+        }
+    };
+    string corrupted = image;
+    corrupted[corrupted.size() / 2] ^= 1;
+    check_rejected(corrupted, POSTING_FORMAT);
+    check_rejected(image.substr(0, image.size() - 8), POSTING_FORMAT);
+    check_rejected(image.substr(0, 10), POSTING_FORMAT);
+    corrupted = image;
+    corrupted[0] = 'X';
+    check_rejected(corrupted, POSTING_FORMAT);
+    check_rejected(image, POSTING_FORMAT + 1);
+    filesystem::remove(path);
+    filesystem::remove(copy_path);
+    try {
+        IndexImage::Open(path, POSTING_FORMAT);
+        ASSERT_HINT(false, "missing image must be reported"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+// ----36----
+void TestQueryAllocations() {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "and"s, "fancy"s, "collar"s, "nasty"s};
+    SearchServer search_server("and with"s);
+    search_server.SetWriteBufferSize(500);
+    for (int i = 0; i < 3000; ++i) {
+        string text;
+        const int word_count = 1 + i % 7;
+        for (int j = 0; j < word_count; ++j) {
+            text += words[(i * (j + 5) + j) % words.size()] + " "s;
+        }
+        search_server.AddDocument(i, text, static_cast<DocumentStatus>(i % 4), {i % 13});
+    }
+    search_server.WaitForSegmentMerges();
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+    const auto key_mapper = [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL && rating > 2;
+    };
+    const vector<string> queries = {"curly cat -dog"s, "pet rat hair"s, "fancy -collar -nasty"s, "missing words"s, "-cat"s, "cat and"s};
+    const auto run_queries = [&](const string& query) {
+        return vector<vector<Document>>{
+            search_server.FindTopDocuments(query),
+            search_server.FindTopDocuments(query, DocumentStatus::BANNED, 7, QueryMode::ALL_WORDS),
+            search_server.FindTopDocuments(query, key_mapper),
+            search_server.FindTopDocuments(search_policy::block_max_wand, query),
+        };
+    };
+    for (const string& query : queries) {
+        run_queries(query);
+    }
+    // без замены operator new счётчик не растёт, и проверяются только результаты
+    const auto check_allocation_count = [](size_t allocation_count, size_t expected_count, const string& hint) {
+        if (IS_HEAP_ALLOCATION_COUNTED) {
+            ASSERT_EQUAL_HINT(allocation_count, expected_count, hint);
+        }
+    };
+
+    // счётчик читается до проверки: ASSERT_EQUAL сам выделяет память под строки
+    for (const string& query : queries) {
+        const size_t allocation_count = heap_allocation_count;
+        const auto results = search_server.FindTopDocuments(query);
+        const size_t query_allocation_count = heap_allocation_count - allocation_count;
+        check_allocation_count(query_allocation_count, results.empty() ? 0 : 1, query);
+        ASSERT_EQUAL(results.size(), search_server.FindTopDocuments(execution::par, query).size());
+    }
+    for (const string& query : queries) {
+        size_t allocation_count = heap_allocation_count;
+        const auto all_words = search_server.FindTopDocuments(query, DocumentStatus::BANNED, 7, QueryMode::ALL_WORDS);
+        const size_t all_words_allocation_count = heap_allocation_count - allocation_count;
+        check_allocation_count(all_words_allocation_count, all_words.empty() ? 0 : 1, query);
+
+        allocation_count = heap_allocation_count;
+        const auto mapped = search_server.FindTopDocuments(query, key_mapper);
+        const size_t mapped_allocation_count = heap_allocation_count - allocation_count;
+        check_allocation_count(mapped_allocation_count, mapped.empty() ? 0 : 1, query);
+
+        allocation_count = heap_allocation_count;
+        const auto block_max_wand = search_server.FindTopDocuments(search_policy::block_max_wand, query);
+        const size_t block_max_wand_allocation_count = heap_allocation_count - allocation_count;
+        check_allocation_count(block_max_wand_allocation_count, block_max_wand.empty() ? 0 : 1, query);
+        // при равной релевантности Block-Max WAND может отобрать другие документы
+        const auto expected = search_server.FindTopDocuments(query);
+        ASSERT_EQUAL(block_max_wand.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT(abs(block_max_wand[i].relevance - expected[i].relevance) < MAXIMUM_MEASUREMENT_ERROR);
+        }
+    }
+    ASSERT(!search_server.FindTopDocuments("curly cat"s).empty());
+    ASSERT(search_server.FindTopDocuments("missing words"s).empty());
+
+    // запрос длиннее арены: память сверх арены выделяется один раз, затем арена увеличивается
+    string long_query = "pet"s;
+    for (int i = 0; i < 20000; ++i) {
+        long_query += " "s + words[i % words.size()] + (i % 3 == 0 ? "x"s : ""s);
+    }
+    const auto long_results = search_server.FindTopDocuments(long_query);
+    const size_t allocation_count = heap_allocation_count;
+    const auto repeated_results = search_server.FindTopDocuments(long_query);
+    const size_t long_query_allocation_count = heap_allocation_count - allocation_count;
+    check_allocation_count(long_query_allocation_count, 1, long_query.substr(0, 16));
+    check_equal(repeated_results, long_results);
+
+    // вложенный поиск из фильтра не портит арену внешнего запроса
+    const auto expected = run_queries("curly cat -dog"s);
+    const auto nested_mapper = [&search_server](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL && !search_server.FindTopDocuments("fancy"s, DocumentStatus::ACTUAL, 1).empty();
+    };
+    check_equal(search_server.FindTopDocuments("curly cat -dog"s, nested_mapper), expected[0]);
+    check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, "curly cat -dog"s, nested_mapper), expected[3]);
+}
+
+// ----37----
+void TestSplitIntoWords() {
+    // любые пробельные символы ASCII разделяют слова, пустых слов нет
+    {
+        const vector<string_view> words = SplitIntoWords("  cat\tdog\n\nbig\r\n\v\fрыжий   кот "sv);
+        const vector<string_view> expected = {"cat"sv, "dog"sv, "big"sv, "рыжий"sv, "кот"sv};
+        ASSERT(words == expected);
+        ASSERT(SplitIntoWords(""sv).empty());
+        ASSERT(SplitIntoWords(" \t\n "sv).empty());
+    }
+
+    // слова на границах блоков и текст длиннее блока
+    for (size_t length = 1; length <= 3 * TEXT_BLOCK_SIZE; ++length) {
+        string text;
+        vector<string> expected;
+        for (size_t i = 0; text.size() < length; ++i) {
+            expected.push_back(string(1 + i % 7, static_cast<char>('a' + i % 26)));
+            text += expected.back();
+            text += i % 3 == 0 ? "\t"s : " "s;
+        }
+        text.resize(length);
+        if (text.back() == ' ' || text.back() == '\t') {
+            text.pop_back();
+        }
+        vector<string_view> words;
+        ASSERT(SplitIntoWords(text, words));
+        ASSERT_EQUAL_HINT(words.size(), SplitIntoWords(text).size(), text);
+        size_t word_length_sum = 0;
+        for (size_t i = 0; i < words.size(); ++i) {
+            ASSERT_HINT(words[i] == string_view(expected[i]).substr(0, words[i].size()), text);
+            word_length_sum += words[i].size();
+        }
+        ASSERT_EQUAL_HINT(word_length_sum + words.size() - 1, text.size(), text);
+    }
+
+    // управляющие символы, кроме пробельных, делают текст некорректным
+    {
+        vector<string_view> words;
+        ASSERT(!SplitIntoWords("cat d\x12og"sv, words));
+        ASSERT_EQUAL(words.size(), 2u);
+        string long_text(2 * TEXT_BLOCK_SIZE + 5, 'a');
+        long_text[TEXT_BLOCK_SIZE + 3] = '\0';
+        words.clear();
+        ASSERT(!SplitIntoWords(long_text, words));
+        ASSERT_EQUAL(words.size(), 1u);
+        ASSERT(SplitIntoWords("\x7f \xff\x80"sv, words));
+    }
+
+    // документы и запросы разбиваются одинаково
+    {
+        SearchServer search_server("and\tin"s);
+        search_server.AddDocument(1, "cat\tin\nthe  city"s, DocumentStatus::ACTUAL, {1});
+        search_server.AddDocument(2, "dog and cat"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 3u);
+        ASSERT_EQUAL(search_server.GetWordFrequencies(2).size(), 2u);
+        const auto documents = search_server.FindTopDocuments("city\t\t-dog\n"s);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT_EQUAL(documents[0].id, 1);
+        const auto [words, status] = search_server.MatchDocument("  cat\r\ncity "s, 1);
+        ASSERT_EQUAL(words.size(), 2u);
+        try {
+            search_server.AddDocument(3, "cat\x1f"s, DocumentStatus::ACTUAL, {1});
+            ASSERT_HINT(false, "control character in document"s);
+        } catch (const invalid_argument&) {
+        }
+        try {
+            search_server.FindTopDocuments("cat \x01dog"s);
+            ASSERT_HINT(false, "control character in query"s);
+        } catch (const invalid_argument&) {
+        }
+        try {
+            SearchServer invalid_stop_words("and \x02in"s);
+            ASSERT_HINT(false, "control character in stop words"s);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+// ----38----
+void TestStopWordFilter() {
+    // таблица из многих групп, совпадающие длины и длинные слова
+    {
+        vector<string> words;
+        for (int i = 0; i < 1000; ++i) {
+            words.push_back("w"s + to_string(i * 7));
+        }
+        words.push_back(string(100, 'x'));
+        words.push_back("в"s);
+        words.push_back("w0"s);
+        const StopWordFilter filter(words);
+        ASSERT_EQUAL(filter.size(), 1002u);
+        for (int i = 0; i < 7000; ++i) {
+            const string word = "w"s + to_string(i);
+            ASSERT_EQUAL_HINT(filter.Contains(word), i % 7 == 0, word);
+        }
+        ASSERT(filter.Contains(string(100, 'x')));
+        ASSERT(!filter.Contains(string(99, 'x')));
+        ASSERT(!filter.Contains(string(101, 'x')));
+        ASSERT(!filter.Contains(string(100, 'y')));
+        ASSERT(filter.Contains("в"s));
+        ASSERT(!filter.Contains(""s));
+        ASSERT(!filter.Contains("w"s));
+    }
+
+    // пустое множество
+    {
+        const StopWordFilter filter;
+        ASSERT_EQUAL(filter.size(), 0u);
+        ASSERT(!filter.Contains("a"s));
+        ASSERT(!StopWordFilter(vector<string>{}).Contains(""s));
+    }
+
+    // SetStopWords пересобирает фильтр, копия сервера сохраняет свои стоп-слова
+    {
+        SearchServer search_server("in the"s);
+        search_server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 2u);
+        ASSERT(search_server.FindTopDocuments("in"s).empty());
+        search_server.PublishSnapshot();
+        const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+        search_server.SetStopWords("cat"s);
+        search_server.AddDocument(2, "cat in the town"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_EQUAL(search_server.GetWordFrequencies(2).size(), 1u);
+        ASSERT(search_server.FindTopDocuments("cat"s).empty());
+        ASSERT(search_server.FindTopDocuments("the"s).empty());
+        ASSERT_EQUAL(search_server.FindTopDocuments("town"s).size(), 1u);
+        ASSERT_EQUAL(snapshot->FindTopDocuments("cat"s).size(), 1u);
+    }
+}
+
+// ----39----
+void TestResultCache() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7});
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(3, "big cat nasty hair"s, DocumentStatus::BANNED, {3});
+    search_server.AddDocument(4, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {2});
+
+    const auto check_equal = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+            ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+        }
+    };
+
+    // кеш выключен по умолчанию
+    search_server.FindTopDocuments("curly pet"s);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 0u);
+
+    search_server.SetResultCacheCapacity(100);
+    const auto expected = search_server.FindTopDocuments("curly pet -rat"s);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().misses, 1u);
+    // тот же запрос после нормализации: порядок, повторы и стоп-слова не важны
+    check_equal(search_server.FindTopDocuments("pet  -rat and curly pet"s), expected);
+    check_equal(search_server.FindTopDocuments(execution::seq, "-rat curly\tpet"s, DocumentStatus::ACTUAL), expected);
+    ResultCacheStats stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 2u);
+    ASSERT_EQUAL(stats.misses, 1u);
+    ASSERT_EQUAL(stats.entry_count, 1u);
+    ASSERT(stats.memory_usage > 0);
+    ASSERT(abs(stats.GetHitRate() - 2.0 / 3) < MAXIMUM_MEASUREMENT_ERROR);
+
+    // статус, число документов, режим и способ поиска входят в ключ
+    ASSERT_EQUAL(search_server.FindTopDocuments("curly pet -rat"s, DocumentStatus::BANNED).size(), 0u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("curly pet -rat"s, DocumentStatus::ACTUAL, 1).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("curly pet -rat"s, DocumentStatus::ACTUAL, 5, QueryMode::ALL_WORDS).size(), 1u);
+    check_equal(search_server.FindTopDocuments(execution::par, "curly pet -rat"s), expected);
+    check_equal(search_server.FindTopDocuments(search_policy::block_max_wand, "curly pet -rat"s), expected);
+    stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 2u);
+    ASSERT_EQUAL(stats.entry_count, 6u);
+
+    // фильтр-функция кешируется только с именем
+    const auto rated = [](int document_id, DocumentStatus status, int rating) {
+        return rating > 1;
+    };
+    search_server.FindTopDocuments("nasty hair"s, rated);
+    search_server.FindTopDocuments("nasty hair"s, rated);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().entry_count, 6u);
+    const auto rated_documents = search_server.FindTopDocuments("nasty hair"s, WithCacheTag("rated"s, rated));
+    ASSERT_EQUAL(rated_documents.size(), 2u);
+    check_equal(search_server.FindTopDocuments("hair nasty"s, WithCacheTag("rated"s, rated)), rated_documents);
+    stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.hits, 3u);
+    ASSERT_EQUAL(stats.entry_count, 7u);
+
+    // изменение документов делает записи недействительными
+    search_server.AddDocument(5, "curly pet"s, DocumentStatus::ACTUAL, {9});
+    const auto after_add = search_server.FindTopDocuments("curly pet -rat"s);
+    ASSERT_EQUAL(after_add.size(), 3u);
+    ASSERT_EQUAL(after_add[0].id, 5);
+    ASSERT_EQUAL(search_server.GetResultCacheStats().invalidations, 1u);
+    search_server.RemoveDocument(5);
+    check_equal(search_server.FindTopDocuments("curly pet -rat"s), expected);
+    search_server.SetStopWords("curly"s);
+    ASSERT_EQUAL(search_server.FindTopDocuments("curly"s).size(), 0u);
+
+    // снимок с прежней эпохой разделяет кеш с сервером
+    search_server.PublishSnapshot();
+    {
+        const SearchServer::Snapshot snapshot = search_server.GetSnapshot();
+        const size_t hits = search_server.GetResultCacheStats().hits;
+        snapshot->FindTopDocuments("pet"s);
+        search_server.FindTopDocuments("pet"s);
+        ASSERT_EQUAL(search_server.GetResultCacheStats().hits, hits + 1);
+    }
+
+    // вытеснение при нехватке места
+    search_server.SetResultCacheCapacity(ResultCache::SHARD_COUNT);
+    stats = search_server.GetResultCacheStats();
+    ASSERT(stats.entry_count <= ResultCache::SHARD_COUNT);
+    for (int i = 0; i < 100; ++i) {
+        search_server.FindTopDocuments("pet w"s + to_string(i));
+    }
+    stats = search_server.GetResultCacheStats();
+    ASSERT(stats.entry_count <= ResultCache::SHARD_COUNT);
+    ASSERT(stats.evictions >= 100 - ResultCache::SHARD_COUNT);
+    search_server.SetResultCacheCapacity(0);
+    stats = search_server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.entry_count, 0u);
+    ASSERT_EQUAL(stats.memory_usage, 0u);
+}
+
+// ----40----
+void TestRequestQueue() {
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    search_server.AddDocument(5, "big dog sparrow Vasiliy"s, DocumentStatus::ACTUAL, {1, 1, 1});
+
+    // окно из последних RequestQueue::WINDOW_SIZE запросов
+    {
+        RequestQueue request_queue(search_server);
+        for (size_t i = 0; i < RequestQueue::WINDOW_SIZE - 1; ++i) {
+            request_queue.AddFindRequest("empty request"s);
+        }
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), static_cast<int>(RequestQueue::WINDOW_SIZE - 1));
+        ASSERT_EQUAL(request_queue.AddFindRequest("curly dog"s).size(), 4u);
+        request_queue.AddFindRequest("big collar"s);
+        request_queue.AddFindRequest("sparrow"s, DocumentStatus::ACTUAL);
+        ASSERT_EQUAL(request_queue.AddFindRequest("sparrow"s, [](int document_id, DocumentStatus status, int rating) {
+            return document_id == 4;
+        }).size(), 1u);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), static_cast<int>(RequestQueue::WINDOW_SIZE - 4));
+        request_queue.AddFindRequest("sparrow"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), static_cast<int>(RequestQueue::WINDOW_SIZE - 4));
+    }
+
+    // текст запросов хранится в очереди, медленные запросы и процентили времени
+    {
+        RequestQueue request_queue(search_server);
+        ASSERT(request_queue.GetSlowRequests().empty());
+        ASSERT_EQUAL(request_queue.GetLatencyPercentile(0.5).count(), 0);
+        {
+            string query = "curly"s;
+            request_queue.AddFindRequest(query);
+            query = "overwritten query"s;
+        }
+        const string long_query(2 * RequestQueue::MAX_STORED_QUERY_LENGTH, 'x');
+        request_queue.AddFindRequest(long_query);
+        request_queue.AddFindRequest("dog"s, [](int document_id, DocumentStatus status, int rating) {
+            this_thread::sleep_for(5ms);
+            return true;
+        });
+        const auto slow_requests = request_queue.GetSlowRequests();
+        ASSERT_EQUAL(slow_requests.size(), 3u);
+        ASSERT_EQUAL(slow_requests[0].query, "dog"s);
+        ASSERT(!slow_requests[0].empty);
+        ASSERT(slow_requests[0].latency >= 10ms);
+        ASSERT(slow_requests[0].latency >= slow_requests[1].latency);
+        ASSERT(slow_requests[1].latency >= slow_requests[2].latency);
+        const auto curly = find_if(slow_requests.begin(), slow_requests.end(), [](const RequestQueue::RequestRecord& record) {
+            return record.query == "curly"s;
+        });
+        ASSERT(curly != slow_requests.end());
+        const auto truncated = find_if(slow_requests.begin(), slow_requests.end(), [](const RequestQueue::RequestRecord& record) {
+            return record.empty;
+        });
+        ASSERT(truncated != slow_requests.end());
+        ASSERT_EQUAL(truncated->query, long_query.substr(0, RequestQueue::MAX_STORED_QUERY_LENGTH));
+        ASSERT_EQUAL(request_queue.GetLatencyPercentile(1.0).count(), slow_requests[0].latency.count());
+        ASSERT(request_queue.GetLatencyPercentile(0.0) <= request_queue.GetLatencyPercentile(0.5));
+        ASSERT(request_queue.GetLatencyPercentile(0.5) <= slow_requests[0].latency);
+    }
+
+    // запросы из нескольких потоков
+    {
+        RequestQueue request_queue(search_server);
+        const int thread_count = 4;
+        const int request_count = 3000;
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&request_queue, t] {
+                for (int i = 0; i < request_count; ++i) {
+                    request_queue.AddFindRequest((i + t) % 3 == 0 ? "cat"s : "missing"s);
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        const int no_result_count = request_queue.GetNoResultRequests();
+        ASSERT(no_result_count > 0 && no_result_count < static_cast<int>(RequestQueue::WINDOW_SIZE));
+        ASSERT_EQUAL(request_queue.GetSlowRequests().size(), RequestQueue::SLOW_REQUEST_SAMPLE_SIZE);
+        // окно обновляется и после параллельной записи
+        for (size_t i = 0; i < RequestQueue::WINDOW_SIZE; ++i) {
+            request_queue.AddFindRequest("cat"s);
+        }
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    }
+}
+
+// ----41----
+void TestFindTopDocumentsBatch() {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "and"s, "fancy"s, "collar"s, "nasty"s, "big"s, "tail"s};
+    SearchServer search_server("and with"s);
+    search_server.SetWriteBufferSize(300);
+    for (int i = 0; i < 2000; ++i) {
+        string text;
+        const int word_count = 1 + i % 9;
+        for (int j = 0; j < word_count; ++j) {
+            text += words[(i * (j + 3) + j * j) % words.size()] + " "s;
+        }
+        search_server.AddDocument(i, text, static_cast<DocumentStatus>(i % 3), {i % 11, i % 5});
+    }
+    for (int i = 0; i < 2000; i += 7) {
+        search_server.RemoveDocument(i);
+    }
+    search_server.SetDenseTermShare(0.3);
+
+    // запросы с общими словами, минус-словами, повторами и без найденных документов
+    vector<string> queries;
+    for (int i = 0; i < 150; ++i) {
+        string query;
+        for (int j = 0; j < 1 + i % 5; ++j) {
+            query += (j == 2 && i % 4 == 0 ? "-"s : ""s) + words[(i + j * 5) % words.size()] + " "s;
+        }
+        queries.push_back(query);
+    }
+    queries.push_back("missing words"s);
+    queries.push_back(""s);
+    queries.push_back("cat cat -cat"s);
+
+    const auto check_batch = [&search_server](const vector<string>& queries, DocumentStatus status, int max_result_count) {
+        const auto results = search_server.FindTopDocumentsBatch(queries, status, max_result_count);
+        ASSERT_EQUAL(results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const auto expected = search_server.FindTopDocuments(queries[i], status, max_result_count);
+            ASSERT_EQUAL_HINT(results[i].size(), expected.size(), queries[i]);
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL_HINT(results[i][j].id, expected[j].id, queries[i]);
+                ASSERT_EQUAL_HINT(results[i][j].relevance, expected[j].relevance, queries[i]);
+                ASSERT_EQUAL_HINT(results[i][j].rating, expected[j].rating, queries[i]);
+            }
+        }
+    };
+    check_batch(queries, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT);
+    check_batch(queries, DocumentStatus::IRRELEVANT, 100);
+    check_batch(queries, DocumentStatus::ACTUAL, 0);
+    check_batch({}, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT);
+    // запросы без общих слов выполняются по одному
+    check_batch({"pet"s, "rat"s, "cat -dog"s, "hair"s}, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT);
+    // запросы, одинаковые после разбора, выполняются один раз
+    check_batch({"cat dog -tail"s, "dog  cat -tail"s, "-tail dog cat dog"s, "cat dog"s}, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT);
+
+    // ProcessQueries выполняет пакет, в том числе в режиме ALL_WORDS
+    const auto results = ProcessQueries(search_server, queries, QueryMode::ALL_WORDS);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = search_server.FindTopDocuments(queries[i], DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, QueryMode::ALL_WORDS);
+        ASSERT_EQUAL(results[i].size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(results[i][j].id, expected[j].id);
+        }
+    }
+
+    // ошибка разбора запроса передаётся вызывающему
+    queries.push_back("cat --dog"s);
+    try {
+        search_server.FindTopDocumentsBatch(queries);
+        ASSERT_HINT(false, "invalid query in batch"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+// ----42----
+void TestProcessQueriesJoinedStream() {
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "fancy"s, "collar"s};
+    SearchServer search_server("and with"s);
+    for (int i = 0; i < 300; ++i) {
+        search_server.AddDocument(i, words[i % words.size()] + " "s + words[i * 3 % words.size()] + " "s + words[i * 5 % 7], DocumentStatus::ACTUAL, {i % 7});
+    }
+    // запросы занимают несколько шагов обработки, последний шаг неполный
+    vector<string> queries;
+    for (size_t i = 0; i < PROCESS_QUERIES_WINDOW_SIZE * 2 + 100; ++i) {
+        queries.push_back(words[i % words.size()] + " -"s + words[i / words.size() % words.size()]);
+    }
+    vector<Document> expected;
+    for (const vector<Document>& documents : ProcessQueries(search_server, queries)) {
+        expected.insert(expected.end(), documents.begin(), documents.end());
+    }
+    ASSERT(expected.size() > 100);
+
+    const auto is_equal = [](const Document& lhs, const Document& rhs) {
+        return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+    };
+    vector<Document> streamed;
+    ProcessQueriesJoined(search_server, queries, [&streamed](const Document& document) {
+        streamed.push_back(document);
+        return true;
+    });
+    ASSERT_EQUAL(streamed.size(), expected.size());
+    ASSERT(equal(streamed.begin(), streamed.end(), expected.begin(), is_equal));
+    const vector<Document> joined = ProcessQueriesJoined(search_server, queries);
+    ASSERT_EQUAL(joined.size(), expected.size());
+    ASSERT(equal(joined.begin(), joined.end(), expected.begin(), is_equal));
+
+    // получатель прекращает обработку
+    streamed.clear();
+    ProcessQueriesJoined(search_server, queries, [&streamed](const Document& document) {
+        streamed.push_back(document);
+        return streamed.size() < 10;
+    });
+    ASSERT_EQUAL(streamed.size(), 10u);
+    ASSERT(equal(streamed.begin(), streamed.end(), expected.begin(), is_equal));
+
+    // первые шаги малы: после отказа на первом документе дальние запросы не выполняются
+    {
+        vector<string> stopped_queries = queries;
+        stopped_queries[PROCESS_QUERIES_WINDOW_SIZE / 2] = "cat --dog"s;
+        streamed.clear();
+        ProcessQueriesJoined(search_server, stopped_queries, [&streamed](const Document& document) {
+            streamed.push_back(document);
+            return false;
+        });
+        ASSERT_EQUAL(streamed.size(), 1u);
+        ASSERT(is_equal(streamed[0], expected[0]));
+    }
+
+    size_t call_count = 0;
+    ProcessQueriesJoined(search_server, {}, [&call_count](const Document&) {
+        ++call_count;
+        return true;
+    });
+    ASSERT_EQUAL(call_count, 0u);
+
+    // ошибка в запросе следующего шага передаётся получателю после документов предыдущих шагов
+    queries[PROCESS_QUERIES_WINDOW_SIZE + 1] = "cat --dog"s;
+    call_count = 0;
+    try {
+        ProcessQueriesJoined(search_server, queries, [&call_count](const Document&) {
+            ++call_count;
+            return true;
+        });
+        ASSERT_HINT(false, "invalid_argument expected"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT(call_count > 0);
+
+    // ошибка в первом запросе передаётся до документов
+    queries[0] = "cat --dog"s;
+    call_count = 0;
+    try {
+        ProcessQueriesJoined(search_server, queries, [&call_count](const Document&) {
+            ++call_count;
+            return true;
+        });
+        ASSERT_HINT(false, "invalid_argument expected"s);
+    } catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(call_count, 0u);
+}
+
+// ----43----
+void TestTaskExecutor() {
+    for (const size_t thread_count : {0, 1, 3}) {
+        TaskExecutor executor(thread_count);
+        ASSERT_EQUAL(executor.GetThreadCount(), thread_count);
+
+        vector<atomic<int>> visit_counts(1000);
+        executor.ParallelFor(visit_counts.size(), [&visit_counts](size_t i) {
+            visit_counts[i].fetch_add(1);
+        });
+        ASSERT(all_of(visit_counts.begin(), visit_counts.end(), [](const atomic<int>& count) {
+            return count.load() == 1;
+        }));
+        executor.ParallelFor(0, [](size_t) {
+            ASSERT_HINT(false, "no indexes expected"s);
+        });
+
+        // вложенный обход делится на задачи того же пула
+        mutex thread_ids_mutex;
+        set<thread::id> thread_ids;
+        atomic<size_t> nested_sum = 0;
+        executor.ParallelFor(16, [&](size_t i) {
+            executor.ParallelFor(100, [&](size_t j) {
+                nested_sum += i * 100 + j;
+                lock_guard lock(thread_ids_mutex);
+                thread_ids.insert(this_thread::get_id());
+            });
+        });
+        ASSERT_EQUAL(nested_sum.load(), 1599u * 1600u / 2);
+        ASSERT(thread_ids.size() <= thread_count + 1);
+
+        atomic<int> call_count = 0;
+        try {
+            executor.ParallelFor(100, [&call_count](size_t i) {
+                ++call_count;
+                if (i == 10) {
+                    throw out_of_range("index 10"s);
+                }
+            });
+            ASSERT_HINT(false, "out_of_range expected"s);
+        } catch (const out_of_range&) {
+        }
+        ASSERT(call_count.load() >= 11);
+
+        TaskExecutor::Future<int> future(executor, [] {
+            return 42;
+        });
+        ASSERT_EQUAL(future.Get(), 42);
+        TaskExecutor::Future<int> failed_future(executor, []() -> int {
+            throw invalid_argument("failed"s);
+        });
+        try {
+            failed_future.Get();
+            ASSERT_HINT(false, "invalid_argument expected"s);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    // без рабочих потоков всё выполняется в вызывающем потоке
+    {
+        TaskExecutor executor(0);
+        const thread::id caller_id = this_thread::get_id();
+        bool is_inline = true;
+        executor.ParallelFor(100, [&](size_t) {
+            is_inline = is_inline && this_thread::get_id() == caller_id;
+        });
+        ASSERT(is_inline);
+    }
+
+    // ожидание без задач не занимает процессор, а новые задачи пула будят ожидающего
+    {
+        TaskExecutor executor(1);
+        const clock_t start = clock();
+        TaskExecutor::Future<int> slow_future(executor, [] {
+            this_thread::sleep_for(300ms);
+            return 7;
+        });
+        ASSERT_EQUAL(slow_future.Get(), 7);
+        ASSERT(clock() - start < CLOCKS_PER_SEC / 10);
+
+        const thread::id caller_id = this_thread::get_id();
+        mutex thread_ids_mutex;
+        set<thread::id> thread_ids;
+        atomic<int> started_count = 0;
+        TaskExecutor::Future<int> nested_future(executor, [&] {
+            // индексы ждут друг друга, поэтому второй может выполнить только ожидающий Get
+            executor.ParallelFor(2, [&](size_t) {
+                {
+                    lock_guard lock(thread_ids_mutex);
+                    thread_ids.insert(this_thread::get_id());
+                }
+                ++started_count;
+                for (int attempt = 0; attempt < 500 && started_count.load() < 2; ++attempt) {
+                    this_thread::sleep_for(10ms);
+                }
+            });
+            return 1;
+        });
+        ASSERT_EQUAL(nested_future.Get(), 1);
+        ASSERT_EQUAL(thread_ids.size(), 2u);
+        ASSERT(thread_ids.count(caller_id) == 1);
+    }
+
+    // параллельные перегрузки сервера выполняются пулом с закреплением за процессором
+    const vector<string> words = {"pet"s, "rat"s, "cat"s, "dog"s, "hair"s, "curly"s, "fancy"s, "collar"s};
+    SearchServer search_server("and with"s);
+    search_server.SetExecutorThreadCount(2, {0});
+    ASSERT_EQUAL(search_server.GetExecutor().GetThreadCount(), 2u);
+    vector<string> texts;
+    for (int i = 0; i < 3000; ++i) {
+        texts.push_back(words[i % words.size()] + " "s + words[i * 3 % 7] + " "s + words[i / 7 % words.size()]);
+    }
+    vector<NewDocument> documents;
+    for (int i = 0; i < 3000; ++i) {
+        documents.push_back({i, texts[i], static_cast<DocumentStatus>(i % 2), {i % 9}});
+    }
+    search_server.AddDocuments(execution::par, documents);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3000);
+    search_server.RemoveDocument(execution::par, 5);
+    search_server.RemoveDocuments(execution::par, {6, 7, 8});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2996);
+
+    const vector<string> queries = {"cat dog"s, "curly -pet hair"s, "fancy collar rat"s, "missing"s};
+    for (const string& query : queries) {
+        const auto expected = search_server.FindTopDocuments(query);
+        const auto found = search_server.FindTopDocuments(execution::par, query);
+        ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+        }
+        for (const int document_id : {0, 1, 2999}) {
+            const auto [expected_words, expected_status] = search_server.MatchDocument(query, document_id);
+            const auto [words, status] = search_server.MatchDocument(execution::par, query, document_id);
+            ASSERT(words == expected_words);
+            ASSERT(status == expected_status);
+        }
+    }
+    const auto batch_results = ProcessQueries(search_server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ASSERT_EQUAL(batch_results[i].size(), search_server.FindTopDocuments(queries[i]).size());
+    }
+}
+
 // Функция TestSearchServer является точкой входа для запуска тестов.
 void TestSearchServer() {
     cerr << "TestExcludeStopWordsFromAddedDocumentContent begin...";
@@ -1076,6 +3088,90 @@ void TestSearchServer() {
     cerr << "TestProcessQueriesJoined begin...";
     TestProcessQueriesJoined(); // 20
     cerr << "ALL OK" << endl;
+
+    cerr << "TestPostingLists begin...";
+    TestPostingLists(); // 21
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestMaxResultCount begin...";
+    TestMaxResultCount(); // 22
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestBlockMaxWand begin...";
+    TestBlockMaxWand(); // 23
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestInverseDocumentFreqCache begin...";
+    TestInverseDocumentFreqCache(); // 24
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestScoreAccumulator begin...";
+    TestScoreAccumulator(); // 25
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestParallelPartitions begin...";
+    TestParallelPartitions(); // 26
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestDocumentBitmaps begin...";
+    TestDocumentBitmaps(); // 27
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestConjunctiveQueries begin...";
+    TestConjunctiveQueries(); // 28
+    cerr << "ALL OK" << endl;
+    cerr << "TestSegmentedIndex begin...";
+    TestSegmentedIndex(); // 29
+    cerr << "ALL OK" << endl;
+    cerr << "TestSnapshots begin...";
+    TestSnapshots(); // 30
+    cerr << "ALL OK" << endl;
+    cerr << "TestCompaction begin...";
+    TestCompaction(); // 31
+    cerr << "ALL OK" << endl;
+    cerr << "TestRemoveDocuments begin...";
+    TestRemoveDocuments(); // 32
+    cerr << "ALL OK" << endl;
+    cerr << "TestAddDocumentBatch begin...";
+    TestAddDocumentBatch(); // 33
+    cerr << "ALL OK" << endl;
+    cerr << "TestCorpusIngestion begin...";
+    TestCorpusIngestion(); // 34
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestIndexImage begin...";
+    TestIndexImage(); // 35
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestQueryAllocations begin...";
+    TestQueryAllocations(); // 36
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestSplitIntoWords begin...";
+    TestSplitIntoWords(); // 37
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestStopWordFilter begin...";
+    TestStopWordFilter(); // 38
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestResultCache begin...";
+    TestResultCache(); // 39
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestRequestQueue begin...";
+    TestRequestQueue(); // 40
+    cerr << "ALL OK" << endl;
+
+    cerr << "TestFindTopDocumentsBatch begin...";
+    TestFindTopDocumentsBatch(); // 41
+    cerr << "ALL OK" << endl;
+    cerr << "TestProcessQueriesJoinedStream begin...";
+    TestProcessQueriesJoinedStream(); // 42
+    cerr << "ALL OK" << endl;
+    cerr << "TestTaskExecutor begin...";
+    TestTaskExecutor(); // 43
+    cerr << "ALL OK" << endl;
 }
 
 // --------- Окончание модульных тестов поисковой системы ----------- 
@@ -165,6 +165,176 @@ void TestProcessQueriesJoined();
 
 
 
+// ----21----
+// Тест списков вхождений.
+// Обычный и сжатый списки должны хранить одни и те же вхождения по возрастанию
+// порядкового номера документа и находить их, в том числе внутри уже
+// упакованных блоков.
+void TestPostingLists();
+
+// ----22----
+// Тест количества возвращаемых документов.
+// FindTopDocuments должен возвращать не более max_result_count лучших документов
+// (по умолчанию MAX_RESULT_DOCUMENT_COUNT) в том же порядке, что и полная сортировка,
+// в том числе при параллельном поиске.
+void TestMaxResultCount();
+
+// ----23----
+// Тест поиска с отсечением Block-Max WAND.
+// Результаты search_policy::block_max_wand должны совпадать с полным перебором,
+// в том числе с минус-словами, фильтром по статусу и предикатом.
+void TestBlockMaxWand();
+
+// ----24----
+// Тест кэша IDF.
+// Релевантность должна учитывать IDF, пересчитанную после каждого добавления
+// и удаления документа. Документы со словом, которое есть во всех документах,
+// находятся с нулевой релевантностью.
+void TestInverseDocumentFreqCache();
+
+// ----25----
+// Тест накопителя релевантности.
+// Исключённые документы не попадают в выдачу, накопитель очищается после запроса,
+// вложенный поиск не портит накопитель потока. Параллельный поиск исключает
+// документы с минус-словами так же, как последовательный.
+void TestScoreAccumulator();
+
+// ----26----
+// Тест параллельного поиска по частям диапазона документов.
+// Результаты должны совпадать с последовательным поиском при любом max_result_count,
+// в том числе после удаления документов из середины диапазона.
+void TestParallelPartitions();
+
+// ----27----
+// Тест битовых карт документов.
+// DocumentBitmap хранит номера в контейнерах-массивах и плотных контейнерах
+// и переключается между ними. Результаты FindTopDocuments и MatchDocument
+// не зависят от порога, с которого слова хранят битовые карты.
+void TestDocumentBitmaps();
+
+// ----28----
+// Тест поиска документов со всеми плюс-словами (QueryMode::ALL_WORDS).
+// Результаты должны совпадать с документами, найденными по любому слову,
+// в которых совпали все плюс-слова, с учётом минус-слов, статуса и предиката,
+// в последовательной и параллельной версиях и в ProcessQueries.
+void TestConjunctiveQueries();
+
+// ----29----
+// Тест сегментированного индекса.
+// Результаты поиска и MatchDocument не зависят от размера буфера записи,
+// от удаления документов и от того, слиты ли сегменты фоновой задачей.
+// После слияния сегментов их становится меньше. Compact переписывает только
+// сегменты, в которых остались вхождения удалённых документов.
+void TestSegmentedIndex();
+
+// ----30----
+// Тест снимков состояния сервера.
+// Снимок не меняется при добавлении и удалении документов, новая версия
+// видна после публикации. Читатели в других потоках получают согласованные
+// результаты, пока сервер изменяется и публикует версии.
+void TestSnapshots();
+
+// ----31----
+// Тест удаления документов с отложенным сжатием индекса.
+// Удалённый документ сразу исчезает из выдачи, GetDocumentCount и обхода,
+// порядок добавления остальных документов сохраняется. Сжатие явным вызовом
+// и по порогу не меняет результаты поиска и снимает отметки удаления.
+void TestCompaction();
+
+// ----32----
+// Тест пакетного удаления документов RemoveDocuments.
+// Результат совпадает с удалением документов по одному для обеих политик,
+// отсутствующие и повторные id пропускаются, слова без документов не находятся.
+void TestRemoveDocuments();
+
+// ----33----
+// Тест пакетного добавления документов AddDocuments.
+// Индекс, построенный параллельной версией, совпадает с построенным вызовами
+// AddDocument: порядок документов, частоты слов и результаты поиска. Недопустимый
+// документ и повторный id отвергаются, документы до них остаются добавленными.
+// С пропуском отвергнутых добавляются все остальные документы пакета.
+void TestAddDocumentBatch();
+
+// ----34----
+// Тест загрузки корпуса IngestCorpus.
+// BoundedQueue передаёт все элементы между несколькими писателями и читателями.
+// Корпус, прочитанный мелкими блоками несколькими потоками, даёт тот же индекс,
+// что и AddDocument по строкам; строки неверного формата и отвергнутые документы
+// пропускаются и учитываются в статистике.
+void TestCorpusIngestion();
+
+// ----35----
+// Тест образа индекса SaveImage и IndexImage::Open.
+// Сервер над образом находит те же документы с той же релевантностью, что и
+// сервер в памяти, и так же изменяется: добавление новых слов, удаление документов
+// образа, сжатие. Частоты слов документов образа параллельные читатели снимка
+// строят без блокировок. Повреждённый, обрезанный, чужой образ и образ другого
+// формата списков вхождений отвергаются.
+void TestIndexImage();
+
+// ----36----
+// Тест выделения памяти при поиске.
+// После первых запросов потока последовательный поиск (любое слово, все слова,
+// фильтр-функция) и Block-Max WAND выделяют в куче только вектор результата.
+// Запрос, не уместившийся в арену, выделяет память сверх неё только один раз.
+// Вложенный поиск из фильтра получает свою арену и находит те же документы.
+// Число выделений проверяется в сборке с -DSEARCH_SERVER_COUNT_ALLOCATIONS.
+void TestQueryAllocations();
+
+// ----37----
+// Тест разбиения текста на слова.
+// Слова разделяются любыми пробельными символами ASCII, пустые слова не появляются,
+// в том числе на границах блоков текста. Другие управляющие символы в документе,
+// запросе и стоп-словах приводят к исключению invalid_argument.
+void TestSplitIntoWords();
+
+// ----38----
+// Тест фильтра стоп-слов.
+// Фильтр находит все свои слова, в том числе длинные и повторяющиеся, и не находит
+// слова той же длины, которых в нём нет. SetStopWords пересобирает фильтр
+// сервера, а ранее полученная версия сервера продолжает использовать старые стоп-слова.
+void TestStopWordFilter();
+
+// ----39----
+// Тест кеша результатов поиска.
+// Запросы, совпадающие после нормализации, находятся в кеше; статус, число документов,
+// режим и способ поиска различают записи. Фильтр-функция кешируется только с именем.
+// Изменение документов и стоп-слов делает записи недействительными, лишние записи вытесняются.
+void TestResultCache();
+
+// ----40----
+// Тест очереди запросов.
+// Количество запросов без результатов считается по последним WINDOW_SIZE запросам.
+// Очередь хранит копию текста запроса, длинные запросы усекаются. Медленные запросы
+// выдаются от самого долгого, процентили времени согласованы с ними. Запросы можно
+// добавлять из нескольких потоков.
+void TestRequestQueue();
+
+// ----41----
+// Тест пакетного поиска.
+// Результаты пакета с общими словами, минус-словами, удалёнными документами и разными
+// статусами в точности совпадают с результатами FindTopDocuments по каждому запросу,
+// в том числе для групп без общих слов и в режиме ALL_WORDS. Ошибка в запросе пакета
+// приводит к исключению invalid_argument.
+void TestFindTopDocumentsBatch();
+
+// ----42----
+// Тест потоковой обработки пакета запросов.
+// Получатель получает документы в порядке запросов, как в ProcessQueries, в том числе
+// для пакета из нескольких шагов обработки, и может прекратить обработку; после
+// отказа на первом документе дальние запросы не выполняются. Ошибка в запросе
+// приводит к исключению invalid_argument после документов предыдущих запросов.
+void TestProcessQueriesJoinedStream();
+
+// ----43----
+// Тест пула потоков.
+// ParallelFor обрабатывает каждый индекс один раз, вложенные обходы не создают новых
+// потоков, исключение передаётся вызывающему. Без рабочих потоков всё выполняется
+// на месте. Ожидание без задач не занимает процессор, а задачи, появившиеся во
+// время ожидания, выполняет и ожидающий поток. Параллельные перегрузки сервера на
+// пуле дают те же результаты, что и последовательные.
+void TestTaskExecutor();
+
 // Функция TestSearchServer является точкой входа для запуска тестов.
 void TestSearchServer();
 